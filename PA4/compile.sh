@@ -1,4 +1,17 @@
 #!/bin/sh
-src='src/main.c src/lexer.c src/str.c src/parser.c src/pair.c src/idtable.c src/symboltable.c src/type.c src/semantics.c src/codegen.c'
-flags='-std=c11 -Wall -Werror -g'
-gcc -o compiler $src $flags 
+lib='src/cminus.c src/memory.c src/lexer.c src/str.c src/parser.c src/pair.c src/idtable.c src/symboltable.c src/type.c src/semantics.c src/codegen.c src/ring.c src/pipeline.c src/trace.c src/passes.c src/prune.c src/fold.c src/regalloc.c src/ir.c src/lower.c src/liveness.c src/inline.c src/tail.c src/numbering.c src/propagate.c src/loop.c src/hoist.c src/induction.c src/asm.c src/peephole.c'
+flags='-std=c11 -Wall -Werror -g -pthread'
+
+# libcminus.a holds the whole pipeline, the compiler is a thin driver over it
+mkdir -p obj
+for file in $lib; do
+	gcc -c -o obj/$(basename $file .c).o $file $flags || exit 1
+done
+ar rcs libcminus.a obj/*.o
+
+gcc -o compiler src/main.c libcminus.a $flags || exit 1
+
+# the library's own tests, when they came along
+if [ -d test ]; then
+	gcc -o cminus_test test/cminus_test.c libcminus.a $flags && ./cminus_test || exit 1
+fi
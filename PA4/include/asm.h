@@ -0,0 +1,53 @@
+#ifndef ASM_H
+#define ASM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "str.h"
+
+#define ASM_OPERANDS 3
+
+/* one line of a function's assembly, an instruction or a label */
+typedef struct Insn {
+
+	/* the mnemonic, empty for a label */
+	char   op[8];
+
+	/* where each operand's text starts in the pool, a label's name is the only operand */
+	int    noperands;
+	size_t operands[ASM_OPERANDS];
+
+} Insn;
+
+typedef struct Asm {
+
+	Insn*  code;
+	size_t count;
+	size_t capacity;
+
+	/* NUL terminated operand texts, only ever appended to */
+	char*  text;
+	size_t length;
+	size_t room;
+
+	/* a line was lost to memory running out */
+	bool   failed;
+
+} Asm;
+
+void Asm_init(Asm* code);
+
+/* appends one line formatted as it would be written, "addiu $sp, $sp, -4" or "_f_main:" */
+void Asm_emit(Asm* code, char const* format, ...);
+
+char const* Asm_operand(Asm const* code, Insn const* insn, int k);
+
+/* copies text into the pool, false when out of memory */
+bool Asm_intern(Asm* code, char const* text, size_t length, size_t* offset);
+
+void Asm_print(Str* out, Asm const* code);
+
+void Asm_release(Asm* code);
+
+#endif
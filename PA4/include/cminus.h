@@ -0,0 +1,132 @@
+#ifndef CMINUS_H
+#define CMINUS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "memory.h"
+#include "lexer.h"
+#include "passes.h"
+#include "codegen.h"
+#include "peephole.h"
+
+typedef enum Phase {
+	Phase_LEXER, Phase_PARSER, Phase_SEMANTICS, Phase_OPTIMIZER, Phase_CODEGEN
+} Phase;
+
+char const* Phase_to_string(Phase phase);
+
+typedef struct Diagnostic {
+
+	/* which part of the pipeline rejected the program */
+	Phase       phase;
+
+	/* phase specific, the Semantic value for Phase_SEMANTICS */
+	int         code;
+
+	/* source line, zero when the phase cannot tell */
+	int         lineno;
+
+	char const* message;
+
+} Diagnostic;
+
+typedef struct Compilation {
+	char const*       output;
+	size_t            length;
+	Diagnostic const* diagnostics;
+	size_t            ndiagnostics;
+} Compilation;
+
+typedef struct PhaseTime {
+	double wall;
+	double cpu;
+} PhaseTime;
+
+/* seconds spent in each phase, indexed by Phase */
+typedef struct Timings {
+	PhaseTime phases[Phase_CODEGEN + 1];
+} Timings;
+
+/* reusable compilation context, everything it hands out stays valid until the next compile */
+typedef struct CMinus CMinus;
+
+/* allocator may be NULL to use malloc and free */
+CMinus* CMinus_new(Allocator const* allocator);
+
+/* compile a C- source buffer into MIPS assembly without touching the file system */
+bool CMinus_compile(CMinus* cminus, char const* source, size_t length, Compilation* result);
+
+/* run the -O<level> pass pipeline over every function, on its tree and again once it is lowered,
+   and from -O1 up the backend's own rewrites and the peephole rules over the assembly */
+void CMinus_optimize(CMinus* cminus, int level);
+
+/* what later compiles and streams write, Target_MIPS unless changed */
+void CMinus_target(CMinus* cminus, Target target);
+
+/* whether the programs later compiles write collect what output prints and write it out in bulk, false unless changed */
+void CMinus_buffer_output(CMinus* cminus, bool buffered);
+
+/* the same for what input reads, taken from stdin in bulk and parsed by the program */
+void CMinus_buffer_input(CMinus* cminus, bool buffered);
+
+/* when true, the programs later compiles write pass every argument on the stack and the result in $a0
+   as at -O0, instead of in the registers -O1 and up use, whatever the level */
+void CMinus_stack_calls(CMinus* cminus, bool stack);
+
+/* how often each peephole Rule fired over all compiles so far, indexed by Rule */
+size_t const* CMinus_peephole(CMinus const* cminus);
+
+/* what each pass of the pipeline did over all compiles so far */
+PassManager const* CMinus_passes(CMinus const* cminus);
+
+/* add the time each phase takes during later compiles and streams to timings,
+   which may be NULL to stop, each phase is also a span in the current Trace */
+void CMinus_profile(CMinus* cminus, Timings* timings);
+
+/* receives assembly as soon as each declaration has been compiled */
+typedef void (*Sink)(void* state, char const* text, size_t length);
+
+/*
+ * Lex, parse, check and generate code one top-level declaration at a time,
+ * freeing each declaration once it has been handed to the sink. Only the
+ * global signatures are kept, so memory stays flat however long the input.
+ * On an error, the declarations before it have already been emitted.
+ */
+bool CMinus_stream(CMinus* cminus, Source* source, Sink sink, void* state, Compilation* result);
+
+/* what one phase of the threaded pipeline did, indexed by Phase */
+typedef struct StageStats {
+
+	/* tokens for the lexer, declarations for every later phase */
+	size_t items;
+
+	/* wall time the phase's thread was alive */
+	double seconds;
+
+	/* how often and for how long the input ring was empty */
+	size_t starved;
+	double starved_seconds;
+
+	/* how often and for how long the output ring was full */
+	size_t blocked;
+	double blocked_seconds;
+
+} StageStats;
+
+typedef struct PipelineStats {
+	StageStats stages[Phase_CODEGEN + 1];
+} PipelineStats;
+
+/*
+ * Same contract as CMinus_stream, but the lexer, parser, checker, optimizer
+ * and code generator each run on their own thread, handing tokens and finished
+ * declarations down bounded lock-free rings. All of them draw from the
+ * allocator given to CMinus_new, under a lock unless it is the default.
+ * stats may be NULL.
+ */
+bool CMinus_pipeline(CMinus* cminus, Source* source, Sink sink, void* state, Compilation* result, PipelineStats* stats);
+
+void CMinus_free(CMinus* cminus);
+
+#endif
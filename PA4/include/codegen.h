@@ -2,11 +2,57 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
-#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
 
+#include "str.h"
 #include "pair.h"
 #include "type.h"
+#include "passes.h"
 
-void codegen(FILE* file, Pair* ast);
+/* what codegen writes, spim assembly or the IR each function is lowered to */
+typedef enum Target {
+	Target_MIPS, Target_IR
+} Target;
 
-#endif
\ No newline at end of file
+typedef struct CodegenOptions {
+
+	Target       target;
+
+	/* the pipeline run over each lowered function, what it works out is used again for register allocation;
+	   any level above -O0 also turns on the backend's own rewrites */
+	PassManager* passes;
+
+	/* when optimizing, pass the first four arguments in $a0 to $a3 and the result in $v0,
+	   leaving $ra and the frame out of functions that call nothing */
+	bool         registers;
+
+	/* print through a buffer flushed with one syscall when full and at exit, instead of two syscalls per output */
+	bool         buffer_output;
+
+	/* read input a few thousand bytes at a time and parse it in the program, instead of a syscall per input */
+	bool         buffer_input;
+
+	/* how often each peephole Rule fired is added here, may be NULL */
+	size_t*      fired;
+
+} CodegenOptions;
+
+/* what generating one program keeps from one declaration to the next, so that several may be under way at once */
+typedef struct Codegen Codegen;
+
+/* false when memory ran out, out then holds only part of the program */
+bool codegen(Str* out, Pair* ast, CodegenOptions const* options);
+
+/* the same output as codegen, one checked top-level declaration at a time, NULL when out of memory */
+Codegen* codegen_begin(Str* out, CodegenOptions const* options);
+
+bool codegen_declaration(Codegen* gen, Str* out, Pair* ast);
+
+/* writes what goes after the last declaration and frees gen */
+void codegen_end(Codegen* gen, Str* out);
+
+/* frees gen when codegen_end is not going to be reached, NULL is ignored */
+void codegen_abandon(Codegen* gen);
+
+#endif
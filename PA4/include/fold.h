@@ -0,0 +1,13 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "pair.h"
+#include "passes.h"
+
+/*
+ * evaluates arithmetic and comparisons of literals as the generated code would,
+ * and drops operands that cannot change the result, x + 0, x * 1, x * 0 and x - x
+ */
+extern Pass const Pass_FOLD;
+
+#endif
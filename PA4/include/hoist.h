@@ -0,0 +1,18 @@
+#ifndef HOIST_H
+#define HOIST_H
+
+#include <stdbool.h>
+
+#include "ir.h"
+#include "passes.h"
+
+/*
+ * Moves what a loop computes the same way on every iteration into its
+ * preheader, innermost loops first so that what leaves one loop may leave the
+ * loop around it too. Only work that cannot trap moves, address arithmetic,
+ * copies, products, comparisons, and loads from a global or a frame slot
+ * that no store or call in the loop may change.
+ */
+extern Pass const Pass_HOIST;
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef INDUCTION_H
+#define INDUCTION_H
+
+#include <stdbool.h>
+
+#include "ir.h"
+#include "passes.h"
+
+/*
+ * Finds the counters a loop steps by a constant, i = i + c, and gives each
+ * array address indexed by one, base + (i << 2), a pointer of its own that is
+ * set up in the preheader and steps by c << 2 next to the counter, so the
+ * shift and the add leave the loop. A counter read by nothing else afterwards
+ * is dropped.
+ */
+extern Pass const Pass_INDUCTION;
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include <stdbool.h>
+
+#include "str.h"
+#include "ir.h"
+#include "passes.h"
+
+/* copies of the functions compiled so far that are small enough to be substituted for calls to them */
+typedef struct Inliner Inliner;
+
+Inliner* Inliner_new(void);
+
+void Inliner_free(Inliner* inliner);
+
+/*
+ * Substitutes the body of a kept function for each call to it that costs no
+ * more than the call sequence it replaces, or twice that inside a loop, while
+ * the caller stays within its budget. A function is never inlined into itself,
+ * the calls the substituted body makes stay calls. Each call inlined is
+ * reported.
+ */
+extern Pass const Pass_INLINE;
+
+/* keeps a copy of the function for the callers compiled after it when it is small enough to ever be inlined */
+extern Pass const Pass_OFFER;
+
+#endif
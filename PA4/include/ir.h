@@ -0,0 +1,202 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "str.h"
+
+/*
+ * Three address code over as many virtual registers as it takes,
+ * grouped into basic blocks that each end in one jump, branch or return.
+ * Scalar locals and parameters are virtual registers themselves,
+ * memory is only touched for globals, arrays and what the backend spills.
+ */
+
+typedef enum Op {
+
+	/* dst = a */
+	Op_COPY,
+
+	/* dst = a op b, add and sub trap on overflow as C- arithmetic does */
+	Op_ADD, Op_SUB, Op_MUL, Op_DIV,
+
+	/* dst = 1 when a op b holds, else 0 */
+	Op_LT, Op_LE, Op_GT, Op_GE, Op_EQ, Op_NE,
+
+	/* address arithmetic, which wraps instead of trapping, dst = a + b and dst = a << imm */
+	Op_ADDU, Op_SLL,
+
+	/* dst = the address of symbol or of the frame slot, plus imm */
+	Op_ADDR,
+
+	/* dst = the word at the address, the word at the address = b */
+	Op_LOAD, Op_STORE,
+
+	/* dst = the parameter numbered imm from zero */
+	Op_PARAM,
+
+	/* dst = symbol(args), dst is -1 when the value goes unused */
+	Op_CALL,
+
+	/* goto targets[0] */
+	Op_JUMP,
+
+	/* goto targets[0] when the comparison imm, Op_LT to Op_NE, holds between a and b, else targets[1] */
+	Op_BRANCH,
+
+	/* leave the function with a, which may be none */
+	Op_RETURN,
+
+	/* leave the function by calling symbol(args) in its place, its result is ours */
+	Op_TAILCALL,
+
+	Op_COUNT
+
+} Op;
+
+char const* Op_to_string(Op op);
+
+bool Op_is_terminator(Op op);
+
+typedef enum OperandKind {
+	OperandKind_NONE, OperandKind_VREG, OperandKind_CONST
+} OperandKind;
+
+typedef struct Operand {
+	OperandKind kind;
+	int         value;
+} Operand;
+
+extern Operand const Operand_NONE;
+
+Operand Operand_vreg(int vreg);
+
+Operand Operand_const(int value);
+
+typedef struct Block Block;
+
+/*
+ * Loads, stores and ADDR address symbol, or the frame slot, or neither,
+ * plus the register in a when there is one, plus imm bytes.
+ */
+typedef struct Instr {
+
+	Op          op;
+
+	/* virtual register written, -1 for none */
+	int         dst;
+
+	Operand     a;
+	Operand     b;
+	int         imm;
+
+	/* global variable or function called, without its prefix */
+	char const* symbol;
+
+	/* frame slot addressed, -1 for none */
+	int         slot;
+
+	/* call arguments, left to right */
+	Operand*    args;
+	int         nargs;
+
+	/* jump target, or branch taken and not taken */
+	Block*      targets[2];
+
+} Instr;
+
+/* the operands an instruction reads in turn, a, b and then the arguments, NULL past the last */
+Operand* Instr_use(Instr* instr, size_t i);
+
+struct Block {
+
+	/* unique within the function, for labels and the dump */
+	int     id;
+
+	/* while loops around the block when it was lowered */
+	int     depth;
+
+	Instr*  code;
+	size_t  count;
+	size_t  capacity;
+
+	/* filled in by Procedure_edges */
+	Block** preds;
+	size_t  npreds;
+	size_t  pcapacity;
+
+	/* filled in by Procedure_dominators, NULL for the entry */
+	Block*  idom;
+
+};
+
+/* the successors of a block that ends in its terminator */
+int Block_successors(Block const* block, Block* successors[2]);
+
+/*
+ * An addressable piece of the frame, a local array. It is only in use from
+ * the scope declaring it opening to the last scope inside that one closing,
+ * scopes being numbered in the order they open, so two slots whose ranges
+ * do not overlap may share their words.
+ */
+typedef struct Slot {
+	char const* name;
+	int         size;
+	int         first;
+	int         last;
+} Slot;
+
+typedef struct Procedure {
+
+	char const*  name;
+	int          nparams;
+
+	/* the variable each virtual register holds, NULL for temporaries */
+	int          nvregs;
+	char const** names;
+	size_t       ncapacity;
+
+	/* blocks[0] is the entry, the order is the order code is laid out in */
+	Block**      blocks;
+	size_t       nblocks;
+	size_t       bcapacity;
+	int          nextblock;
+
+	Slot*        slots;
+	size_t       nslots;
+	size_t       scapacity;
+
+	/* an allocation failed while building, the function is not to be used */
+	bool         failed;
+
+} Procedure;
+
+Procedure* Procedure_new(char const* name, int nparams);
+
+void Procedure_free(Procedure* function);
+
+/* a new empty block at the end of the layout */
+Block* Procedure_block(Procedure* function);
+
+/* a new virtual register, name is NULL for a temporary */
+int Procedure_vreg(Procedure* function, char const* name);
+
+/* a slot in use throughout the function, until its scopes are narrowed */
+int Procedure_slot(Procedure* function, char const* name, int size);
+
+/* copies instr to the end of block, taking over its args, NULL when out of memory */
+Instr* Block_append(Procedure* function, Block* block, Instr const* instr);
+
+/* drops blocks the entry cannot reach, then recomputes every block's predecessors */
+bool Procedure_edges(Procedure* function);
+
+/* the immediate dominator of every block, the predecessors must be up to date */
+bool Procedure_dominators(Procedure* function);
+
+/* whether every path from the entry to b passes through a, as of Procedure_dominators */
+bool Block_dominates(Block const* a, Block const* b);
+
+void Procedure_dump(Str* out, Procedure const* function);
+
+#endif
@@ -26,18 +26,44 @@ typedef struct Token {
 
 } Token;
 
+/* characters are read either from a stream or from a buffer in memory */
+typedef struct Source {
+    FILE*       file;
+    char const* buffer;
+    size_t      length;
+    size_t      position;
+} Source;
+
+Source Source_file(FILE* file);
+
+Source Source_buffer(char const* buffer, size_t length);
+
+int Source_getc(Source* source);
+
+void Source_ungetc(Source* source, int glyph);
+
 Token* Token_new(void);
 
 void Token_free(Token* token);
 
-bool lex(FILE* source, Token* token);
+bool lex(Source* source, Token* token);
 
 typedef struct TokenList {
 	Token             value;
 	struct TokenList* next;
 } TokenList;
 
-TokenList* lexlist(FILE* source);
+TokenList* lexlist(Source* source);
+
+/* lex only as far as the end of the next top-level declaration,
+   token carries the line count from one call to the next */
+TokenList* lexdeclaration(Source* source, Token* token);
+
+/* true once token closes a top-level declaration, depth starts at zero */
+bool lexboundary(Token const* token, int* depth);
+
+/* the first error token in the list, NULL when it is clean */
+TokenList* lexinvalid(TokenList* tokens);
 
 void lexfree(TokenList* tokens);
 
@@ -0,0 +1,20 @@
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include <stdbool.h>
+
+#include "ir.h"
+
+/* the virtual registers live on entry to and exit from each block of a function */
+typedef struct Liveness Liveness;
+
+/* the function's predecessors must be up to date, NULL when out of memory */
+Liveness* Liveness_compute(Procedure const* function);
+
+bool Liveness_in(Liveness const* liveness, Block const* block, int vreg);
+
+bool Liveness_out(Liveness const* liveness, Block const* block, int vreg);
+
+void Liveness_free(Liveness* liveness);
+
+#endif
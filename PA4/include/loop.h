@@ -0,0 +1,38 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "ir.h"
+
+/* a natural loop that is only entered from a preheader, as lower_iteration builds them */
+typedef struct Loop {
+
+	/* the target of the back edges, which dominates the rest of the loop */
+	Block*  header;
+
+	/* the only predecessor of the header outside the loop, ending in a jump to it */
+	Block*  preheader;
+
+	/* the blocks of the loop in layout order, the header among them */
+	Block** blocks;
+	size_t  count;
+
+	/* by block id */
+	bool*   contains;
+
+} Loop;
+
+typedef struct Loops {
+	Loop*  loops;
+	size_t count;
+} Loops;
+
+/* the loops of a function with a preheader, innermost first, the dominators must be up to date,
+   false when out of memory */
+bool Loops_find(Procedure* function, Loops* loops);
+
+void Loops_release(Loops* loops);
+
+#endif
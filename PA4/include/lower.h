@@ -0,0 +1,14 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include "pair.h"
+#include "ir.h"
+
+/*     !!! WARNING !!!
+   DECLARATION MUST PASS SEMANTIC
+   ANALYSIS BEFORE LOWERING */
+
+/* the IR of a function declaration, NULL when out of memory */
+Procedure* lower_function(Pair* declaration);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <threads.h>
+
+typedef struct Allocator {
+
+	/* handed back to every callback untouched */
+	void*  state;
+
+	void* (*allocate)(void* state, size_t size);
+	void* (*reallocate)(void* state, void* block, size_t size);
+	void  (*release)(void* state, void* block);
+
+} Allocator;
+
+/* wraps malloc, realloc and free */
+extern Allocator const Allocator_DEFAULT;
+
+/* install the allocator every subsystem draws from on the calling thread, returning the previous one */
+Allocator const* Memory_use(Allocator const* allocator);
+
+/* the subsystem an allocation is charged to */
+typedef enum MemoryTag {
+	MemoryTag_OTHER, MemoryTag_STR, MemoryTag_TOKENLIST, MemoryTag_PAIR,
+	MemoryTag_IDTABLE, MemoryTag_TYPE, MemoryTag_IR, MemoryTag_ASM, MemoryTag_COUNT
+} MemoryTag;
+
+char const* MemoryTag_to_string(MemoryTag tag);
+
+typedef struct MemoryStats {
+	size_t allocations;
+	size_t bytes;
+	size_t live;
+	size_t peak;
+} MemoryStats;
+
+/*
+ * Account every later allocation of the calling thread into stats, one entry
+ * per MemoryTag. Tracked blocks carry a header the others lack, so this has to
+ * be called before the thread allocates anything, and a block is only to be
+ * freed by a thread tracking as the one that allocated it was.
+ */
+void Memory_track(MemoryStats stats[MemoryTag_COUNT]);
+
+void* Memory_alloc(MemoryTag tag, size_t size);
+
+void* Memory_calloc(MemoryTag tag, size_t count, size_t size);
+
+void* Memory_realloc(MemoryTag tag, void* block, size_t size);
+
+void Memory_free(void* block);
+
+typedef struct ArenaChunk {
+	size_t             size;
+	size_t             used;
+	struct ArenaChunk* next;
+	/* allocations follow the header */
+} ArenaChunk;
+
+/*
+ * Bump allocator over chunks taken from a backing allocator.
+ * Freeing is a no-op, Arena_reset rewinds every chunk so that
+ * a repeated workload is served entirely from existing chunks.
+ */
+typedef struct Arena {
+	Allocator const* backing;
+	Allocator        allocator;
+	ArenaChunk*      first;
+	ArenaChunk*      here;
+} Arena;
+
+void Arena_init(Arena* arena, Allocator const* backing);
+
+void Arena_reset(Arena* arena);
+
+void Arena_release(Arena* arena);
+
+/* Calls a backing allocator under a lock, for one not safe to call from several threads at once. */
+typedef struct Locked {
+	Allocator const* backing;
+	Allocator        allocator;
+	mtx_t            lock;
+} Locked;
+
+/* false when the lock could not be made */
+bool Locked_init(Locked* locked, Allocator const* backing);
+
+void Locked_release(Locked* locked);
+
+#endif
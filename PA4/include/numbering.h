@@ -0,0 +1,20 @@
+#ifndef NUMBERING_H
+#define NUMBERING_H
+
+#include <stdbool.h>
+
+#include "ir.h"
+#include "passes.h"
+
+/*
+ * Numbers the values the virtual registers hold, walking the dominator tree,
+ * and drops what a dominating block or an earlier instruction already worked
+ * out the same way: arithmetic, comparisons, address arithmetic, and loads
+ * that no store or call on the way may have changed, a store counting as
+ * the load of the value it wrote. A temporary the function writes once is
+ * replaced by the register already holding its value, anything else is left
+ * a copy of it. How many were dropped is reported.
+ */
+extern Pass const Pass_NUMBERING;
+
+#endif
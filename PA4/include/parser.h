@@ -9,6 +9,12 @@
 
 Pair* parse(TokenList* tokens);
 
+/* parse tokens holding exactly one top-level declaration */
+Pair* parse_declaration(TokenList* tokens);
+
+/* line the last parse gave up on */
+int parse_lineno(void);
+
 void write_ast(FILE* file, Pair* root);
 
 #endif
\ No newline at end of file
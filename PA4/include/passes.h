@@ -0,0 +1,116 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "str.h"
+#include "pair.h"
+#include "ir.h"
+
+/* facts about a function that passes ask for instead of working out themselves */
+typedef enum Analysis {
+
+	/* of the tree of a checked function */
+	Analysis_FLOW,
+
+	/* of a lowered function, the immediate dominator of each block, the loops they make and the registers live across blocks */
+	Analysis_DOMINATORS,
+	Analysis_LOOPS,
+	Analysis_LIVENESS,
+
+	Analysis_COUNT
+
+} Analysis;
+
+#define ANALYSIS(analysis) (1u << (analysis))
+
+/* what goes stale when a pass changes the blocks of a lowered function or how they branch */
+#define ANALYSES_CFG (ANALYSIS(Analysis_DOMINATORS) | ANALYSIS(Analysis_LOOPS) | ANALYSIS(Analysis_LIVENESS))
+
+char const* Analysis_to_string(Analysis analysis);
+
+/* results for the function being optimized, kept until a pass invalidates them */
+typedef struct Analyses {
+	Pair*      function;
+	Procedure* procedure;
+	unsigned   valid;
+	void*      results[Analysis_COUNT];
+	size_t     computed[Analysis_COUNT];
+	size_t     reused[Analysis_COUNT];
+} Analyses;
+
+/* the cached result, computed first when it is missing or stale, NULL when out of memory */
+void const* Analyses_get(Analyses* analyses, Analysis analysis);
+
+/* drops every result, once the function they were worked out for is done with */
+void Analyses_clear(Analyses* analyses);
+
+typedef struct Inliner Inliner;
+
+/* what the passes over lowered functions share across one program, and where they say what they did */
+typedef struct PassContext {
+
+	/* the functions kept to be inlined, NULL until a pass first needs them */
+	Inliner*    inliner;
+
+	/* each note is a line starting with comment */
+	Str*        report;
+	char const* comment;
+
+} PassContext;
+
+typedef struct Pass {
+
+	char const* name;
+
+	/* analyses worked out before the pass runs */
+	unsigned    requires;
+
+	/* analyses that go stale whenever the pass reports a change */
+	unsigned    invalidates;
+
+	/* a pass over the tree of a checked function, true when the function was changed */
+	bool      (*run)(Pair* function, Analyses* analyses);
+
+	/* a pass over a lowered function instead, false when out of memory, changed is set when it did anything */
+	bool      (*lowered)(Procedure* function, Analyses* analyses, PassContext* context, bool* changed);
+
+} Pass;
+
+typedef struct PassStats {
+	char const* name;
+	size_t      runs;
+	size_t      changed;
+	double      seconds;
+} PassStats;
+
+#define MAX_PASSES 16
+
+typedef struct PassManager {
+	int         level;
+	size_t      npasses;
+	Pass const* passes[MAX_PASSES];
+	PassStats   stats[MAX_PASSES];
+
+	/* for the tree being optimized and the function being lowered, which the pipeline works on from different threads */
+	Analyses    analyses;
+	Analyses    lowered;
+} PassManager;
+
+/* the pipeline for -O0, -O1 or -O2, higher levels are clamped to -O2 */
+void PassManager_init(PassManager* manager, int level);
+
+/* run the passes over the tree of one checked function declaration */
+bool PassManager_run(PassManager* manager, Pair* function);
+
+/*
+ * Runs the passes over one lowered function, false when out of memory. What
+ * they worked out is left in lowered for the code generator, until
+ * Analyses_clear or the next function.
+ */
+bool PassManager_run_lowered(PassManager* manager, Procedure* function, PassContext* context);
+
+void PassManager_release(PassManager* manager);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stddef.h>
+
+#include "asm.h"
+
+typedef enum Rule {
+	Rule_MOVE_BACK,
+	Rule_SAME_ADDRESS,
+	Rule_STORE_STORE,
+	Rule_LOAD_LOAD,
+	Rule_LOAD_STORE,
+	Rule_LI_LOAD,
+	Rule_LI_LI,
+	Rule_MOVE_LI,
+	Rule_MOVE_MOVE,
+	Rule_MFLO_LI,
+	Rule_COUNT
+} Rule;
+
+char const* Rule_to_string(Rule rule);
+
+/*
+ * Slides a window of a few instructions over the code, rewriting it wherever
+ * one of the rules matches until none does, and adds how often each rule fired
+ * to fired, which may be NULL. Rules never look past a label.
+ */
+void Peephole_run(Asm* code, size_t fired[Rule_COUNT]);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "cminus.h"
+
+/*
+ * The threads behind CMinus_pipeline, each drawing from allocator. On failure
+ * error describes the earliest declaration in the source that was rejected,
+ * with any message it needs formatted into text.
+ */
+bool pipeline(Source* source, Sink sink, void* state, Allocator const* allocator, PassManager* passes, CodegenOptions const* codegen, PipelineStats* stats, Diagnostic* error, char* text, size_t size);
+
+#endif
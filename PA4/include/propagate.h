@@ -0,0 +1,20 @@
+#ifndef PROPAGATE_H
+#define PROPAGATE_H
+
+#include <stdbool.h>
+
+#include "ir.h"
+#include "passes.h"
+
+/*
+ * Sparse conditional constant propagation over the SSA form of the
+ * function, worked out on the side with phis where definitions of a
+ * register meet. Only the edges found to be taken count, so a constant
+ * stays one past a branch that always goes the same way. Each use of a
+ * constant becomes the constant, a branch it decides becomes a jump, and
+ * the blocks no longer reached are dropped. Nothing is folded that would
+ * have trapped.
+ */
+extern Pass const Pass_PROPAGATE;
+
+#endif
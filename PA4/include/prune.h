@@ -0,0 +1,24 @@
+#ifndef PRUNE_H
+#define PRUNE_H
+
+#include <stdbool.h>
+
+#include "pair.h"
+#include "passes.h"
+
+/* the statements of a function that can never finish and fall through to the next one */
+typedef struct Flow Flow;
+
+Flow* Flow_compute(Pair* function);
+
+bool Flow_completes(Flow const* flow, Pair* statement);
+
+void Flow_free(Flow* flow);
+
+/* replaces if and while statements whose condition is a literal by what they reduce to */
+extern Pass const Pass_DEAD_BRANCHES;
+
+/* drops the statements of a block that follow one that never completes */
+extern Pass const Pass_UNREACHABLE;
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <stddef.h>
+
+/* a value that must stay in one place from position start to position end */
+typedef struct Interval {
+
+	int key;
+	int start;
+	int end;
+
+	/* uses, scaled up by how deeply they are nested in loops */
+	int weight;
+
+	/* the registers it may be given, as bits */
+	unsigned allowed;
+
+	/* the register it was given, or -1 when it stays in memory */
+	int reg;
+
+} Interval;
+
+/*
+ * Linear scan over the intervals in order of their start, handing each the
+ * lowest numbered free register it is allowed, out of at most 32. When none
+ * is free the lightest of the new interval and the live ones it could take
+ * a register from goes to memory.
+ * The intervals are reordered, returns the mask of registers handed out.
+ */
+unsigned Interval_allocate(Interval* intervals, size_t count);
+
+#endif
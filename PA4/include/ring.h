@@ -0,0 +1,47 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+
+/* keeps the two ends of a ring off each other's cache line */
+#define RING_LINE 64
+
+/*
+ * Bounded queue between exactly one producer and one consumer thread.
+ * Each end only ever writes its own index, so no locks are needed,
+ * a full or empty ring is waited out by yielding the thread.
+ */
+typedef struct Ring {
+
+	void**                  slots;
+	size_t                  mask;
+
+	/* next slot to pop, written by the consumer only */
+	alignas(RING_LINE) atomic_size_t head;
+
+	/* times the consumer found the ring empty and how long it waited */
+	size_t                  empty_stalls;
+	double                  empty_seconds;
+
+	/* next slot to push, written by the producer only */
+	alignas(RING_LINE) atomic_size_t tail;
+
+	/* times the producer found the ring full and how long it waited */
+	size_t                  full_stalls;
+	double                  full_seconds;
+
+} Ring;
+
+/* capacity is rounded up to a power of two */
+bool Ring_init(Ring* ring, size_t capacity);
+
+void Ring_push(Ring* ring, void* item);
+
+void* Ring_pop(Ring* ring);
+
+void Ring_release(Ring* ring);
+
+#endif
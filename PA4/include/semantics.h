@@ -2,7 +2,10 @@
 #ifndef SEMANTICS_H
 #define SEMANTICS_H
 
+#include <stdbool.h>
+
 #include "pair.h"
+#include "type.h"
 
 typedef enum Semantic {
 	/* 0 */ Semantic_OK,
@@ -18,6 +21,26 @@ typedef enum Semantic {
 	/* A */ Semantic_BAD_LITERAL_VALUE
 } Semantic;
 
+char const* Semantic_to_string(Semantic semantic);
+
 Semantic check_semantics(Pair* ast);
 
+/* checks a program one top-level declaration at a time,
+   only the global scope survives between declarations */
+typedef struct Checker {
+	struct SymbolTable* table;
+	Type*               main_type;
+	bool                declared;
+	bool                last_main;
+} Checker;
+
+Checker* Checker_new(void);
+
+Semantic Checker_declaration(Checker* checker, Pair* ast);
+
+/* verify the program as a whole once every declaration is in */
+Semantic Checker_finish(Checker* checker);
+
+void Checker_free(Checker* checker);
+
 #endif
\ No newline at end of file
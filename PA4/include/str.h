@@ -1,7 +1,8 @@
-
 #ifndef STR_H
 #define STR_H
 
+#include <stddef.h>
+
 typedef struct Str {
 
     /* current length of the string */
@@ -29,4 +30,10 @@ void Str_pushchar(Str* s, char glyph);
 
 void Str_copy_nulterm(Str* s, char* nulterm);
 
-#endif
\ No newline at end of file
+void Str_append(Str* s, char const* text, size_t length);
+
+void Str_puts(Str* s, char const* nulterm);
+
+void Str_printf(Str* s, char const* format, ...);
+
+#endif
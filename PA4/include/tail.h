@@ -0,0 +1,22 @@
+#ifndef TAIL_H
+#define TAIL_H
+
+#include <stdbool.h>
+
+#include "ir.h"
+#include "passes.h"
+
+/* the most arguments a tail call to another function passes, through $a0 to $a3 */
+#define TAIL_ARGUMENTS 4
+
+/*
+ * Turns a call whose result the function returns straight away into a tail
+ * call. A call to the function itself becomes a jump back to just past its
+ * parameters once they hold the new arguments. A call to any other function
+ * leaves through the callee, reusing the frame, when its arguments fit in the
+ * words the caller pushed for ours and the function has no arrays of its own
+ * that one of them could point into.
+ */
+extern Pass const Pass_TAIL;
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* wall clock in seconds */
+double Trace_wall(void);
+
+/* processor time used by the whole process in seconds */
+double Trace_cpu(void);
+
+/*
+ * Chrome trace-event JSON, for chrome://tracing or ui.perfetto.dev.
+ * Spans are written as they happen so nothing is buffered in memory.
+ */
+typedef struct Trace {
+	FILE*  file;
+	double origin;
+	size_t events;
+} Trace;
+
+void Trace_open(Trace* trace, FILE* file);
+
+void Trace_close(Trace* trace);
+
+/* route the spans below to trace, NULL turns them into no-ops */
+void Trace_use(Trace* trace);
+
+/* open and close a span, which nest like the calls around them */
+void Trace_begin(char const* category, char const* name);
+
+void Trace_end(char const* category, char const* name);
+
+#endif
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "../include/memory.h"
+#include "../include/asm.h"
+
+void Asm_init(Asm* code) {
+	*code = (Asm) { NULL, 0, 0, NULL, 0, 0, false };
+}
+
+char const* Asm_operand(Asm const* code, Insn const* insn, int k) {
+	return code->text + insn->operands[k];
+}
+
+bool Asm_intern(Asm* code, char const* text, size_t length, size_t* offset) {
+
+	if (code->length + length + 1 > code->room) {
+
+		size_t room   = code->room ? code->room * 2 : 1024;
+		while (room < code->length + length + 1) room *= 2;
+
+		char*  larger = Memory_realloc(MemoryTag_ASM, code->text, room);
+
+		if (!larger) {
+			code->failed = true;
+			return false;
+		}
+
+		code->text = larger;
+		code->room = room;
+	}
+
+	memcpy(code->text + code->length, text, length);
+	code->text[code->length + length] = '\0';
+
+	*offset       = code->length;
+	code->length += length + 1;
+
+	return true;
+}
+
+/* interns the text between start and end, minus surrounding spaces */
+static bool field(Asm* code, size_t* offset, char const* start, char const* end) {
+
+	while (start < end && *start == ' ') ++start;
+	while (end > start && end[-1] == ' ') --end;
+
+	return Asm_intern(code, start, end - start, offset);
+}
+
+static bool parse(Asm* code, Insn* insn, char const* line) {
+
+	size_t      length = strlen(line);
+	char const* end    = line + length;
+
+	insn->op[0]     = '\0';
+	insn->noperands = 0;
+
+	if (length && line[length - 1] == ':') {
+		insn->noperands = 1;
+		return field(code, &insn->operands[0], line, end - 1);
+	}
+
+	while (*line == ' ') ++line;
+
+	size_t mnemonic = strcspn(line, " ");
+	if (mnemonic >= sizeof insn->op) return false;
+
+	memcpy(insn->op, line, mnemonic);
+	insn->op[mnemonic] = '\0';
+
+	for (char const* start = line + mnemonic; start < end;) {
+
+		char const* comma = strchr(start, ',');
+		if (!comma) comma = end;
+
+		if (insn->noperands == ASM_OPERANDS) return false;
+		if (!field(code, &insn->operands[insn->noperands++], start, comma)) return false;
+
+		start = comma + 1;
+	}
+
+	return true;
+}
+
+void Asm_emit(Asm* code, char const* format, ...) {
+
+	char    small[128];
+	char*   line = small;
+	va_list args, again;
+
+	va_start(args, format);
+	va_copy(again, args);
+
+	int length = vsnprintf(small, sizeof small, format, args);
+
+	/* identifiers have no length limit, so neither do labels */
+	if (length >= 0 && (size_t) length >= sizeof small) {
+		line = Memory_alloc(MemoryTag_ASM, length + 1);
+		if (line) vsnprintf(line, length + 1, format, again);
+	}
+
+	va_end(again);
+	va_end(args);
+
+	if (length < 0 || !line) goto fail;
+
+	if (code->count == code->capacity) {
+
+		size_t capacity = code->capacity ? code->capacity * 2 : 64;
+		Insn*  larger   = Memory_realloc(MemoryTag_ASM, code->code, capacity * sizeof (Insn));
+
+		if (!larger) goto fail;
+
+		code->code     = larger;
+		code->capacity = capacity;
+	}
+
+	if (!parse(code, &code->code[code->count], line)) goto fail;
+
+	++code->count;
+	if (line != small) Memory_free(line);
+	return;
+
+fail:
+	code->failed = true;
+	if (line != small) Memory_free(line);
+}
+
+void Asm_print(Str* out, Asm const* code) {
+
+	for (size_t i = 0; i < code->count; ++i) {
+
+		Insn const* insn = &code->code[i];
+
+		if (!insn->op[0]) {
+			Str_printf(out, "%s:\n", Asm_operand(code, insn, 0));
+			continue;
+		}
+
+		Str_printf(out, "  %s", insn->op);
+
+		for (int k = 0; k < insn->noperands; ++k) {
+			Str_printf(out, "%s%s", k ? ", " : " ", Asm_operand(code, insn, k));
+		}
+
+		Str_puts(out, "\n");
+	}
+}
+
+void Asm_release(Asm* code) {
+	Memory_free(code->code);
+	Memory_free(code->text);
+	Asm_init(code);
+}
@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/str.h"
+#include "../include/pair.h"
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "../include/semantics.h"
+#include "../include/codegen.h"
+#include "../include/cminus.h"
+#include "../include/pipeline.h"
+#include "../include/trace.h"
+
+/* each phase stops at the first error so there is never more than a handful */
+#define MAX_DIAGNOSTICS 8
+#define MAX_MESSAGE     64
+
+struct CMinus {
+	Allocator      backing;
+	Arena          arena;
+	Timings*       timings;
+	PassManager    passes;
+	CodegenOptions codegen;
+	size_t         fired[Rule_COUNT];
+	size_t         ndiagnostics;
+	Diagnostic     diagnostics[MAX_DIAGNOSTICS];
+	char           messages[MAX_DIAGNOSTICS][MAX_MESSAGE];
+};
+
+char const* Phase_to_string(Phase phase) {
+	switch (phase) {
+		case Phase_LEXER:     return "lexer";
+		case Phase_PARSER:    return "parser";
+		case Phase_SEMANTICS: return "semantics";
+		case Phase_OPTIMIZER: return "optimizer";
+		case Phase_CODEGEN:   return "codegen";
+		default:              return "???";
+	}
+}
+
+CMinus* CMinus_new(Allocator const* allocator) {
+
+	if (!allocator) allocator = &Allocator_DEFAULT;
+
+	CMinus* cminus = allocator->allocate(allocator->state, sizeof (CMinus));
+	if (!cminus) return NULL;
+
+	cminus->backing      = *allocator;
+	cminus->ndiagnostics = 0;
+	cminus->timings      = NULL;
+	cminus->codegen      = (CodegenOptions) { .target = Target_MIPS, .passes = &cminus->passes, .registers = true, .fired = cminus->fired };
+	memset(cminus->fired, 0, sizeof cminus->fired);
+	PassManager_init(&cminus->passes, 0);
+	Arena_init(&cminus->arena, &cminus->backing);
+
+	return cminus;
+}
+
+void CMinus_optimize(CMinus* cminus, int level) {
+	PassManager_release(&cminus->passes);
+	PassManager_init(&cminus->passes, level);
+}
+
+void CMinus_stack_calls(CMinus* cminus, bool stack) {
+	cminus->codegen.registers = !stack;
+}
+
+void CMinus_target(CMinus* cminus, Target target) {
+	cminus->codegen.target = target;
+}
+
+void CMinus_buffer_output(CMinus* cminus, bool buffered) {
+	cminus->codegen.buffer_output = buffered;
+}
+
+void CMinus_buffer_input(CMinus* cminus, bool buffered) {
+	cminus->codegen.buffer_input = buffered;
+}
+
+size_t const* CMinus_peephole(CMinus const* cminus) {
+	return cminus->fired;
+}
+
+PassManager const* CMinus_passes(CMinus const* cminus) {
+	return &cminus->passes;
+}
+
+/* only function bodies have anything to optimize */
+static void optimize(CMinus* cminus, Pair* declaration) {
+	if (declaration->val == ASType_FUN_DECLARATION) {
+		PassManager_run(&cminus->passes, declaration);
+	}
+}
+
+void CMinus_profile(CMinus* cminus, Timings* timings) {
+	cminus->timings = timings;
+}
+
+/* when the running phase started */
+typedef struct Clock {
+	Phase  phase;
+	double wall;
+	double cpu;
+} Clock;
+
+static Clock start(CMinus* cminus, Phase phase) {
+
+	Trace_begin("phase", Phase_to_string(phase));
+
+	Clock clock = { phase, 0, 0 };
+	if (cminus->timings) {
+		clock.wall = Trace_wall();
+		clock.cpu  = Trace_cpu();
+	}
+
+	return clock;
+}
+
+static void stop(CMinus* cminus, Clock clock) {
+
+	if (cminus->timings) {
+		PhaseTime* time = &cminus->timings->phases[clock.phase];
+		time->wall += Trace_wall() - clock.wall;
+		time->cpu  += Trace_cpu() - clock.cpu;
+	}
+
+	Trace_end("phase", Phase_to_string(clock.phase));
+}
+
+static void diagnose(CMinus* cminus, Phase phase, int code, int lineno, char const* message) {
+
+	if (cminus->ndiagnostics == MAX_DIAGNOSTICS) return;
+
+	Diagnostic* d = &cminus->diagnostics[cminus->ndiagnostics++];
+	d->phase   = phase;
+	d->code    = code;
+	d->lineno  = lineno;
+	d->message = message;
+}
+
+/* the lexer does not fail, it emits error tokens the parser then chokes on */
+static bool check_tokens(CMinus* cminus, TokenList* tokens) {
+
+	TokenList* bad = lexinvalid(tokens);
+	if (!bad) return true;
+
+	if (cminus->ndiagnostics == MAX_DIAGNOSTICS) return false;
+
+	/* the message has to last as long as the other diagnostics */
+	char* message = cminus->messages[cminus->ndiagnostics];
+	snprintf(message, MAX_MESSAGE, "invalid token \"%s\"", bad->value.lexeme->buffer);
+
+	diagnose(cminus, Phase_LEXER, TokenType_ERR, bad->value.lineno, message);
+	return false;
+}
+
+bool CMinus_compile(CMinus* cminus, char const* source, size_t length, Compilation* result) {
+
+	bool ok = false;
+
+	/* everything from the previous compile is dead, rewind the arena over it */
+	Arena_reset(&cminus->arena);
+	cminus->ndiagnostics = 0;
+
+	Allocator const* previous = Memory_use(&cminus->arena.allocator);
+
+	Str* out = Str_new(4096);
+	if (!out) {
+		diagnose(cminus, Phase_CODEGEN, 0, 0, "out of memory");
+		goto done;
+	}
+
+	Clock clock = start(cminus, Phase_LEXER);
+
+	Source     text   = Source_buffer(source, length);
+	TokenList* tokens = lexlist(&text);
+
+	stop(cminus, clock);
+	if (!check_tokens(cminus, tokens)) goto done;
+
+	clock = start(cminus, Phase_PARSER);
+	Pair* ast = parse(tokens);
+	stop(cminus, clock);
+
+	if (!ast) {
+		diagnose(cminus, Phase_PARSER, 0, parse_lineno(), "syntax error");
+		goto done;
+	}
+
+	clock = start(cminus, Phase_SEMANTICS);
+	Semantic s = check_semantics(ast);
+	stop(cminus, clock);
+
+	if (s != Semantic_OK) {
+		diagnose(cminus, Phase_SEMANTICS, s, 0, Semantic_to_string(s));
+		goto done;
+	}
+
+	clock = start(cminus, Phase_OPTIMIZER);
+	for (Pair* node = ast->cdr; node; node = node->cdr) {
+		optimize(cminus, node->car);
+	}
+	stop(cminus, clock);
+
+	clock = start(cminus, Phase_CODEGEN);
+	bool generated = codegen(out, ast, &cminus->codegen);
+	stop(cminus, clock);
+
+	if (!generated) {
+		diagnose(cminus, Phase_CODEGEN, 0, 0, "out of memory");
+		goto done;
+	}
+
+	ok = true;
+
+	/* no need to free the tokens or the tree, the arena owns them */
+done:
+	Memory_use(previous);
+
+	result->output       = out ? out->buffer : "";
+	result->length       = out && ok ? out->length : 0;
+	result->diagnostics  = cminus->diagnostics;
+	result->ndiagnostics = cminus->ndiagnostics;
+
+	return ok;
+}
+
+static void flush(Str* out, Sink sink, void* state) {
+	sink(state, out->buffer, out->length);
+	Str_clear(out);
+}
+
+bool CMinus_stream(CMinus* cminus, Source* source, Sink sink, void* state, Compilation* result) {
+
+	bool     ok = false;
+	Semantic s;
+
+	Arena_reset(&cminus->arena);
+	cminus->ndiagnostics = 0;
+
+	/* declarations are really freed as we go, which the arena would not do */
+	Allocator const* previous = Memory_use(&cminus->backing);
+
+	Str*     out     = Str_new(4096);
+	Token*   token   = Token_new();
+	Checker* checker = Checker_new();
+	Codegen* gen     = out ? codegen_begin(out, &cminus->codegen) : NULL;
+
+	if (!out || !token || !checker || !gen) {
+		diagnose(cminus, Phase_CODEGEN, 0, 0, "out of memory");
+		goto done;
+	}
+
+	flush(out, sink, state);
+
+	for (;;) {
+
+		Pair* ast   = NULL;
+		Clock clock = start(cminus, Phase_LEXER);
+
+		TokenList* tokens = lexdeclaration(source, token);
+		stop(cminus, clock);
+
+		if (!tokens) break;
+		if (!check_tokens(cminus, tokens)) goto next;
+
+		clock = start(cminus, Phase_PARSER);
+		ast   = parse_declaration(tokens);
+		stop(cminus, clock);
+
+		if (!ast) {
+			diagnose(cminus, Phase_PARSER, 0, parse_lineno(), "syntax error");
+			goto next;
+		}
+
+		clock = start(cminus, Phase_SEMANTICS);
+		s     = Checker_declaration(checker, ast);
+		stop(cminus, clock);
+
+		if (s != Semantic_OK) {
+			diagnose(cminus, Phase_SEMANTICS, s, 0, Semantic_to_string(s));
+			goto next;
+		}
+
+		clock = start(cminus, Phase_OPTIMIZER);
+		optimize(cminus, ast);
+		stop(cminus, clock);
+
+		clock = start(cminus, Phase_CODEGEN);
+		bool generated = codegen_declaration(gen, out, ast);
+		stop(cminus, clock);
+
+		if (!generated) {
+			diagnose(cminus, Phase_CODEGEN, 0, 0, "out of memory");
+			goto next;
+		}
+
+		flush(out, sink, state);
+
+	next:
+		Pair_free(ast);
+		lexfree(tokens);
+
+		if (cminus->ndiagnostics) goto done;
+	}
+
+	s = Checker_finish(checker);
+	if (s != Semantic_OK) {
+		diagnose(cminus, Phase_SEMANTICS, s, 0, Semantic_to_string(s));
+		goto done;
+	}
+
+	codegen_end(gen, out);
+	flush(out, sink, state);
+	gen = NULL;
+	ok  = true;
+
+done:
+	codegen_abandon(gen);
+
+	Checker_free(checker);
+	if (token) Token_free(token);
+	if (out)   Str_free(out);
+
+	Memory_use(previous);
+
+	result->output       = "";
+	result->length       = 0;
+	result->diagnostics  = cminus->diagnostics;
+	result->ndiagnostics = cminus->ndiagnostics;
+
+	return ok;
+}
+
+bool CMinus_pipeline(CMinus* cminus, Source* source, Sink sink, void* state, Compilation* result, PipelineStats* stats) {
+
+	Diagnostic error = { Phase_LEXER, 0, 0, "could not make a lock" };
+	Locked     locked;
+	bool       ok    = false;
+
+	Arena_reset(&cminus->arena);
+	cminus->ndiagnostics = 0;
+
+	/* each thread frees what it is done with, so the arena is no use here either; malloc is safe
+	   to call from every thread at once, any other allocator is called by one at a time */
+	if (Locked_init(&locked, &cminus->backing)) {
+
+		Allocator const* allocator = cminus->backing.allocate == Allocator_DEFAULT.allocate ? &cminus->backing : &locked.allocator;
+		Allocator const* previous  = Memory_use(allocator);
+
+		ok = pipeline(source, sink, state, allocator, &cminus->passes, &cminus->codegen, stats, &error, cminus->messages[0], MAX_MESSAGE);
+
+		Memory_use(previous);
+		Locked_release(&locked);
+	}
+
+	if (!ok) diagnose(cminus, error.phase, error.code, error.lineno, error.message);
+
+	result->output       = "";
+	result->length       = 0;
+	result->diagnostics  = cminus->diagnostics;
+	result->ndiagnostics = cminus->ndiagnostics;
+
+	return ok;
+}
+
+void CMinus_free(CMinus* cminus) {
+
+	if (!cminus) return;
+
+	PassManager_release(&cminus->passes);
+	Arena_release(&cminus->arena);
+	cminus->backing.release(cminus->backing.state, cminus);
+}
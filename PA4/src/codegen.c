@@ -1,554 +1,1603 @@
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <limits.h>
+
 #include "../include/codegen.h"
+#include "../include/memory.h"
+#include "../include/lower.h"
+#include "../include/inline.h"
+#include "../include/tail.h"
+#include "../include/liveness.h"
+#include "../include/regalloc.h"
+#include "../include/asm.h"
+#include "../include/peephole.h"
+#include "../include/trace.h"
 
 typedef enum CGMeta {
 	CGMeta_TEXT, CGMeta_DATA
 } CGMeta;
 
-static CGMeta segment;
-
-static void codegen_compound_stmt(FILE* file, Pair* ast, char const* function);
+/*
+ * The code of a builtin is a format given the instructions fetching its
+ * argument from the stack when calls push them, then the register its
+ * result goes in, $a0 or $v0 by the calling convention.
+ */
+typedef struct Builtin {
+	char const* name;
+	int         nargs;
+	char const* code;
+
+	/* the version going through the runtime's buffer, and the option choosing it as an offset into CodegenOptions */
+	char const* buffered;
+	size_t      enabled;
+} Builtin;
+
+static Builtin const builtins[] = {
+	{ "output", 1,
+		"_f_output:\n"
+		"%s"
+		"  li $v0, 1\n"
+		"  syscall\n"
+		"  li $v0, 11\n"
+		"  li $a0, 0x0a\n"
+		"  syscall\n"
+		"  li %s, 0\n"
+		"  jr $ra\n"
+		"\n",
+		/* the digits are counted first and then written from the last, dividing by 10 with the high word of a multiply */
+		"_f_output:\n"
+		"%s"
+		"  move $t7, $a0\n"
+		"  lw $t0, _rt_count\n"
+		"  ble $t0, 4084, _rt_output_room\n"
+		"  move $t9, $ra\n"
+		"  jal _rt_flush\n"
+		"  move $ra, $t9\n"
+		"  li $t0, 0\n"
+		"_rt_output_room:\n"
+		"  la $t1, _rt_output\n"
+		"  addu $t1, $t1, $t0\n"
+		"  move $a0, $t7\n"
+		"  li $t4, 0xcccccccd\n"
+		"  bgez $a0, _rt_output_count\n"
+		"  li $t2, 0x2d\n"
+		"  sb $t2, 0($t1)\n"
+		"  addiu $t1, $t1, 1\n"
+		"  negu $a0, $a0\n"
+		"_rt_output_count:\n"
+		"  move $t2, $a0\n"
+		"  move $t3, $t1\n"
+		"_rt_output_digit:\n"
+		"  multu $t2, $t4\n"
+		"  mfhi $t2\n"
+		"  srl $t2, $t2, 3\n"
+		"  addiu $t3, $t3, 1\n"
+		"  bnez $t2, _rt_output_digit\n"
+		"  li $t2, 0x0a\n"
+		"  sb $t2, 0($t3)\n"
+		"  addiu $t5, $t3, 1\n"
+		"_rt_output_write:\n"
+		"  multu $a0, $t4\n"
+		"  mfhi $t2\n"
+		"  srl $t2, $t2, 3\n"
+		"  sll $t6, $t2, 2\n"
+		"  addu $t6, $t6, $t2\n"
+		"  sll $t6, $t6, 1\n"
+		"  subu $t6, $a0, $t6\n"
+		"  addiu $t6, $t6, 0x30\n"
+		"  addiu $t3, $t3, -1\n"
+		"  sb $t6, 0($t3)\n"
+		"  move $a0, $t2\n"
+		"  bnez $a0, _rt_output_write\n"
+		"  la $t1, _rt_output\n"
+		"  subu $t5, $t5, $t1\n"
+		"  sw $t5, _rt_count\n"
+		"  li %s, 0\n"
+		"  jr $ra\n"
+		"\n", offsetof (CodegenOptions, buffer_output) },
+	{ "input", 0,
+		"_f_input:\n"
+		"%s"
+		"  li $v0, 5\n"
+		"  syscall\n"
+		"  move $a0, $v0\n"
+		"  jr $ra\n"
+		"\n",
+		/*
+		 * read_int takes one line of up to 255 characters, the newline
+		 * included, and gives what atol makes of it. The same characters are
+		 * taken from _rt_input, refilled 4096 bytes at a time with the read
+		 * syscall. The magnitude is kept in 64 bits, $v1 over $t6, and its low
+		 * word taken as read_int does, except that once it reaches 2^63 atol
+		 * saturates, leaving -1 for LONG_MAX and 0 for LONG_MIN.
+		 */
+		"_f_input:\n"
+		"%s"
+		"  lw $t0, _rt_in_next\n"
+		"  lw $t1, _rt_in_end\n"
+		"  li $t3, 0\n"
+		"  li $t4, 0\n"
+		"  li $t5, 255\n"
+		"  li $t6, 0\n"
+		"  li $v1, 0\n"
+		"  li $t9, 0\n"
+		"_rt_input_next:\n"
+		"  beqz $t5, _rt_input_done\n"
+		"  blt $t0, $t1, _rt_input_have\n"
+		"  li $v0, 14\n"
+		"  li $a0, 0\n"
+		"  la $a1, _rt_input\n"
+		"  li $a2, 4096\n"
+		"  syscall\n"
+		"  blez $v0, _rt_input_done\n"
+		"  move $t1, $v0\n"
+		"  li $t0, 0\n"
+		"_rt_input_have:\n"
+		"  lbu $t2, _rt_input($t0)\n"
+		"  addiu $t0, $t0, 1\n"
+		"  addiu $t5, $t5, -1\n"
+		"  beq $t2, 0x0a, _rt_input_done\n"
+		"  beq $t3, 2, _rt_input_next\n"
+		"  addiu $t7, $t2, -0x30\n"
+		"  sltiu $t8, $t7, 10\n"
+		"  bnez $t8, _rt_input_digit\n"
+		"  bnez $t3, _rt_input_stop\n"
+		"  beq $t2, 0x20, _rt_input_next\n"
+		"  addiu $t8, $t2, -0x09\n"
+		"  sltiu $t8, $t8, 5\n"
+		"  bnez $t8, _rt_input_next\n"
+		"  beq $t2, 0x2d, _rt_input_minus\n"
+		"  beq $t2, 0x2b, _rt_input_sign\n"
+		"_rt_input_stop:\n"
+		"  li $t3, 2\n"
+		"  b _rt_input_next\n"
+		"_rt_input_minus:\n"
+		"  li $t4, 1\n"
+		"_rt_input_sign:\n"
+		"  li $t3, 1\n"
+		"  b _rt_input_next\n"
+		"_rt_input_digit:\n"
+		"  li $t3, 1\n"
+		"  bnez $t9, _rt_input_next\n"
+		"  li $t8, 0x0ccccccd\n"
+		"  sltu $t8, $v1, $t8\n"
+		"  beqz $t8, _rt_input_huge\n"
+		"  li $t8, 10\n"
+		"  multu $t6, $t8\n"
+		"  mflo $t6\n"
+		"  mfhi $t2\n"
+		"  sll $t8, $v1, 2\n"
+		"  addu $v1, $v1, $t8\n"
+		"  sll $v1, $v1, 1\n"
+		"  addu $v1, $v1, $t2\n"
+		"  addu $t6, $t6, $t7\n"
+		"  sltu $t8, $t6, $t7\n"
+		"  addu $v1, $v1, $t8\n"
+		"  bgez $v1, _rt_input_next\n"
+		"_rt_input_huge:\n"
+		"  li $t9, 1\n"
+		"  b _rt_input_next\n"
+		"_rt_input_done:\n"
+		"  sw $t0, _rt_in_next\n"
+		"  sw $t1, _rt_in_end\n"
+		"  beqz $t9, _rt_input_small\n"
+		"  addiu $t6, $t4, -1\n"
+		"  b _rt_input_positive\n"
+		"_rt_input_small:\n"
+		"  beqz $t4, _rt_input_positive\n"
+		"  subu $t6, $zero, $t6\n"
+		"_rt_input_positive:\n"
+		"  move %s, $t6\n"
+		"  jr $ra\n"
+		"\n"
+		".data\n"
+		"_rt_in_next: .word 0\n"
+		"_rt_in_end: .word 0\n"
+		"_rt_input: .space 4096\n"
+		".text\n", offsetof (CodegenOptions, buffer_input) },
+};
+
+#define BUILTIN_COUNT (sizeof builtins / sizeof builtins[0])
+
+static Builtin const* builtin(char const* symbol) {
+
+	for (size_t i = 0; i < BUILTIN_COUNT; ++i) {
+		if (strcmp(builtins[i].name, symbol) == 0) return &builtins[i];
+	}
 
-static void codegen_expression(FILE* file, Pair* ast);
+	return NULL;
+}
 
-static char const BUILTINS[]  =
-	".text\n"
-	"_f_output:\n"
-	"  lw $a0, 4($sp)\n"
-	"  li $v0, 1\n"
-	"  syscall\n"
-	"  li $v0, 11\n"
-	"  li $a0, 0x0a\n"
+/*
+ * Buffered output collects whole lines in _rt_output, with room for the
+ * longest, "-2147483648\n", and the NUL ending them, writing them out in one
+ * print_string when it is close to full and once more before the exit.
+ */
+static char const FLUSH[] =
+	"_rt_flush:\n"
+	"  lw $t0, _rt_count\n"
+	"  beqz $t0, _rt_flush_done\n"
+	"  sb $zero, _rt_output($t0)\n"
+	"  la $a0, _rt_output\n"
+	"  li $v0, 4\n"
 	"  syscall\n"
-	"  li $a0, 0\n"
-	"  jr $ra\n"
-	"\n"
-	"_f_input:\n"
-	"  li $v0, 5\n"
-	"  syscall\n"
-	"  move $a0, $v0\n"
+	"  sw $zero, _rt_count\n"
+	"_rt_flush_done:\n"
 	"  jr $ra\n"
 	"\n"
+	".data\n"
+	"_rt_count: .word 0\n"
+	"_rt_output: .space 4100\n"
+	".text\n"
 ;
 
-static char const ENTRY_EXIT[] = 
+static char const ENTRY[] =
 	"main:\n"
 	"  jal _f_main\n"
+;
+
+static char const EXIT[] =
 	"  li $v0, 10\n"
 	"  syscall\n"
 ;
 
-static int codegen_call_arguments(FILE* file, Pair* ast) {
-	
-	if (!ast) return 0;
+/*
+ * Scalars and arrays of up to SMALL_LIMIT bytes are laid out from SMALL_DATA
+ * while they fit in the SMALL_SIZE bytes spim points $gp at the middle of, so
+ * that one 16 bit offset from it reaches them. The rest go in .data as before.
+ */
+#define SMALL_DATA  0x10000000
+#define SMALL_SIZE  0x10000
+#define SMALL_LIMIT 64
+
+typedef struct Global {
+	char* name;
+	int   size;
+
+	/* its references, one inside a loop counting LOOP_WEIGHT times more for each loop */
+	long  weight;
+
+	/* bytes into the small data, -1 out of it */
+	int   offset;
+} Global;
+
+/* what generating one program keeps from one declaration to the next */
+struct Codegen {
+
+	CodegenOptions options;
+
+	CGMeta         segment;
+
+	/* what the passes over lowered functions keep from one function to the next */
+	PassContext    context;
+
+	/* by builtin, some jal or j reaches it, so it is written out at the end */
+	bool           referenced[BUILTIN_COUNT];
+
+	/* every global seen while optimizing, and how much of the small data they took */
+	Global*        globals;
+	size_t         nglobals;
+	size_t         gcapacity;
+	int            small;
+
+};
+
+/*
+ * The backend's own rewrites come with any level above -O0: syscalls made in
+ * place, frame words shared by arrays, small globals reached from $gp,
+ * constant factors and divisors expanded, and the peephole rules.
+ */
+static bool optimizing(Codegen const* gen) {
+	return gen->options.passes->level > 0;
+}
+
+/* arguments in $a0 to $a3 and the result in $v0, unless calls were asked to go through the stack */
+static bool in_registers(Codegen const* gen) {
+	return optimizing(gen) && gen->options.registers;
+}
+
+/* where a function leaves its result */
+static char const* result_register(Codegen const* gen) {
+	return in_registers(gen) ? "$v0" : "$a0";
+}
+
+static bool buffered(Codegen const* gen, Builtin const* b) {
+	return *(bool const*) ((char const*) &gen->options + b->enabled);
+}
+
+/* a call made as the syscall the builtin would make, which leaves every allocatable register alone */
+static bool intrinsic(Codegen const* gen, Instr const* instr) {
+
+	if (!optimizing(gen) || (instr->op != Op_CALL && instr->op != Op_TAILCALL)) return false;
+
+	Builtin const* b = builtin(instr->symbol);
+	return b && !buffered(gen, b);
+}
+
+/* some jal or j reaches the builtin, so it is written out at the end */
+static void reference(Codegen* gen, char const* symbol) {
+	Builtin const* b = builtin(symbol);
+	if (b) gen->referenced[b - builtins] = true;
+}
+
+/* virtual registers are given $t0 to $t7 and $s0 to $s7,
+   $t8 and $t9 hold operands that live in memory and $v1 frame and small data addresses */
+#define REGISTERS 16
+
+static char const* const REGISTER[REGISTERS] = {
+	"$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+	"$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7"
+};
+
+/* the registers the first arguments travel in, on the way to a tail call or with the register convention */
+static char const* const ARGUMENT[TAIL_ARGUMENTS] = { "$a0", "$a1", "$a2", "$a3" };
+
+#define TEMPORARIES 0x00ffu
+#define SAVED       0xff00u
+
+/* how many uses outside a loop one use inside it is worth */
+#define LOOP_WEIGHT 8
+
+/* where everything of the function being emitted lives */
+typedef struct Frame {
+
+	/* the program the function belongs to */
+	Codegen*         gen;
+
+	Procedure const* function;
+
+	/* the register of each virtual register, -1 when it lives in memory */
+	int*             reg;
+
+	/* the $fp offset of each virtual register living in memory */
+	int*             spill;
+
+	/* the $fp offset of each slot */
+	int*             slot;
+
+	/* the $s registers handed out, saved just below the saved $ra */
+	unsigned         saved;
+
+	/* bytes of frame below the saved $ra, the outgoing arguments included */
+	int              size;
+
+	/* what size would be with every slot in words of its own */
+	int              separate;
+
+	/* with arguments in registers, a function calling nothing leaves $ra where it is, and builds no frame at all when nothing lives in one */
+	bool             leaf;
+	bool             frameless;
+
+} Frame;
 
-	int   count = codegen_call_arguments(file, ast->cdr);
-	Pair* node  = ast->car;
+static void Frame_release(Frame* frame) {
+	Memory_free(frame->reg);
+	Memory_free(frame->spill);
+	Memory_free(frame->slot);
+}
+
+static void extend(Interval* interval, int position) {
+	if (interval->start > position) interval->start = position;
+	if (interval->end   < position) interval->end   = position;
+}
+
+/* whether one of the call positions, in order, falls strictly inside the interval */
+static bool crosses(int const* calls, size_t ncalls, Interval const* interval) {
+
+	size_t low  = 0;
+	size_t high = ncalls;
+
+	while (low < high) {
+		size_t middle = (low + high) / 2;
+		if (calls[middle] <= interval->start) low  = middle + 1;
+		else                                  high = middle;
+	}
+
+	return low < ncalls && calls[low] < interval->end;
+}
+
+/*
+ * Lays the slots out below offset, each one below every slot placed before it
+ * whose scopes overlap its own. Slots come in the order their scopes open, so
+ * those are the slots of the scopes enclosing it, all in use alongside it.
+ * Returns the offset of the lowest word taken.
+ */
+static int place(Frame* frame, Procedure const* function, int offset) {
+
+	int lowest = offset;
+
+	for (size_t i = 0; i < function->nslots; ++i) {
+
+		Slot const* slot = &function->slots[i];
+		int         top  = offset;
+
+		for (size_t j = 0; j < i; ++j) {
+
+			Slot const* other = &function->slots[j];
+
+			if (other->first <= slot->last && slot->first <= other->last && frame->slot[j] < top) top = frame->slot[j];
+		}
+
+		frame->slot[i] = top - slot->size;
+		if (frame->slot[i] < lowest) lowest = frame->slot[i];
+	}
+
+	return lowest;
+}
+
+/*
+ * Numbers the instructions in layout order, reading at 2k and writing at 2k + 1,
+ * so the result of an instruction may take the register of an operand dying there.
+ * Each virtual register gets one interval over everywhere it is live, which may
+ * only be given a callee saved register when a call happens inside it.
+ */
+static bool allocate(Frame* frame, Procedure const* function) {
+
+	size_t nvregs   = function->nvregs;
+	size_t ninstrs  = 0;
+	size_t ncalls   = 0;
+	int    outgoing = 0;
+	bool   ok       = false;
+
+	for (size_t i = 0; i < function->nblocks; ++i) ninstrs += function->blocks[i]->count;
+
+	Interval*       intervals = Memory_alloc(MemoryTag_IR, (nvregs ? nvregs : 1) * sizeof (Interval));
+	int*            params    = Memory_alloc(MemoryTag_IR, (nvregs ? nvregs : 1) * sizeof (int));
+	int*            calls     = Memory_alloc(MemoryTag_IR, (ninstrs ? ninstrs : 1) * sizeof (int));
+	Liveness const* liveness  = Analyses_get(&frame->gen->options.passes->lowered, Analysis_LIVENESS);
+
+	frame->function = function;
+	frame->reg      = Memory_alloc(MemoryTag_IR, (nvregs ? nvregs : 1) * sizeof (int));
+	frame->spill    = Memory_alloc(MemoryTag_IR, (nvregs ? nvregs : 1) * sizeof (int));
+	frame->slot     = Memory_alloc(MemoryTag_IR, (function->nslots ? function->nslots : 1) * sizeof (int));
+	frame->saved    = 0;
+	frame->size     = 0;
+
+	if (!intervals || !params || !calls || !liveness || !frame->reg || !frame->spill || !frame->slot)
+		goto done;
+
+	for (size_t v = 0; v < nvregs; ++v) {
+		intervals[v] = (Interval) { (int) v, INT_MAX, -1, 0, TEMPORARIES | SAVED, -1 };
+		params[v]    = -1;
+	}
+
+	int position = 0;
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block const* block = function->blocks[i];
+		int          first = position;
+		int          last  = position + 2 * (int) block->count - 1;
+		int          use   = 1;
 
-	/* node->dyn stores whether the variable is subscripted */
-	if (node->val == ASType_VAR && !node->dyn) {
+		for (int depth = block->depth < 6 ? block->depth : 6; depth > 0; --depth) use *= LOOP_WEIGHT;
 
-		/* special case for array references passed into functions,
-		   passing it to codegen_expression would end up derefenceing it,
-		   which we don't want to do */
+		for (size_t v = 0; v < nvregs; ++v) {
+			if (Liveness_in(liveness, block, v))  extend(&intervals[v], first);
+			if (Liveness_out(liveness, block, v)) extend(&intervals[v], last);
+		}
+
+		for (size_t j = 0; j < block->count; ++j, position += 2) {
+
+			Instr*   instr = &block->code[j];
+			Operand* operand;
+
+			for (size_t k = 0; (operand = Instr_use(instr, k)); ++k) {
+				if (operand->kind != OperandKind_VREG) continue;
+				extend(&intervals[operand->value], position);
+				intervals[operand->value].weight += use;
+			}
+
+			if (instr->op == Op_CALL && !intrinsic(frame->gen, instr)) {
+				calls[ncalls++] = position + 1;
+				if (outgoing < instr->nargs) outgoing = instr->nargs;
+			}
+			if (instr->op == Op_PARAM) params[instr->dst] = instr->imm;
+
+			if (instr->dst >= 0) {
+				extend(&intervals[instr->dst], position + 1);
+				intervals[instr->dst].weight += use;
+			}
+		}
+	}
+
+	size_t count = 0;
+
+	for (size_t v = 0; v < nvregs; ++v) {
 
-		Pair* var = node->cdr->car;
+		frame->reg[v] = -1;
+
+		if (intervals[v].end < 0) continue;
+		if (crosses(calls, ncalls, &intervals[v])) intervals[v].allowed = SAVED;
+
+		intervals[count++] = intervals[v];
+	}
+
+	frame->saved = Interval_allocate(intervals, count) & SAVED;
+
+	for (size_t i = 0; i < count; ++i) frame->reg[intervals[i].key] = intervals[i].reg;
+
+	/* the saved registers come first, then whatever did not get a register, then the arrays */
+	int offset = 0;
+
+	for (int r = 0; r < REGISTERS; ++r) {
+		if (frame->saved & 1u << r) offset -= 4;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+
+		int v = intervals[i].key;
+		if (frame->reg[v] >= 0) continue;
+
+		/* a parameter already has a word of its own where the caller pushed it */
+		if (params[v] >= 0) {
+			frame->spill[v] = 4 * (params[v] + 1);
+		} else {
+			offset -= 4;
+			frame->spill[v] = offset;
+		}
+	}
 
-		switch ((PrimativeType) node->num) {
+	int separate = offset;
+
+	for (size_t i = 0; i < function->nslots; ++i) {
+		separate -= function->slots[i].size;
+		frame->slot[i] = separate;
+	}
+
+	int lowest = optimizing(frame->gen) ? place(frame, function, offset) : separate;
+
+	/* the bottom word is where a callee saves $ra, the arguments of the largest call go right above it */
+	frame->size     = 4 * outgoing - lowest;
+	frame->separate = 4 * outgoing - separate;
+
+	frame->leaf      = in_registers(frame->gen) && ncalls == 0;
+	frame->frameless = frame->leaf && frame->size == 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		if (frame->reg[intervals[i].key] < 0) frame->frameless = false;
+	}
+
+	ok = true;
+
+done:
+	Memory_free(intervals);
+	Memory_free(params);
+	Memory_free(calls);
+
+	return ok;
+}
+
+static bool fits(long value) {
+	return value >= -32768 && value <= 32767;
+}
+
+static Global* global(Codegen const* gen, char const* name) {
+
+	for (size_t i = 0; i < gen->nglobals; ++i) {
+		if (strcmp(gen->globals[i].name, name) == 0) return &gen->globals[i];
+	}
+
+	return NULL;
+}
+
+/* the offset from $gp of a byte of a global, false when it is not within reach */
+static bool reach(Codegen const* gen, char const* symbol, int offset, int* near) {
+
+	Global const* g = global(gen, symbol);
+	if (!g || g->offset < 0) return false;
+
+	long at = (long) g->offset + offset - SMALL_SIZE / 2;
+	if (!fits(at)) return false;
+
+	*near = (int) at;
+	return true;
+}
+
+/* the register holding an operand, loading it into scratch when it is in memory or a constant */
+static char const* source(Asm* code, Frame const* frame, Operand operand, char const* scratch) {
+
+	switch (operand.kind) {
+
+		case OperandKind_VREG:
+			if (frame->reg[operand.value] >= 0) return REGISTER[frame->reg[operand.value]];
+			Asm_emit(code, "lw %s, %d($fp)", scratch, frame->spill[operand.value]);
+			return scratch;
+
+		case OperandKind_CONST:
+			if (!operand.value) return "$zero";
+			Asm_emit(code, "li %s, %d", scratch, operand.value);
+			return scratch;
+
+		default:
+			return "$zero";
+	}
+}
+
+/* the register to compute a virtual register into, $t8 when it lives in memory */
+static char const* destination(Frame const* frame, int vreg) {
+	return frame->reg[vreg] >= 0 ? REGISTER[frame->reg[vreg]] : "$t8";
+}
+
+/* stores what was computed for a virtual register living in memory */
+static void writeback(Asm* code, Frame const* frame, int vreg, char const* reg) {
+	if (frame->reg[vreg] < 0) Asm_emit(code, "sw %s, %d($fp)", reg, frame->spill[vreg]);
+}
+
+static void move(Asm* code, char const* dest, char const* source) {
+	if (strcmp(dest, source) != 0) Asm_emit(code, "move %s, %s", dest, source);
+}
+
+static char const* const MNEMONIC[Op_COUNT] = {
+	[Op_ADD]  = "add",  [Op_SUB] = "sub", [Op_MUL] = "mult", [Op_DIV] = "div",
+	[Op_LT]   = "slt",  [Op_LE]  = "sle", [Op_GT]  = "sgt",  [Op_GE]  = "sge",
+	[Op_EQ]   = "seq",  [Op_NE]  = "sne", [Op_ADDU] = "addu",
+};
+
+/* the same comparison with its operands the other way around */
+static Op mirror(Op op) {
+
+	switch (op) {
+		case Op_LT: return Op_GT;
+		case Op_GT: return Op_LT;
+		case Op_LE: return Op_GE;
+		case Op_GE: return Op_LE;
+		default:    return op;
+	}
+}
+
+/* cycles a mult and the mflo after it take, where a shift or an add takes one */
+#define MULTIPLY_COST 5
+
+/* a run of instructions that work in $t9 and leave the result of the last in dest */
+typedef struct Sequence {
+	char const* dest;
+	int         left;
+} Sequence;
+
+static char const* into(Sequence* sequence) {
+	return --sequence->left ? "$t9" : sequence->dest;
+}
+
+/*
+ * x * c as shifts of x added and subtracted, one for each nonzero digit of c
+ * in non-adjacent form, which wraps exactly as the low word of mult does.
+ * False when that would cost more than the mult.
+ */
+static bool emit_multiply(Asm* code, char const* dest, char const* x, int c) {
+
+	int    shifts[33];
+	int    signs[33];
+	int    n = 0;
+	size_t i = 0;
+
+	for (unsigned long long v = (unsigned) c; v; v >>= 1, ++i) {
+
+		if (!(v & 1)) continue;
+
+		int sign = (v & 3) == 1 ? 1 : -1;
+
+		v = sign > 0 ? v - 1 : v + 1;
+
+		/* x << 32 and up is zero */
+		if (i < 32) {
+			shifts[n] = (int) i;
+			signs[n++] = sign;
+		}
+	}
+
+	if (!n) {
+		Asm_emit(code, "li %s, 0", dest);
+		return true;
+	}
+
+	/* the sum starts from a term that is added when there is one */
+	int start  = 0;
+	int writes = n - 1;
+	int cost   = 0;
+
+	while (start < n && signs[start] < 0) ++start;
+
+	if (start == n) {
+		start   = 0;
+		writes += 1;
+		cost   += 1 + (shifts[0] != 0);
+	} else {
+		writes += shifts[start] != 0;
+		cost   += shifts[start] != 0;
+	}
+
+	for (int j = 0; j < n; ++j) {
+		if (j != start) cost += 1 + (shifts[j] != 0);
+	}
+
+	if (!writes) {
+		move(code, dest, x);
+		return true;
+	}
+
+	if (cost >= MULTIPLY_COST) return false;
+
+	Sequence    sequence = { dest, writes };
+	char const* sum      = x;
+
+	if (signs[start] > 0) {
+
+		if (shifts[start]) {
+			sum = into(&sequence);
+			Asm_emit(code, "sll %s, %s, %d", sum, x, shifts[start]);
+		}
+
+	} else {
+
+		char const* term = x;
+
+		if (shifts[start]) {
+			Asm_emit(code, "sll $v1, %s, %d", x, shifts[start]);
+			term = "$v1";
+		}
+
+		sum = into(&sequence);
+		Asm_emit(code, "subu %s, $zero, %s", sum, term);
+	}
+
+	for (int j = 0; j < n; ++j) {
+
+		if (j == start) continue;
+
+		char const* term = x;
+
+		if (shifts[j]) {
+			Asm_emit(code, "sll $v1, %s, %d", x, shifts[j]);
+			term = "$v1";
+		}
+
+		char const* to = into(&sequence);
+
+		Asm_emit(code, "%s %s, %s, %s", signs[j] > 0 ? "addu" : "subu", to, sum, term);
+		sum = to;
+	}
+
+	return true;
+}
+
+/* the multiplier and shift that make the high word of x * multiplier, shifted, x / d for every x, from Hacker's Delight */
+static void magic(unsigned d, int* multiplier, int* shift) {
+
+	unsigned const two31 = 0x80000000u;
+
+	unsigned anc = two31 - 1 - two31 % d;
+	unsigned q1  = two31 / anc;
+	unsigned r1  = two31 - q1 * anc;
+	unsigned q2  = two31 / d;
+	unsigned r2  = two31 - q2 * d;
+	unsigned delta;
+	int      p   = 31;
+
+	do {
+
+		++p;
+
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc) {
+			++q1;
+			r1 -= anc;
+		}
+
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= d) {
+			++q2;
+			r2 -= d;
+		}
+
+		delta = d - r2;
+
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+
+	*multiplier = (int) (q2 + 1);
+	*shift      = p - 32;
+}
+
+/*
+ * x / d rounding toward zero as div does, by shifting for a power of two and
+ * otherwise by the high word of a multiply. A negative quotient is one too low
+ * before the sign bit of x is added back. Dividing by zero and by -1, where
+ * div traps, is left to div. A negative d divides by -d and negates.
+ */
+static bool emit_divide(Asm* code, char const* dest, char const* x, int d) {
+
+	if (d == 0 || d == -1) return false;
+
+	if (d == 1) {
+		move(code, dest, x);
+		return true;
+	}
 
-			case PrimativeType_ARRAY:
-				if (var->num == 0) {
-					fprintf(file,
-						"  la $a0, _v_%s\n",
-					var->dyn);
-				} else {
-					fprintf(file,
-						"  addi $a0, $fp, %d\n",
-					var->num);
-				}
+	unsigned    magnitude = d < 0 ? 0u - (unsigned) d : (unsigned) d;
+	char const* quotient  = d < 0 ? "$t9" : dest;
+
+	if (!(magnitude & (magnitude - 1))) {
+
+		int k = 0;
+		while (1u << k != magnitude) ++k;
+
+		/* a negative dividend is biased by d - 1 first, so the shift rounds toward zero */
+		if (k == 1) {
+			Asm_emit(code, "srl $v1, %s, 31", x);
+		} else {
+			Asm_emit(code, "sra $v1, %s, 31", x);
+			Asm_emit(code, "srl $v1, $v1, %d", 32 - k);
+		}
+
+		Asm_emit(code, "addu $v1, %s, $v1", x);
+		Asm_emit(code, "sra %s, $v1, %d", quotient, k);
+
+	} else {
+
+		int multiplier;
+		int shift;
+
+		magic(magnitude, &multiplier, &shift);
+
+		Asm_emit(code, "li $v1, %d", multiplier);
+		Asm_emit(code, "mult %s, $v1", x);
+		Asm_emit(code, "mfhi $t9");
+		if (multiplier < 0) Asm_emit(code, "addu $t9, $t9, %s", x);
+		if (shift)          Asm_emit(code, "sra $t9, $t9, %d", shift);
+		Asm_emit(code, "srl $v1, %s, 31", x);
+		Asm_emit(code, "addu %s, $t9, $v1", quotient);
+	}
+
+	if (d < 0) Asm_emit(code, "subu %s, $zero, $t9", dest);
+
+	return true;
+}
+
+static void emit_binary(Asm* code, Frame const* frame, Instr const* instr) {
+
+	Op      op = instr->op;
+	Operand a  = instr->a;
+	Operand b  = instr->b;
+
+	/* a constant goes on the right, where an immediate field can take it */
+	if (a.kind == OperandKind_CONST && b.kind != OperandKind_CONST && op != Op_SUB && op != Op_DIV) {
+		Operand swap = a;
+		a  = b;
+		b  = swap;
+		op = mirror(op);
+	}
+
+	char const* left = source(code, frame, a, "$t8");
+	char const* dest = destination(frame, instr->dst);
+	long        k    = op == Op_SUB ? -(long) b.value : b.value;
+
+	if (optimizing(frame->gen) && b.kind == OperandKind_CONST
+		&& ((op == Op_MUL && emit_multiply(code, dest, left, b.value))
+		 || (op == Op_DIV && emit_divide(code, dest, left, b.value)))) {
+		writeback(code, frame, instr->dst, dest);
+		return;
+	}
+
+	if (b.kind == OperandKind_CONST && fits(k) && op != Op_MUL && op != Op_DIV) {
+
+		switch (op) {
+
+			/* addi traps on overflow just as add and sub do */
+			case Op_ADD:
+			case Op_SUB:
+				Asm_emit(code, "addi %s, %s, %ld", dest, left, k);
+				break;
+
+			case Op_ADDU:
+				Asm_emit(code, "addiu %s, %s, %ld", dest, left, k);
 				break;
 
-			case PrimativeType_POINTER:
-				fprintf(file,
-					"  addi $a0, $fp, %d\n"
-					"  lw $a0, 0($a0)\n",
-				var->num);
+			case Op_LT:
+				Asm_emit(code, "slti %s, %s, %ld", dest, left, k);
 				break;
 
 			default:
-				codegen_expression(file, ast->car);
+				Asm_emit(code, "%s %s, %s, %ld", MNEMONIC[op], dest, left, k);
 				break;
 		}
 
 	} else {
-		codegen_expression(file, ast->car);
+
+		char const* right = source(code, frame, b, "$t9");
+
+		if (op == Op_MUL || op == Op_DIV) {
+			Asm_emit(code, "%s %s, %s", MNEMONIC[op], left, right);
+			Asm_emit(code, "mflo %s", dest);
+		} else {
+			Asm_emit(code, "%s %s, %s, %s", MNEMONIC[op], dest, left, right);
+		}
 	}
 
-	/* push argument onto stack */
-	fputs(
-		"  sw $a0, 0($sp)\n"
-		"  addiu $sp, $sp, -4\n",
-	file);
+	writeback(code, frame, instr->dst, dest);
+}
+
+/* the memory operand of a load or store, adding $fp or $gp to a register through $v1 for frame slots and small data */
+static void address(Asm* code, Frame const* frame, Instr const* instr, char* operand, size_t size) {
+
+	char const* base   = NULL;
+	int         offset = instr->imm;
+
+	if (instr->a.kind == OperandKind_CONST) offset += instr->a.value;
+	else if (instr->a.kind == OperandKind_VREG) base = source(code, frame, instr->a, "$t8");
+
+	int near;
+
+	if (instr->symbol && reach(frame->gen, instr->symbol, offset, &near)) {
+
+		if (base) {
+			Asm_emit(code, "addu $v1, %s, $gp", base);
+			snprintf(operand, size, "%d($v1)", near);
+		} else {
+			snprintf(operand, size, "%d($gp)", near);
+		}
+
+	} else if (instr->symbol) {
+
+		int length = offset ? snprintf(operand, size, "_v_%s+%d", instr->symbol, offset)
+		                    : snprintf(operand, size, "_v_%s", instr->symbol);
 
-	return count + 1;
+		if (base && length > 0 && (size_t) length < size) snprintf(operand + length, size - length, "(%s)", base);
+
+	} else if (instr->slot >= 0) {
+
+		offset += frame->slot[instr->slot];
+
+		if (base) {
+			Asm_emit(code, "addu $v1, %s, $fp", base);
+			snprintf(operand, size, "%d($v1)", offset);
+		} else {
+			snprintf(operand, size, "%d($fp)", offset);
+		}
+
+	} else {
+		snprintf(operand, size, "%d(%s)", offset, base ? base : "$zero");
+	}
 }
 
-static void codegen_variable_address(FILE* file, Pair* ast) {
+/* output prints its argument and a newline and gives 0, input reads an integer */
+static void emit_intrinsic(Asm* code, Frame const* frame, Instr const* instr) {
 
-	Pair* node;
+	char const* result = "$v0";
 
-	node = ast->cdr;
-	int offset = node->car->num;
+	if (strcmp(instr->symbol, "output") == 0) {
+		move(code, "$a0", source(code, frame, instr->args[0], "$a0"));
+		Asm_emit(code, "li $v0, 1");
+		Asm_emit(code, "syscall");
+		Asm_emit(code, "li $v0, 11");
+		Asm_emit(code, "li $a0, 0x0a");
+		Asm_emit(code, "syscall");
+		result = "$zero";
+	} else {
+		Asm_emit(code, "li $v0, 5");
+		Asm_emit(code, "syscall");
+	}
+
+	if (instr->dst >= 0) {
+		move(code, destination(frame, instr->dst), result);
+		writeback(code, frame, instr->dst, result);
+	}
+}
 
-	/* variable is marked indexable */
-	if (ast->dyn) {
-		/* compute index */
-		codegen_expression(file, node->cdr->car);
+static void emit_call(Asm* code, Frame const* frame, Instr const* instr) {
 
-		/* shift index to word size and save in $t1 */
-		fputs(
-			"  sll $a0, $a0, 2\n"
-			"  move $t1, $a0\n",
-		file);
+	if (intrinsic(frame->gen, instr)) {
+		emit_intrinsic(code, frame, instr);
+		return;
 	}
 
-	switch (ast->num) {
+	Builtin const* called = builtin(instr->symbol);
+	reference(frame->gen, instr->symbol);
 
-		case PrimativeType_POINTER:
-			/* variable is a pointer parameter */
+	/* the arguments go where the callee expects them, in the words above $sp the frame set aside unless in registers */
+	for (int i = 0; i < instr->nargs; ++i) {
 
-			/* calculate stack offset of argument
-			   and load the */
-			fprintf(file,
-				"  addi $a0, $fp, %d\n"
-				"  lw $a0, 0($a0)\n",
-			offset);
-			break;
+		if (in_registers(frame->gen) && i < TAIL_ARGUMENTS) {
+			move(code, ARGUMENT[i], source(code, frame, instr->args[i], ARGUMENT[i]));
+			continue;
+		}
 
-		default:
-			if (offset == 0) {
-				/* variable is a global */
+		char const* argument = source(code, frame, instr->args[i], "$t8");
+		Asm_emit(code, "sw %s, %d($sp)", argument, 4 * (i + 1));
+	}
 
-				/* load address of label */
-				fprintf(file,
-					"  la $a0, _v_%s\n",
-				node->car->dyn);
-			} else {
-				/* variable is a local */
+	Asm_emit(code, "jal _f_%s", instr->symbol);
 
-				/* calculate stack offset */
-				fprintf(file,
-					"  addi $a0, $fp, %d\n",
-				offset);
-			}
-			break;
+	/* $sp is back where it was, the callee's prologue moved $fp and the builtins have none */
+	if (!called) Asm_emit(code, "addiu $fp, $sp, %d", 4 + frame->size);
+
+	if (instr->dst >= 0) {
+		move(code, destination(frame, instr->dst), result_register(frame->gen));
+		writeback(code, frame, instr->dst, result_register(frame->gen));
+	}
+}
+
+/* undoes the prologue, short of returning */
+static void emit_epilogue(Asm* code, Frame const* frame) {
+
+	int offset = 0;
+
+	if (frame->frameless) return;
+
+	for (int r = 0; r < REGISTERS; ++r) {
+		if (frame->saved & 1u << r) Asm_emit(code, "lw %s, %d($fp)", REGISTER[r], offset -= 4);
+	}
+
+	Asm_emit(code, "move $sp, $fp");
+	if (!frame->leaf) Asm_emit(code, "lw $ra, 0($sp)");
+}
 
+/*
+ * The callee is entered as if our caller had called it, with its arguments
+ * where our caller passed ours and $ra still holding where to go back to.
+ * They are gathered in $a0 to $a3 first, as a parameter left in memory lives
+ * in one of the words they overwrite.
+ */
+static void emit_tail_call(Asm* code, Frame const* frame, Instr const* instr, Block const* next) {
+
+	/* a builtin made in place is returned from like any other value, input's is in $v0 */
+	if (intrinsic(frame->gen, instr)) {
+		emit_intrinsic(code, frame, instr);
+		if (strcmp(instr->symbol, "input") == 0) move(code, result_register(frame->gen), "$v0");
+		if (next) Asm_emit(code, "j _f_%s_exit", frame->function->name);
+		return;
 	}
 
-	if (ast->dyn) {
-		/* add index to address */
-		fputs("  add $a0, $t1, $a0\n", file);
+	for (int i = 0; i < instr->nargs; ++i) {
+		move(code, ARGUMENT[i], source(code, frame, instr->args[i], ARGUMENT[i]));
 	}
+
+	for (int i = 0; i < instr->nargs && !in_registers(frame->gen); ++i) {
+		Asm_emit(code, "sw %s, %d($fp)", ARGUMENT[i], 4 * (i + 1));
+	}
+
+	reference(frame->gen, instr->symbol);
+
+	emit_epilogue(code, frame);
+	Asm_emit(code, "j _f_%s", instr->symbol);
 }
 
-static inline void codegen_operator(FILE* file, Pair* ast, char const* operator) {
-	Pair* node = ast->cdr;
-	codegen_expression(file, node->car);
-	fputs(
-		"  sw $a0, 0($sp)\n"
-		"  addiu $sp, $sp, -4\n",
-	file);
-	node = node->cdr;
-	codegen_expression(file, node->car);
-	fprintf(file,
-		"  lw $t1, 4($sp)\n"
-		"  %s $a0, $t1, $a0\n"
-		"  addiu $sp, $sp, 4\n",
-	operator);
+static void emit_jump(Asm* code, Frame const* frame, Block const* to, Block const* next) {
+	if (to != next) Asm_emit(code, "b _f_%s_%d", frame->function->name, to->id);
 }
 
-static inline void codegen_factor(FILE* file, Pair* ast, char const* operator) {
-	Pair* node = ast->cdr;
-	codegen_expression(file, node->car);
-	fputs(
-		"  sw $a0, 0($sp)\n"
-		"  addiu $sp, $sp, -4\n",
-	file);
-	node = node->cdr;
-	codegen_expression(file, node->car);
-	fprintf(file,
-		"  lw $t1, 4($sp)\n"
-		"  %s $t1, $a0\n"
-		"  mflo $a0\n"
-		"  addiu $sp, $sp, 4\n",
-	operator);
+/* the comparison that holds exactly when op does not */
+static Op negate(Op op) {
+
+	switch (op) {
+		case Op_LT: return Op_GE;
+		case Op_GE: return Op_LT;
+		case Op_LE: return Op_GT;
+		case Op_GT: return Op_LE;
+		case Op_EQ: return Op_NE;
+		default:    return Op_EQ;
+	}
 }
 
-static void codegen_expression(FILE* file, Pair* ast) {
+static bool holds(Op op, int x, int y) {
 
-	Pair* node;
+	switch (op) {
+		case Op_LT: return x <  y;
+		case Op_LE: return x <= y;
+		case Op_GT: return x >  y;
+		case Op_GE: return x >= y;
+		case Op_EQ: return x == y;
+		default:    return x != y;
+	}
+}
 
-	switch (ast->val) {
+static char const* const BRANCH[Op_COUNT] = {
+	[Op_LT] = "blt", [Op_LE] = "ble", [Op_GT] = "bgt", [Op_GE] = "bge", [Op_EQ] = "beq", [Op_NE] = "bne",
+};
+
+/* the single real instruction comparing against zero, where there is one */
+static char const* const BRANCH_ZERO[Op_COUNT] = {
+	[Op_LT] = "bltz", [Op_LE] = "blez", [Op_GT] = "bgtz", [Op_GE] = "bgez",
+};
+
+/*
+ * One compare-and-branch to the block that does not come next, so the block
+ * laid out after this one, the body of an if or a while, is reached by falling
+ * through. When neither target comes next a jump follows the branch.
+ */
+static void emit_branch(Asm* code, Frame const* frame, Instr const* instr, Block const* next) {
+
+	char const* name  = frame->function->name;
+	Op          op    = instr->imm;
+	Operand     a     = instr->a;
+	Operand     b     = instr->b;
+	Block*      taken = instr->targets[0];
+	Block*      other = instr->targets[1];
+
+	if (a.kind == OperandKind_CONST && b.kind == OperandKind_CONST) {
+		emit_jump(code, frame, holds(op, a.value, b.value) ? taken : other, next);
+		return;
+	}
 
-		case ASType_NUM:
-			fprintf(file, "  li $a0, %d\n", ast->num);
+	/* the constant goes where the immediate forms take it */
+	if (a.kind == OperandKind_CONST) {
+		Operand swap = a;
+		a  = b;
+		b  = swap;
+		op = mirror(op);
+	}
+
+	if (taken == next) {
+		Block* swap = taken;
+		taken = other;
+		other = swap;
+		op    = negate(op);
+	}
+
+	char const* left = source(code, frame, a, "$t8");
+
+	if (b.kind == OperandKind_CONST && b.value == 0) {
+		if (BRANCH_ZERO[op]) Asm_emit(code, "%s %s, _f_%s_%d", BRANCH_ZERO[op], left, name, taken->id);
+		else                 Asm_emit(code, "%s %s, $zero, _f_%s_%d", BRANCH[op], left, name, taken->id);
+	} else if (b.kind == OperandKind_CONST) {
+		Asm_emit(code, "%s %s, %d, _f_%s_%d", BRANCH[op], left, b.value, name, taken->id);
+	} else {
+		Asm_emit(code, "%s %s, %s, _f_%s_%d", BRANCH[op], left, source(code, frame, b, "$t9"), name, taken->id);
+	}
+
+	emit_jump(code, frame, other, next);
+}
+
+static void emit_instr(Asm* code, Frame const* frame, Instr const* instr, Block const* next) {
+
+	char const* name = frame->function->name;
+	char        operand[128];
+
+	switch (instr->op) {
+
+		case Op_COPY: {
+			char const* dest = destination(frame, instr->dst);
+			if (instr->a.kind == OperandKind_CONST) Asm_emit(code, "li %s, %d", dest, instr->a.value);
+			else                                    move(code, dest, source(code, frame, instr->a, dest));
+			writeback(code, frame, instr->dst, dest);
 			break;
+		}
+
+		case Op_SLL: {
+			char const* value = source(code, frame, instr->a, "$t8");
+			char const* dest  = destination(frame, instr->dst);
+			Asm_emit(code, "sll %s, %s, %d", dest, value, instr->imm);
+			writeback(code, frame, instr->dst, dest);
+			break;
+		}
 
-		case ASType_LE:
-			codegen_operator(file, ast, "sle");
+		case Op_ADDR: {
+			char const* dest = destination(frame, instr->dst);
+			int         near;
+			if (!instr->symbol)                               Asm_emit(code, "addiu %s, $fp, %d", dest, frame->slot[instr->slot] + instr->imm);
+			else if (reach(frame->gen, instr->symbol, instr->imm, &near)) Asm_emit(code, "addiu %s, $gp, %d", dest, near);
+			else                                              Asm_emit(code, "la %s, _v_%s+%d", dest, instr->symbol, instr->imm);
+			writeback(code, frame, instr->dst, dest);
 			break;
+		}
 
-		case ASType_LT:
-			codegen_operator(file, ast, "slt");
+		case Op_LOAD: {
+			address(code, frame, instr, operand, sizeof operand);
+			char const* dest = destination(frame, instr->dst);
+			Asm_emit(code, "lw %s, %s", dest, operand);
+			writeback(code, frame, instr->dst, dest);
 			break;
-		
-		case ASType_GT:
-			codegen_operator(file, ast, "sgt");
+		}
+
+		case Op_STORE: {
+			char const* value = source(code, frame, instr->b, "$t9");
+			address(code, frame, instr, operand, sizeof operand);
+			Asm_emit(code, "sw %s, %s", value, operand);
 			break;
+		}
+
+		/* a parameter left in memory is read where the caller pushed it */
+		case Op_PARAM: {
 
-		case ASType_GE:
-			codegen_operator(file, ast, "sge");
+			int         home     = 4 * (instr->imm + 1);
+			char const* incoming = in_registers(frame->gen) && instr->imm < TAIL_ARGUMENTS ? ARGUMENT[instr->imm] : NULL;
+
+			/* one arriving in a register and left in memory goes to the word the caller set aside for it */
+			if (frame->reg[instr->dst] < 0) {
+				if (incoming) Asm_emit(code, "sw %s, %d($fp)", incoming, home);
+			} else if (incoming) {
+				move(code, REGISTER[frame->reg[instr->dst]], incoming);
+			} else {
+				Asm_emit(code, "lw %s, %d(%s)", REGISTER[frame->reg[instr->dst]], home, frame->frameless ? "$sp" : "$fp");
+			}
 			break;
+		}
 
-		case ASType_EQ:
-			codegen_operator(file, ast, "seq");
+		case Op_CALL:
+			emit_call(code, frame, instr);
 			break;
 
-		case ASType_NE:
-			codegen_operator(file, ast, "sne");
+		case Op_JUMP:
+			emit_jump(code, frame, instr->targets[0], next);
 			break;
 
-		case ASType_ADD:
-			codegen_operator(file, ast, "add");
+		case Op_BRANCH:
+			emit_branch(code, frame, instr, next);
 			break;
 
-		case ASType_SUB:
-			codegen_operator(file, ast, "sub");
+		case Op_TAILCALL:
+			emit_tail_call(code, frame, instr, next);
 			break;
 
-		case ASType_MUL:
-			codegen_factor(file, ast, "mult");
+		case Op_RETURN: {
+
+			char const* result = result_register(frame->gen);
+
+			if (instr->a.kind == OperandKind_CONST) Asm_emit(code, "li %s, %d", result, instr->a.value);
+			else if (instr->a.kind == OperandKind_VREG) move(code, result, source(code, frame, instr->a, result));
+			if (next) Asm_emit(code, "j _f_%s_exit", name);
 			break;
+		}
 
-		case ASType_DIV:
-			codegen_factor(file, ast, "div");
+		default:
+			emit_binary(code, frame, instr);
 			break;
+	}
+}
 
-		case ASType_CALL: {
+static void emit_function(Asm* code, Frame const* frame) {
 
-			node = ast->cdr;
+	Procedure const* function = frame->function;
+	char const*      name     = function->name;
+	int              offset   = 0;
 
-			char const* identifier = node->car->dyn;
+	Asm_emit(code, "_f_%s:", name);
 
-			/* save frame pointer */
-			fputs(
-				"  sw $fp, 0($sp)\n"
-				"  addiu $sp, $sp, -4\n",
-			file);
+	if (!frame->frameless) {
+		if (!frame->leaf) Asm_emit(code, "sw $ra, 0($sp)");
+		Asm_emit(code, "move $fp, $sp");
+		Asm_emit(code, "addiu $sp, $sp, %d", -4 - frame->size);
+	}
 
-			node = node->cdr->car;
+	/* only the callee saved registers this function hands out */
+	for (int r = 0; r < REGISTERS; ++r) {
+		if (frame->saved & 1u << r) Asm_emit(code, "sw %s, %d($fp)", REGISTER[r], offset -= 4);
+	}
 
-			int nargs = node->cdr ? codegen_call_arguments(file, node->cdr) : 0;
+	for (size_t i = 0; i < function->nblocks; ++i) {
 
-			/* jump then restore frame pointer */
-			fprintf(file,
-				"  jal _f_%s\n"
-				"  addiu $sp, $sp, %d\n"
-				"  lw $fp, 0($sp)\n",
-			identifier, (nargs + 1) << 2);
+		Block const* block = function->blocks[i];
+		Block const* next  = i + 1 < function->nblocks ? function->blocks[i + 1] : NULL;
 
-			break;
+		Asm_emit(code, "_f_%s_%d:", name, block->id);
+
+		for (size_t j = 0; j < block->count; ++j) {
+			emit_instr(code, frame, &block->code[j], next);
 		}
+	}
 
-		case ASType_VAR:
-			/* generate address of data */
-			codegen_variable_address(file, ast);
-			/* dereference address */
-			fputs("  lw $a0, 0($a0)\n", file);
-			break;
+	Asm_emit(code, "_f_%s_exit:", name);
+	emit_epilogue(code, frame);
+	Asm_emit(code, "jr $ra");
+}
 
-		case ASType_SET:
-			node = ast->cdr;
-			codegen_variable_address(file, node->car);
-			fputs(
-				"  sw $a0, 0($sp)\n"
-				"  addiu $sp, $sp, -4\n",
-			file);
-			node = node->cdr;
-			codegen_expression(file, node->car);
-			fputs(
-				"  lw $t1, 4($sp)\n"
-				"  sw $a0, 0($t1)\n"
-				"  addiu $sp, $sp, 4\n",
-			file);
-			break;
+static bool codegen_fun_declaration(Codegen* gen, Str* out, Pair* ast) {
 
-		default:
-			return;
+	PassManager* passes   = gen->options.passes;
+	Procedure*   function = lower_function(ast);
+	if (!function) return false;
+
+	if (gen->options.target != Target_IR && gen->segment != CGMeta_TEXT) {
+		gen->segment = CGMeta_TEXT;
+		Str_puts(out, "\n.text\n");
 	}
-}
 
+	gen->context.report  = out;
+	gen->context.comment = gen->options.target == Target_IR ? ";" : "#";
 
+	if (!PassManager_run_lowered(passes, function, &gen->context)) {
+		Analyses_clear(&passes->lowered);
+		Procedure_free(function);
+		return false;
+	}
 
-static void codegen_statment(FILE* file, Pair* ast, char const* function) {
+	if (gen->options.target == Target_IR) {
+		Procedure_dump(out, function);
+		Analyses_clear(&passes->lowered);
+		Procedure_free(function);
+		return true;
+	}
 
-	Pair* node;
+	Frame frame = { .gen = gen };
+	Asm   code;
+	bool  ok = allocate(&frame, function);
 
-	static int label_counter;
+	Asm_init(&code);
 
-	switch (ast->val) {
+	if (ok && optimizing(gen) && function->nslots) {
+		Str_printf(out, "# frame of %s: %d bytes, %d with no slots shared\n",
+			function->name, 4 + frame.size, 4 + frame.separate);
+	}
 
-		 /* expression statements */
-        case ASType_NUM:
-        case ASType_LE:
-        case ASType_LT:
-        case ASType_GT:
-        case ASType_GE:
-        case ASType_EQ:
-        case ASType_NE:
-        case ASType_ADD:
-        case ASType_SUB:
-        case ASType_MUL:
-        case ASType_DIV:
-        case ASType_CALL:
-        case ASType_VAR:
-        case ASType_SET:
-        	codegen_expression(file, ast);
-        	break;
-
-		case ASType_EMPTY_STMT:
-			/* nothing to do here */
-			break;
+	if (ok) {
 
-		case ASType_RETURN_STMT:
-			node = ast->cdr;
-			if (node) codegen_expression(file, node->car);
-			fprintf(file, "  j _f_%s_exit\n", function);
-			break;
+		emit_function(&code, &frame);
+		if (optimizing(gen)) Peephole_run(&code, gen->options.fired);
 
-		case ASType_ITERATION_STMT: {
+		ok = !code.failed;
+		if (ok) Asm_print(out, &code);
 
-			/* get unique identifier for this statement */
-			int label = label_counter++;
+		Str_puts(out, "\n");
+	}
 
-			node = ast->cdr;
+	Asm_release(&code);
+	Frame_release(&frame);
+	Analyses_clear(&passes->lowered);
+	Procedure_free(function);
 
-			fprintf(file, "_while_%d:\n", label);
+	return ok;
+}
 
-			 /* generate code for test expression */
-			codegen_expression(file, node->car);
+/* a new entry for a global, in the small data when it is small and there is room left, NULL when out of memory */
+static Global* declare(Codegen* gen, char const* name, int size) {
 
-			fprintf(file, "  beq $a0, $zero, _end_while_%d\n", label);
+	if (gen->nglobals == gen->gcapacity) {
 
-			/* generate statements for loop body */
-			node = node->cdr;
-			codegen_statment(file, node->car, function);
+		size_t  bigger = gen->gcapacity ? gen->gcapacity * 2 : 16;
+		Global* larger = Memory_realloc(MemoryTag_OTHER, gen->globals, bigger * sizeof (Global));
 
-			fprintf(file,
-				"  b _while_%d\n"
-				"_end_while_%d:\n",
-			label, label);
+		if (!larger) return NULL;
 
-			break;
-		}
+		gen->globals   = larger;
+		gen->gcapacity = bigger;
+	}
 
-		case ASType_SELECTION_STMT: {
+	char* copy = strdup(name);
+	if (!copy) return NULL;
 
-			/* get unique identifier for this statement */
-			int label = label_counter++;
+	Global* g = &gen->globals[gen->nglobals++];
+	*g = (Global) { copy, size, 0, -1 };
 
-			node = ast->cdr;
+	if (size <= SMALL_LIMIT && size <= SMALL_SIZE - gen->small) {
+		g->offset   = gen->small;
+		gen->small += size;
+	}
 
-			 /* generate code for test expression */
-			codegen_expression(file, node->car);
+	return g;
+}
 
-			if (node->cdr->cdr) {
-				/* two branch if statement */
-				fprintf(file, "  bne $a0, $zero, _if_%d\n", label);
+/* adds up the references to each global under ast, a variable named by a global's name with no local binding */
+static void weigh(Codegen* gen, Pair* ast, int depth) {
 
-				node = node->cdr;
-				Pair* true_branch  = node->car;
-				node = node->cdr; 
-				Pair* false_branch = node->car;
+	if (!ast) return;
 
-				/* generate false branch statements */
-				codegen_statment(file, false_branch, function);
+	if (ast->val == ASType_ITERATION_STMT && depth < 6) ++depth;
 
-				fprintf(file,
-					"  b _end_if_%d\n"
-					"_if_%d:\n",
-				label, label);
+	if (ast->val == ASType_VAR && ast->cdr->car->num == 0) {
 
-				/* generate true branch statements */
-				codegen_statment(file, true_branch, function);
+		Global* g   = global(gen, ast->cdr->car->dyn);
+		long    use = 1;
 
-			} else {
-				/* one branch if statement */
-				fprintf(file, "  beq $a0, $zero, _end_if_%d\n", label);
+		for (int d = depth; d > 0; --d) use *= LOOP_WEIGHT;
+		if (g) g->weight += use;
+	}
 
-				/* generate true branch statements */
-				node = node->cdr;
-				codegen_statment(file, node->car, function);
-			}
+	for (Pair* node = ast->cdr; node; node = node->cdr) weigh(gen, node->car, depth);
+}
 
-			fprintf(file, "_end_if_%d:\n", label);
-			break;
-		}
+/* fewest bytes per reference first, the earlier declared of two alike */
+static int by_heat(void const* x, void const* y) {
 
-		case ASType_COMPOUND_STMT:
-			codegen_compound_stmt(file, ast, function);
-			break;
+	Global const* a = x;
+	Global const* b = y;
 
-		default:
-			return;
-	}
+	long long left  = (long long) b->weight * a->size;
+	long long right = (long long) a->weight * b->size;
 
+	if (left != right) return left < right ? -1 : 1;
+	return a->offset < b->offset ? -1 : a->offset > b->offset;
 }
 
-static void codegen_compound_stmt(FILE* file, Pair* ast, char const* function) {
+/* the small data in order, the offset of -1 the rest have ending up last as unsigned */
+static int by_offset(void const* x, void const* y) {
 
-	int offset = ast->num;
+	unsigned a = (unsigned) ((Global const*) x)->offset;
+	unsigned b = (unsigned) ((Global const*) y)->offset;
 
-	Pair* node = ast->cdr;
-	if (!node) return;
+	return (a > b) - (a < b);
+}
 
-	if (offset)
-		fprintf(file, "  addiu $sp, $sp, %d\n", offset);
+/*
+ * The small globals go in declaration order, as they would compiling one
+ * declaration at a time. Only when there are more than the small data holds
+ * does the whole program at hand matter: the globals referenced most for
+ * their size are given it first, so that the ones that do not fit are the
+ * ones it matters least for.
+ */
+static void layout(Codegen* gen, Pair* program) {
 
-	 do {
+	long wanted = 0;
 
-		switch (node->car->val) {
+	for (Pair* node = program->cdr; node; node = node->cdr) {
 
-			case ASType_NUM:
-			case ASType_LE:
-			case ASType_LT:
-			case ASType_GT:
-			case ASType_GE:
-			case ASType_EQ:
-			case ASType_NE:
-			case ASType_ADD:
-			case ASType_SUB:
-			case ASType_MUL:
-			case ASType_DIV:
-			case ASType_CALL:
-			case ASType_VAR:
-			case ASType_SET:
-				codegen_expression(file, node->car);
-				break;
+		Pair* declaration = node->car;
+		if (declaration->val != ASType_VAR_DECLARATION) continue;
 
-			case ASType_EMPTY_STMT:
-			case ASType_RETURN_STMT:
-			case ASType_ITERATION_STMT:
-			case ASType_SELECTION_STMT:
-			case ASType_COMPOUND_STMT:
-				codegen_statment(file, node->car, function);
-				break;
+		Pair* named = declaration->cdr->cdr;
+		int   size  = named->cdr ? named->cdr->car->num << 2 : 4;
 
+		if (!declare(gen, named->car->dyn, size)) return;
+		if (size <= SMALL_LIMIT) wanted += size;
+	}
 
-			case ASType_VAR_DECLARATION:
-				/* nothing to do, offset was calculated during semantic analysis */
-				break;
+	if (wanted <= SMALL_SIZE) return;
 
-			default:
-				return;
-		}
+	for (Pair* node = program->cdr; node; node = node->cdr) {
+		if (node->car->val == ASType_FUN_DECLARATION) weigh(gen, node->car, 0);
+	}
 
-	} while ((node = node->cdr));
+	/* declaration order breaks ties, the offsets holding it while sorting */
+	for (size_t i = 0; i < gen->nglobals; ++i) gen->globals[i].offset = (int) i;
+	qsort(gen->globals, gen->nglobals, sizeof (Global), by_heat);
 
-	if (offset)
-		fprintf(file, "  addiu $sp, $sp, %d\n", -offset);
-}
+	gen->small = 0;
 
-static void codegen_fun_declaration(FILE* file, Pair* ast) {
+	for (size_t i = 0; i < gen->nglobals; ++i) {
 
-	if (segment != CGMeta_TEXT) {
-		segment = CGMeta_TEXT;
-		fputs("\n.text\n", file);
+		Global* g = &gen->globals[i];
+
+		g->offset = g->size <= SMALL_LIMIT && g->size <= SMALL_SIZE - gen->small ? gen->small : -1;
+		if (g->offset >= 0) gen->small += g->size;
 	}
+}
+
+/* this function is only used for global variables
+   locals are virtual registers or frame slots of
+   the function lowered to IR */
+
+static void codegen_var_declaration(Codegen* gen, Str* out, Pair* ast) {
 
 	Pair*       node       = ast->cdr->cdr;
 	char const* identifier = node->car->dyn;
+	int         size       = (node = node->cdr) ? node->car->num << 2 : 4;
 
-	fprintf(file,
-		"_f_%s:\n"
-		"  sw $ra, 0($sp)\n"
-		"  move $fp, $sp\n"
-		"  addiu $sp, $sp, -4\n",
-	identifier);
+	if (gen->options.target == Target_IR) {
+		Str_printf(out, "global %s %d\n\n", identifier, size);
+		return;
+	}
 
-	node = node->cdr->cdr;
+	/* laid out already or now, what is in the small data is written at the end */
+	if (optimizing(gen)) {
 
-	codegen_compound_stmt(file, node->car, identifier);
+		Global const* g = global(gen, identifier);
+		if (!g) g = declare(gen, identifier, size);
 
-	fprintf(file,
-		"_f_%s_exit:\n"
-		"  move $sp, $fp\n"
-		"  lw $ra, 0($sp)\n"
-		"  jr $ra\n\n",
-	identifier);
+		if (g && g->offset >= 0) return;
+	}
 
+	if (gen->segment != CGMeta_DATA) {
+		gen->segment = CGMeta_DATA;
+		Str_puts(out, "\n.data\n");
+	}
+
+	Str_printf(out, "_v_%s: .space %d\n", identifier, size);
 }
 
-/* this function is only used for global variables
-   local variables are allocate to the stack at the
-   beginning of their corresponding compound statement */
+Codegen* codegen_begin(Str* out, CodegenOptions const* with) {
 
-static void codegen_var_declaration(FILE* file, Pair* ast) {
+	Codegen* gen = Memory_calloc(MemoryTag_OTHER, 1, sizeof (Codegen));
+	if (!gen) return NULL;
 
-	if (segment != CGMeta_DATA) {
-		segment = CGMeta_DATA;
-		fputs("\n.data\n", file);
-	}
+	gen->segment = CGMeta_TEXT;
+	gen->options = *with;
 
-	Pair*       node       = ast->cdr->cdr;
-	char const* identifier = node->car->dyn;
-	int         size       = (node = node->cdr) ? node->car->num << 2 : 4; 
+	if (gen->options.target == Target_MIPS) Str_puts(out, ".text\n");
+	return gen;
+}
+
+bool codegen_declaration(Codegen* gen, Str* out, Pair* ast) {
+
+	bool ok = true;
 
-	fprintf(file, "_v_%s: .space %d\n", identifier, size);
+	switch (ast->val) {
+
+		case ASType_FUN_DECLARATION:
+			Trace_begin("codegen", ast->cdr->cdr->car->dyn);
+			ok = codegen_fun_declaration(gen, out, ast);
+			Trace_end("codegen", ast->cdr->cdr->car->dyn);
+			break;
+
+		case ASType_VAR_DECLARATION:
+			codegen_var_declaration(gen, out, ast);
+			break;
+
+		default:
+			break;
+	}
+
+	return ok;
 }
 
-/*     !!! WARNING !!!
-   AST MUST PASS SEMANTIC
-   ANALYSIS BEFORE CODEGEN */
+void codegen_abandon(Codegen* gen) {
 
-void codegen(FILE* file, Pair* ast) {
+	if (!gen) return;
 
-	Pair* node = ast;
-	segment    = CGMeta_TEXT;
+	Inliner_free(gen->context.inliner);
 
-	fputs(BUILTINS, file);
+	for (size_t i = 0; i < gen->nglobals; ++i) Memory_free(gen->globals[i].name);
+	Memory_free(gen->globals);
+	Memory_free(gen);
+}
 
-	/* skip program node to get into declaration list */
-	node = node->cdr;
+/* the small data in one piece at the start of the data segment, in the order of the offsets handed out */
+static void write_small(Codegen* gen, Str* out) {
 
-	while (node) {
+	if (!gen->small) return;
 
-		Pair* car = node->car;
-		
-		/* generate code for this node */
-		switch (car->val) {
+	qsort(gen->globals, gen->nglobals, sizeof (Global), by_offset);
+	Str_printf(out, "\n.data 0x%x\n", SMALL_DATA);
 
-			case ASType_FUN_DECLARATION:
-				codegen_fun_declaration(file, car);
-				break;
+	for (size_t i = 0; i < gen->nglobals && gen->globals[i].offset >= 0; ++i) {
+		Str_printf(out, "_v_%s: .space %d\n", gen->globals[i].name, gen->globals[i].size);
+	}
+}
 
-			case ASType_VAR_DECLARATION:
-				codegen_var_declaration(file, car);
-				break;
+void codegen_end(Codegen* gen, Str* out) {
 
-			default:
-				return;
-		}
+	if (gen->options.target == Target_IR) {
+		codegen_abandon(gen);
+		return;
+	}
 
-		node = node->cdr;
+	if (gen->segment != CGMeta_TEXT) {
+		gen->segment = CGMeta_TEXT;
+		Str_puts(out, "\n.text\n");
 	}
 
-	if (segment != CGMeta_TEXT) {
-		segment = CGMeta_TEXT;
-		fputs("\n.text\n", file);
+	for (size_t i = 0; i < BUILTIN_COUNT; ++i) {
+
+		Builtin const* b = &builtins[i];
+
+		if (!gen->referenced[i]) continue;
+
+		char const* fetch = b->nargs && !in_registers(gen) ? "  lw $a0, 4($sp)\n" : "";
+		Str_printf(out, buffered(gen, b) ? b->buffered : b->code, fetch, result_register(gen));
 	}
 
-	fputs(ENTRY_EXIT, file);
+	if (gen->options.buffer_output) Str_puts(out, FLUSH);
+
+	Str_puts(out, ENTRY);
+	if (gen->options.buffer_output) Str_puts(out, "  jal _rt_flush\n");
+	Str_puts(out, EXIT);
+
+	write_small(gen, out);
+	codegen_abandon(gen);
 }
 
+/*     !!! WARNING !!!
+   AST MUST PASS SEMANTIC
+   ANALYSIS BEFORE CODEGEN */
+
+bool codegen(Str* out, Pair* ast, CodegenOptions const* with) {
+
+	Codegen* gen = codegen_begin(out, with);
+	if (!gen) return false;
 
+	if (optimizing(gen) && gen->options.target == Target_MIPS) layout(gen, ast);
+
+	/* skip program node to get into declaration list */
+	for (Pair* node = ast->cdr; node; node = node->cdr) {
+		if (!codegen_declaration(gen, out, node->car)) {
+			codegen_abandon(gen);
+			return false;
+		}
+	}
+
+	codegen_end(gen, out);
+	return true;
+}
@@ -0,0 +1,209 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "../include/memory.h"
+#include "../include/fold.h"
+
+static bool number(Pair* expression, int value) {
+	return expression->val == ASType_NUM && expression->num == value;
+}
+
+/* whether leaving the expression out entirely would go unnoticed */
+static bool pure(Pair* expression) {
+
+	switch (expression->val) {
+
+		case ASType_NUM:
+			return true;
+
+		case ASType_VAR:
+			return !expression->dyn || pure(expression->cdr->cdr->car);
+
+		case ASType_CALL:
+		case ASType_SET:
+			return false;
+
+		default:
+			return pure(expression->cdr->car) && pure(expression->cdr->cdr->car);
+	}
+}
+
+/* whether two pure expressions always have the same value */
+static bool same(Pair* x, Pair* y) {
+
+	if (x->val != y->val) return false;
+
+	switch (x->val) {
+
+		case ASType_NUM:
+			return x->num == y->num;
+
+		case ASType_VAR: {
+
+			Pair* a = x->cdr->car;
+			Pair* b = y->cdr->car;
+
+			if (a->num != b->num || strcmp(a->dyn, b->dyn) != 0 || x->dyn != y->dyn) return false;
+			return !x->dyn || same(x->cdr->cdr->car, y->cdr->cdr->car);
+		}
+
+		case ASType_CALL:
+		case ASType_SET:
+			return false;
+
+		default:
+			return same(x->cdr->car, y->cdr->car) && same(x->cdr->cdr->car, y->cdr->cdr->car);
+	}
+}
+
+/*
+ * The value of x op y in 32 bits, false when the generated code would trap
+ * instead, add and sub on overflow and div by zero. Division truncates toward
+ * zero in C as it does in MIPS, multiplication keeps the low word as mflo does.
+ */
+static bool evaluate(ASType op, int32_t x, int32_t y, int32_t* value) {
+
+	int64_t wide;
+
+	switch (op) {
+
+		case ASType_ADD:
+			wide = (int64_t) x + y;
+			break;
+
+		case ASType_SUB:
+			wide = (int64_t) x - y;
+			break;
+
+		case ASType_MUL:
+			*value = (int32_t) ((uint32_t) x * (uint32_t) y);
+			return true;
+
+		case ASType_DIV:
+			if (y == 0 || (x == INT32_MIN && y == -1)) return false;
+			*value = x / y;
+			return true;
+
+		case ASType_LT: *value = x <  y; return true;
+		case ASType_LE: *value = x <= y; return true;
+		case ASType_GT: *value = x >  y; return true;
+		case ASType_GE: *value = x >= y; return true;
+		case ASType_EQ: *value = x == y; return true;
+		case ASType_NE: *value = x != y; return true;
+
+		default:
+			return false;
+	}
+
+	if (wide < INT32_MIN || wide > INT32_MAX) return false;
+
+	*value = (int32_t) wide;
+	return true;
+}
+
+static void become_number(Pair* expression, int value) {
+
+	Pair_free(expression->cdr);
+
+	expression->val = ASType_NUM;
+	expression->num = value;
+	expression->cdr = NULL;
+}
+
+/* overwrite expression with the operand held by cell */
+static void become_operand(Pair* expression, Pair* cell) {
+
+	Pair* operand = cell->car;
+	cell->car = NULL;
+
+	Pair_free(expression->cdr);
+
+	*expression = *operand;
+	Memory_free(operand);
+}
+
+static bool simplify(Pair* expression) {
+
+	Pair*   left  = expression->cdr->car;
+	Pair*   right = expression->cdr->cdr->car;
+	int32_t value;
+
+	if (left->val == ASType_NUM && right->val == ASType_NUM) {
+		if (!evaluate(expression->val, left->num, right->num, &value)) return false;
+		become_number(expression, value);
+		return true;
+	}
+
+	switch (expression->val) {
+
+		case ASType_ADD:
+			if (number(right, 0)) goto keep_left;
+			if (number(left, 0))  goto keep_right;
+			return false;
+
+		case ASType_SUB:
+			if (number(right, 0)) goto keep_left;
+			if (pure(left) && same(left, right)) goto zero;
+			return false;
+
+		case ASType_MUL:
+			if (number(right, 1)) goto keep_left;
+			if (number(left, 1))  goto keep_right;
+			if ((number(right, 0) && pure(left)) || (number(left, 0) && pure(right))) goto zero;
+			return false;
+
+		case ASType_DIV:
+			if (number(right, 1)) goto keep_left;
+			return false;
+
+		default:
+			return false;
+	}
+
+keep_left:
+	become_operand(expression, expression->cdr);
+	return true;
+
+keep_right:
+	become_operand(expression, expression->cdr->cdr);
+	return true;
+
+zero:
+	become_number(expression, 0);
+	return true;
+}
+
+/* every node keeps its children in the cars of its cdr list, so one walk reaches every expression */
+static bool fold(Pair* ast) {
+
+	bool changed = false;
+
+	for (Pair* node = ast->cdr; node; node = node->cdr) {
+		if (node->car) changed |= fold(node->car);
+	}
+
+	switch (ast->val) {
+
+		case ASType_ADD: case ASType_SUB: case ASType_MUL: case ASType_DIV:
+		case ASType_LT:  case ASType_LE:  case ASType_GT:  case ASType_GE:
+		case ASType_EQ:  case ASType_NE:
+			changed |= simplify(ast);
+			break;
+
+		default:
+			break;
+	}
+
+	return changed;
+}
+
+static bool run_fold(Pair* function, Analyses* analyses) {
+	return fold(function);
+}
+
+/* a loop condition that folds to a literal changes which statements complete */
+Pass const Pass_FOLD = {
+	.name        = "fold",
+	.invalidates = ANALYSIS(Analysis_FLOW),
+	.run         = run_fold,
+};
@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/memory.h"
+#include "../include/loop.h"
+#include "../include/hoist.h"
+
+typedef struct Hoisting {
+
+	Procedure* function;
+
+	/* how often each virtual register is written in the function and in the loop at hand */
+	int*       defs;
+	int*       inside;
+
+	/* whether anything moved */
+	bool       changed;
+
+} Hoisting;
+
+/* what may run before it did without changing what the program does */
+static bool movable(Op op) {
+
+	switch (op) {
+
+		case Op_COPY: case Op_MUL:
+		case Op_LT: case Op_LE: case Op_GT: case Op_GE: case Op_EQ: case Op_NE:
+		case Op_ADDU: case Op_SLL: case Op_ADDR: case Op_LOAD:
+			return true;
+
+		/* add and sub trap on overflow, div on zero */
+		default:
+			return false;
+	}
+}
+
+/* whether the word a load reads may be written somewhere in the loop, a call or a store through a register may write anything */
+static bool clobbered(Loop const* loop, Instr const* load) {
+
+	for (size_t i = 0; i < loop->count; ++i) {
+
+		Block const* block = loop->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+
+			Instr const* instr = &block->code[j];
+
+			if (instr->op == Op_CALL) return true;
+			if (instr->op != Op_STORE) continue;
+
+			if (!instr->symbol && instr->slot < 0) return true;
+			if (load->symbol && instr->symbol && strcmp(load->symbol, instr->symbol) == 0) return true;
+			if (load->slot >= 0 && instr->slot == load->slot) return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Only temporaries move, each is written once and read after, so the preheader
+ * still comes before every read. A load through a register stays, the address
+ * may only be good on the iterations that reach it.
+ */
+static bool invariant(Hoisting const* h, Loop const* loop, Instr* instr) {
+
+	if (!movable(instr->op) || instr->dst < 0) return false;
+	if (h->function->names[instr->dst] || h->defs[instr->dst] != 1) return false;
+
+	Operand* operand;
+
+	for (size_t k = 0; (operand = Instr_use(instr, k)); ++k) {
+		if (operand->kind == OperandKind_VREG && h->inside[operand->value]) return false;
+	}
+
+	return instr->op != Op_LOAD || (instr->a.kind != OperandKind_VREG && !clobbered(loop, instr));
+}
+
+/* puts instr before the jump that ends the preheader */
+static bool prepend(Procedure* function, Block* preheader, Instr const* instr) {
+
+	if (!Block_append(function, preheader, instr)) return false;
+
+	Instr* code = preheader->code;
+	size_t last = preheader->count - 1;
+	Instr  jump = code[last - 1];
+
+	code[last - 1] = code[last];
+	code[last]     = jump;
+
+	return true;
+}
+
+static bool hoist(Hoisting* h, Loop const* loop) {
+
+	memset(h->inside, 0, h->function->nvregs * sizeof (int));
+
+	for (size_t i = 0; i < loop->count; ++i) {
+
+		Block const* block = loop->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+			if (block->code[j].dst >= 0) ++h->inside[block->code[j].dst];
+		}
+	}
+
+	/* until whatever depended on what moved has had the chance to move after it */
+	for (bool changed = true; changed;) {
+
+		changed = false;
+
+		for (size_t i = 0; i < loop->count; ++i) {
+
+			Block* block = loop->blocks[i];
+
+			for (size_t j = 0; j < block->count;) {
+
+				Instr instr = block->code[j];
+
+				if (!invariant(h, loop, &block->code[j])) {
+					++j;
+					continue;
+				}
+
+				memmove(&block->code[j], &block->code[j + 1], (block->count - j - 1) * sizeof (Instr));
+				--block->count;
+
+				if (!prepend(h->function, loop->preheader, &instr)) return false;
+
+				--h->inside[instr.dst];
+				changed    = true;
+				h->changed = true;
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool run_hoist(Procedure* function, Analyses* analyses, PassContext* context, bool* changed) {
+
+	size_t       nvregs = function->nvregs;
+	Hoisting     h      = { function, NULL, NULL, false };
+	Loops const* loops  = Analyses_get(analyses, Analysis_LOOPS);
+	bool         ok     = false;
+
+	h.defs   = Memory_calloc(MemoryTag_IR, nvregs ? nvregs : 1, sizeof (int));
+	h.inside = Memory_calloc(MemoryTag_IR, nvregs ? nvregs : 1, sizeof (int));
+
+	if (!h.defs || !h.inside) goto done;
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block const* block = function->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+			if (block->code[j].dst >= 0) ++h.defs[block->code[j].dst];
+		}
+	}
+
+	for (size_t i = 0; i < loops->count; ++i) {
+		if (!hoist(&h, &loops->loops[i])) goto done;
+	}
+
+	ok = true;
+
+done:
+	Memory_free(h.defs);
+	Memory_free(h.inside);
+
+	*changed = h.changed;
+	return ok;
+}
+
+/* only instructions move, the loops stay as they were for the passes after */
+Pass const Pass_HOIST = {
+	.name        = "hoist",
+	.requires    = ANALYSIS(Analysis_LOOPS),
+	.invalidates = ANALYSIS(Analysis_LIVENESS),
+	.lowered     = run_hoist,
+};
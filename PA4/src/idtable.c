@@ -3,30 +3,33 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../include/str.h"
 #include "../include/type.h"
 #include "../include/idtable.h"
+#include "../include/memory.h"
 
-const unsigned SIZE_CLASSES = 9;
+const unsigned SIZE_CLASSES = 17;
 
 const unsigned SIZE_CLASS[] = {
-	37, 67, 127, 257, 509, 1019, 2039, 4073, 7919
+	37, 67, 127, 257, 509, 1019, 2039, 4073, 7919,
+	15823, 31643, 63281, 126551, 253081, 506147, 1012289, 2024573
 };
 
 IDTable* IDTable_new(int size_class) {
 
-	if (size_class < 0 || size_class > 9)
+	if (size_class < 0 || size_class >= SIZE_CLASSES)
 		return NULL;
 
-	IDTable* table = malloc(sizeof (IDTable));
+	IDTable* table = Memory_alloc(MemoryTag_IDTABLE, sizeof (IDTable));
 	if (!table) goto fail_1;
 
-	table->keys = calloc(SIZE_CLASS[size_class], sizeof (char const*));
+	table->keys = Memory_calloc(MemoryTag_IDTABLE, SIZE_CLASS[size_class], sizeof (char const*));
 	if (!table->keys) goto fail_2;
 
-	table->vals = calloc(SIZE_CLASS[size_class], sizeof (Type*));
+	table->vals = Memory_calloc(MemoryTag_IDTABLE, SIZE_CLASS[size_class], sizeof (Type*));
 	if (!table->vals) goto fail_3;
 
-	table->offs = calloc(SIZE_CLASS[size_class], sizeof (int));
+	table->offs = Memory_calloc(MemoryTag_IDTABLE, SIZE_CLASS[size_class], sizeof (int));
 	if (!table->vals) goto fail_4;
 
 	table->size_class = 0;
@@ -35,11 +38,11 @@ IDTable* IDTable_new(int size_class) {
 	return table;
 
 fail_4:
-	free(table->vals);
+	Memory_free(table->vals);
 fail_3:
-	free(table->keys);
+	Memory_free(table->keys);
 fail_2:
-	free(table);
+	Memory_free(table);
 fail_1:
 	return NULL;
 }
@@ -62,9 +65,10 @@ static unsigned hash2(char const* key, unsigned mod) {
 	unsigned value = 0;
 
 	while ((glyph = *key++)) {
-		value = (17 * value + glyph) % mod;
+		value = (17 * value + glyph) % (mod - 1);
 	}
 
+	/* a step of zero or mod would probe the same slot forever */
 	return value + 1;
 }
 
@@ -101,13 +105,13 @@ static bool IDTable_grow(IDTable* table) {
 	unsigned old_size = SIZE_CLASS[table->size_class];
 	unsigned new_size = SIZE_CLASS[table->size_class + 1];
 	
-	char const** keys = calloc(new_size, sizeof (char const*));
+	char const** keys = Memory_calloc(MemoryTag_IDTABLE, new_size, sizeof (char const*));
 	if (!table->keys) goto fail_1;
 
-	Type** vals = calloc(new_size, sizeof (Type*));
+	Type** vals = Memory_calloc(MemoryTag_IDTABLE, new_size, sizeof (Type*));
 	if (!table->vals) goto fail_2;
 
-	int* offs = calloc(new_size, sizeof (int));
+	int* offs = Memory_calloc(MemoryTag_IDTABLE, new_size, sizeof (int));
 	if (!table->offs) goto fail_3;
 
 	for (unsigned i = 0; i < old_size; ++i) {
@@ -127,9 +131,9 @@ static bool IDTable_grow(IDTable* table) {
 		}
 	}
 
-	free(table->keys);
-	free(table->vals);
-	free(table->offs);
+	Memory_free(table->keys);
+	Memory_free(table->vals);
+	Memory_free(table->offs);
 
 	table->keys = keys;
 	table->vals = vals;
@@ -140,11 +144,11 @@ static bool IDTable_grow(IDTable* table) {
 	return true;
 
 fail_4:
-	free(offs);
+	Memory_free(offs);
 fail_3:
-	free(vals);
+	Memory_free(vals);
 fail_2:
-	free(keys);
+	Memory_free(keys);
 fail_1:
 	return false;
 }
@@ -159,12 +163,16 @@ IDTableStatus IDTable_put(IDTable* table, char const* key, Type* val, int off) {
 	if (IDTable_full(table) && !IDTable_grow(table))
 		return IDTableStatus_NO_SPACE;
 
+	/* the table owns its keys so it can outlive the tree they came from */
+	char const* owned = strdup(key);
+	if (!owned) return IDTableStatus_NO_SPACE;
+
 	IDTableStatus status = IDTable_put_helper(
 		SIZE_CLASS[table->size_class],
 		table->keys,
 		table->vals,
 		table->offs,
-		key,
+		owned,
 		val,
 		off
 	);
@@ -172,7 +180,9 @@ IDTableStatus IDTable_put(IDTable* table, char const* key, Type* val, int off) {
 	switch (status) {
 		case IDTableStatus_OK:
 			++table->used;
+			return status;
 		default:
+			Memory_free((void*) owned);
 			return status;
 	}
 }
@@ -199,14 +209,15 @@ void IDTable_free(IDTable* table) {
 	unsigned size = SIZE_CLASS[table->size_class];
 
 	for (unsigned i = 0; i < size; ++i) {
+		Memory_free((void*) table->keys[i]);
 		Type_free((void*) table->vals[i]);
 	}
 
-	free(table->keys);
-	free(table->vals);
-	free(table->offs);
+	Memory_free(table->keys);
+	Memory_free(table->vals);
+	Memory_free(table->offs);
 
-	free(table);
+	Memory_free(table);
 }
 
 void IDTable_write(FILE* file, IDTable* table) {
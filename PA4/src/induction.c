@@ -0,0 +1,644 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/memory.h"
+#include "../include/loop.h"
+#include "../include/liveness.h"
+#include "../include/induction.h"
+
+/* how far into a global a pointer's exit test may look, the data segment is nowhere near the top of memory */
+#define GLOBAL_REACH  (1 << 24)
+
+/* how far a pointer may step past the end of what it is compared against */
+#define STEP_REACH    64
+
+/* a register kept equal to base + counter * scale all through a loop */
+typedef struct Pointer {
+
+	int         counter;
+	int         scale;
+
+	/* a global, a frame slot, a loop invariant register, or none of them */
+	char const* symbol;
+	int         slot;
+	int         base;
+
+	int         vreg;
+
+} Pointer;
+
+typedef struct Reduction {
+
+	Procedure*  function;
+	Analyses*   analyses;
+	Loop const* loop;
+
+	/* how often each virtual register is written in the loop */
+	int*        inside;
+	size_t      ninside;
+
+	/* the pointers of the loop at hand */
+	Pointer*    pointers;
+	size_t      npointers;
+	size_t      capacity;
+
+	/* whether any address was rewritten */
+	bool        changed;
+
+} Reduction;
+
+static Instr make(Op op, int dst) {
+	return (Instr) { op, dst, Operand_NONE, Operand_NONE, 0, NULL, -1, NULL, 0, { NULL, NULL } };
+}
+
+static bool is(Operand operand, int vreg) {
+	return operand.kind == OperandKind_VREG && operand.value == vreg;
+}
+
+/* puts instr at position at of block, moving what was there on */
+static bool insert(Procedure* function, Block* block, size_t at, Instr const* instr) {
+
+	if (!Block_append(function, block, instr)) return false;
+
+	Instr added = block->code[block->count - 1];
+
+	memmove(&block->code[at + 1], &block->code[at], (block->count - 1 - at) * sizeof (Instr));
+	block->code[at] = added;
+
+	return true;
+}
+
+static void erase(Block* block, size_t at) {
+	memmove(&block->code[at], &block->code[at + 1], (block->count - at - 1) * sizeof (Instr));
+	--block->count;
+}
+
+/* a new temporary, written nowhere in the loop yet */
+static int fresh(Reduction* r) {
+
+	int vreg = Procedure_vreg(r->function, NULL);
+	if (vreg < 0) return -1;
+
+	if ((size_t) vreg >= r->ninside) {
+
+		size_t bigger = r->ninside * 2 > (size_t) vreg ? r->ninside * 2 : (size_t) vreg + 1;
+		int*   larger = Memory_realloc(MemoryTag_IR, r->inside, bigger * sizeof (int));
+
+		if (!larger) {
+			r->function->failed = true;
+			return -1;
+		}
+
+		memset(larger + r->ninside, 0, (bigger - r->ninside) * sizeof (int));
+		r->inside  = larger;
+		r->ninside = bigger;
+	}
+
+	return vreg;
+}
+
+static int reads(Procedure const* function, int vreg) {
+
+	int count = 0;
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block* block = function->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+
+			Operand* operand;
+
+			for (size_t k = 0; (operand = Instr_use(&block->code[j], k)); ++k) {
+				if (is(*operand, vreg)) ++count;
+			}
+		}
+	}
+
+	return count;
+}
+
+static int writes(Procedure const* function, int vreg) {
+
+	int count = 0;
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block const* block = function->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+			if (block->code[j].dst == vreg) ++count;
+		}
+	}
+
+	return count;
+}
+
+/* where the one instruction of the loop writing the counter is, when it steps it by a constant */
+static bool step(Reduction const* r, int counter, Block** where, size_t* at, int* by) {
+
+	if (r->inside[counter] != 1) return false;
+
+	for (size_t i = 0; i < r->loop->count; ++i) {
+
+		Block* block = r->loop->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+
+			Instr const* instr = &block->code[j];
+			if (instr->dst != counter) continue;
+
+			*where = block;
+			*at    = j;
+
+			if (instr->op == Op_ADD && is(instr->a, counter) && instr->b.kind == OperandKind_CONST) {
+				*by = instr->b.value;
+				return true;
+			}
+
+			if (instr->op == Op_ADD && is(instr->b, counter) && instr->a.kind == OperandKind_CONST) {
+				*by = instr->a.value;
+				return true;
+			}
+
+			if (instr->op == Op_SUB && is(instr->a, counter) && instr->b.kind == OperandKind_CONST) {
+				*by = (int) (0u - (unsigned) instr->b.value);
+				return true;
+			}
+
+			return false;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Whether the temporary written at position at of block is only read further
+ * down the same block, with the counter not stepping in between, so that a
+ * pointer following the counter holds what it would have been computed from.
+ */
+static bool local(Reduction const* r, Block const* block, size_t at, int vreg, int counter) {
+
+	Block* where;
+	size_t position;
+	int    by;
+	int    count = 0;
+	size_t last  = at;
+
+	if (r->function->names[vreg] || writes(r->function, vreg) != 1) return false;
+	if (!step(r, counter, &where, &position, &by)) return false;
+
+	for (size_t j = at + 1; j < block->count; ++j) {
+
+		Instr*   instr = &block->code[j];
+		Operand* operand;
+
+		for (size_t k = 0; (operand = Instr_use(instr, k)); ++k) {
+			if (is(*operand, vreg)) {
+				++count;
+				last = j;
+			}
+		}
+	}
+
+	if (count != reads(r->function, vreg)) return false;
+
+	return where != block || position < at || position > last;
+}
+
+/* the pointer for base + counter * scale, set up in the preheader the first time it is asked for */
+static int pointer(Reduction* r, int counter, int scale, char const* symbol, int slot, int base) {
+
+	for (size_t i = 0; i < r->npointers; ++i) {
+
+		Pointer const* p = &r->pointers[i];
+
+		if (p->counter == counter && p->scale == scale && p->slot == slot && p->base == base
+			&& (p->symbol == symbol || (p->symbol && symbol && strcmp(p->symbol, symbol) == 0)))
+			return p->vreg;
+	}
+
+	if (r->npointers == r->capacity) {
+
+		size_t   bigger = r->capacity ? r->capacity * 2 : 8;
+		Pointer* larger = Memory_realloc(MemoryTag_IR, r->pointers, bigger * sizeof (Pointer));
+
+		if (!larger) {
+			r->function->failed = true;
+			return -1;
+		}
+
+		r->pointers = larger;
+		r->capacity = bigger;
+	}
+
+	Procedure* function  = r->function;
+	Block*     preheader = r->loop->preheader;
+	int        scaled    = fresh(r);
+	Instr      instr     = make(Op_MUL, scaled);
+	int        shift     = 0;
+
+	while (shift < 31 && 1u << shift != (unsigned) scale) ++shift;
+
+	instr.a = Operand_vreg(counter);
+
+	if (shift < 31) {
+		instr.op  = Op_SLL;
+		instr.imm = shift;
+	} else {
+		instr.b = Operand_const(scale);
+	}
+
+	if (scaled < 0 || !insert(function, preheader, preheader->count - 1, &instr)) return -1;
+
+	int vreg = scaled;
+
+	if (symbol || slot >= 0) {
+
+		int start = fresh(r);
+
+		instr        = make(Op_ADDR, start);
+		instr.symbol = symbol;
+		instr.slot   = slot;
+
+		if (start < 0 || !insert(function, preheader, preheader->count - 1, &instr)) return -1;
+
+		base = -1;
+		vreg = fresh(r);
+
+		instr   = make(Op_ADDU, vreg);
+		instr.a = Operand_vreg(start);
+		instr.b = Operand_vreg(scaled);
+
+		if (vreg < 0 || !insert(function, preheader, preheader->count - 1, &instr)) return -1;
+
+	} else if (base >= 0) {
+
+		vreg = fresh(r);
+
+		instr   = make(Op_ADDU, vreg);
+		instr.a = Operand_vreg(base);
+		instr.b = Operand_vreg(scaled);
+
+		if (vreg < 0 || !insert(function, preheader, preheader->count - 1, &instr)) return -1;
+	}
+
+	r->pointers[r->npointers++] = (Pointer) { counter, scale, symbol, slot, base, vreg };
+	return vreg;
+}
+
+/* replaces the reads of from in block after at with to */
+static void rename(Block* block, size_t at, int from, int to) {
+
+	for (size_t j = at + 1; j < block->count; ++j) {
+
+		Operand* operand;
+
+		for (size_t k = 0; (operand = Instr_use(&block->code[j], k)); ++k) {
+			if (is(*operand, from)) *operand = Operand_vreg(to);
+		}
+	}
+}
+
+/* where the temporary read as a is written by counter * constant just before at, with nothing else reading it */
+static bool product(Reduction const* r, Block const* block, size_t at, Operand a, size_t* where, int* counter, int* factor) {
+
+	for (size_t j = at; j-- > 0;) {
+
+		Instr const* instr = &block->code[j];
+		if (!is(a, instr->dst)) continue;
+
+		if (instr->op != Op_MUL) return false;
+
+		if (instr->a.kind == OperandKind_VREG && instr->b.kind == OperandKind_CONST) {
+			*counter = instr->a.value;
+			*factor  = instr->b.value;
+		} else if (instr->b.kind == OperandKind_VREG && instr->a.kind == OperandKind_CONST) {
+			*counter = instr->b.value;
+			*factor  = instr->a.value;
+		} else {
+			return false;
+		}
+
+		*where = j;
+		return reads(r->function, instr->dst) == 1 && local(r, block, j, instr->dst, *counter);
+	}
+
+	return false;
+}
+
+/*
+ * Rewrites the reads of index = counter << shift, or (counter * c) << shift,
+ * at position at of block: an invariant base added to it, and a global or slot
+ * addressed by it, become pointers of their own, anything else reads a pointer
+ * with no base. The pointers first asked for here then step right after the counter.
+ * 1 when it was rewritten, 0 when it stays, -1 when out of memory.
+ */
+static int reduce(Reduction* r, Block* block, size_t at) {
+
+	Instr  shift   = block->code[at];
+	int    index   = shift.dst;
+	size_t first   = r->npointers;
+	size_t where   = at;
+	int    counter = shift.a.value;
+	int    factor  = 1;
+
+	if (shift.op != Op_SLL || shift.a.kind != OperandKind_VREG) return 0;
+
+	if (!local(r, block, at, index, counter) && !product(r, block, at, shift.a, &where, &counter, &factor)) return 0;
+	if (!local(r, block, at, index, counter)) return 0;
+
+	int scale = (int) ((unsigned) factor << shift.imm);
+
+	for (size_t m = at + 1; m < block->count;) {
+
+		Instr*   user = &block->code[m];
+		Operand* operand;
+
+		if (user->op == Op_ADDU && is(user->a, index) != is(user->b, index)) {
+
+			Operand base = is(user->a, index) ? user->b : user->a;
+
+			if (base.kind == OperandKind_VREG && !r->inside[base.value] && local(r, block, m, user->dst, counter)) {
+
+				int p = pointer(r, counter, scale, NULL, -1, base.value);
+				if (p < 0) return -1;
+
+				rename(block, m, block->code[m].dst, p);
+				erase(block, m);
+				continue;
+			}
+		}
+
+		if ((user->op == Op_LOAD || user->op == Op_STORE) && is(user->a, index) && (user->symbol || user->slot >= 0)) {
+
+			int p = pointer(r, counter, scale, user->symbol, user->slot, -1);
+			if (p < 0) return -1;
+
+			user         = &block->code[m];
+			user->a      = Operand_vreg(p);
+			user->symbol = NULL;
+			user->slot   = -1;
+		}
+
+		for (size_t k = 0; (operand = Instr_use(&block->code[m], k)); ++k) {
+
+			if (!is(*operand, index)) continue;
+
+			int p = pointer(r, counter, scale, NULL, -1, -1);
+			if (p < 0) return -1;
+
+			*Instr_use(&block->code[m], k) = Operand_vreg(p);
+		}
+
+		++m;
+	}
+
+	erase(block, at);
+	if (where != at) erase(block, where);
+
+	Block* stepped;
+	size_t position;
+	int    by;
+
+	if (!step(r, counter, &stepped, &position, &by)) return 0;
+
+	for (size_t i = first; i < r->npointers; ++i) {
+
+		Pointer const* p     = &r->pointers[i];
+		Instr          instr = make(Op_ADDU, p->vreg);
+
+		instr.a = Operand_vreg(p->vreg);
+		instr.b = Operand_const((int) ((unsigned) by * (unsigned) p->scale));
+
+		if (!insert(r->function, stepped, ++position, &instr)) return -1;
+
+		++r->inside[p->vreg];
+	}
+
+	return 1;
+}
+
+/* 1 when the loop reads the counter just so many times and nothing reads it once the loop is left, -1 when out of memory */
+static int idle(Reduction* r, int counter, int times) {
+
+	int count = 0;
+
+	for (size_t i = 0; i < r->loop->count; ++i) {
+
+		Block* block = r->loop->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+
+			Operand* operand;
+
+			for (size_t k = 0; (operand = Instr_use(&block->code[j], k)); ++k) {
+				if (is(*operand, counter)) ++count;
+			}
+		}
+	}
+
+	if (count != times) return 0;
+
+	Liveness const* liveness = Analyses_get(r->analyses, Analysis_LIVENESS);
+	if (!liveness) return -1;
+
+	for (size_t i = 0; i < r->loop->count; ++i) {
+
+		Block* successors[2];
+		int    n = Block_successors(r->loop->blocks[i], successors);
+
+		for (int s = 0; s < n; ++s) {
+			if (!r->loop->contains[successors[s]->id] && Liveness_in(liveness, successors[s], counter)) return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* a counter left stepping only itself along is dropped, the pointers set up from it still read it before the loop, false when out of memory */
+static bool drop(Reduction* r, int counter) {
+
+	Block* where;
+	size_t position;
+	int    by;
+
+	if (!step(r, counter, &where, &position, &by)) return true;
+
+	int unused = idle(r, counter, 1);
+	if (unused <= 0) return unused == 0;
+
+	erase(where, position);
+	--r->inside[counter];
+
+	r->changed = true;
+	return true;
+}
+
+/* the constant the counter is set to on the way into the loop, false when that is not known */
+static bool start(Reduction const* r, int counter, int* value) {
+
+	Block const* block = r->loop->preheader;
+
+	for (size_t n = 0; n < r->function->nblocks; ++n) {
+
+		for (size_t j = block->count; j-- > 0;) {
+
+			Instr const* instr = &block->code[j];
+			if (instr->dst != counter) continue;
+
+			if (instr->op != Op_COPY || instr->a.kind != OperandKind_CONST) return false;
+
+			*value = instr->a.value;
+			return true;
+		}
+
+		if (block->npreds != 1) return false;
+		block = block->preds[0];
+	}
+
+	return false;
+}
+
+/*
+ * Rewrites the test of the counter against a constant that ends the block it
+ * steps in, staying in the loop while it holds, into the same test of a pointer
+ * into a global or a slot against where the pointer is at the constant, so that
+ * the loop need not read the counter any more. The counter going up from a known
+ * start keeps both sides within reach of where the pointer starts, so neither wraps.
+ * false when out of memory.
+ */
+static bool replace(Reduction* r, int counter) {
+
+	Block* block;
+	size_t position;
+	int    by;
+	int    from;
+	int    limit;
+
+	if (!step(r, counter, &block, &position, &by) || by <= 0 || !start(r, counter, &from) || from < 0) return true;
+
+	Instr* test = &block->code[block->count - 1];
+
+	if (test->op != Op_BRANCH || !r->loop->contains[test->targets[0]->id] || r->loop->contains[test->targets[1]->id]) return true;
+
+	if ((test->imm == Op_LT || test->imm == Op_LE) && is(test->a, counter) && test->b.kind == OperandKind_CONST) {
+		limit = test->b.value;
+	} else if ((test->imm == Op_GT || test->imm == Op_GE) && is(test->b, counter) && test->a.kind == OperandKind_CONST) {
+		limit = test->a.value;
+	} else {
+		return true;
+	}
+
+	Pointer const* p = NULL;
+
+	for (size_t i = 0; i < r->npointers && !p; ++i) {
+		Pointer const* candidate = &r->pointers[i];
+		if (candidate->counter == counter && candidate->scale > 0 && (candidate->symbol || candidate->slot >= 0)) p = candidate;
+	}
+
+	if (!p || limit < from) return true;
+
+	/* only worth it when the counter then goes */
+	int unused = idle(r, counter, 2);
+	if (unused <= 0) return unused == 0;
+
+	long long reach = p->symbol ? GLOBAL_REACH : r->function->slots[p->slot].size;
+
+	if ((long long) limit * p->scale > reach || (long long) by * p->scale > STEP_REACH) return true;
+
+	Block* preheader = r->loop->preheader;
+	int    end       = fresh(r);
+	Instr  instr     = make(Op_ADDR, end);
+
+	instr.symbol = p->symbol;
+	instr.slot   = p->slot;
+	instr.imm    = limit * p->scale;
+
+	if (end < 0 || !insert(r->function, preheader, preheader->count - 1, &instr)) return false;
+
+	test = &block->code[block->count - 1];
+
+	if (is(test->a, counter)) {
+		test->a = Operand_vreg(p->vreg);
+		test->b = Operand_vreg(end);
+	} else {
+		test->a = Operand_vreg(end);
+		test->b = Operand_vreg(p->vreg);
+	}
+
+	r->changed = true;
+	return true;
+}
+
+static bool reduce_loop(Reduction* r, Loop const* loop) {
+
+	r->loop      = loop;
+	r->npointers = 0;
+
+	memset(r->inside, 0, r->ninside * sizeof (int));
+
+	for (size_t i = 0; i < loop->count; ++i) {
+
+		Block const* block = loop->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+			if (block->code[j].dst >= 0) ++r->inside[block->code[j].dst];
+		}
+	}
+
+	for (size_t i = 0; i < loop->count; ++i) {
+
+		Block* block = loop->blocks[i];
+
+		for (size_t j = 0; j < block->count;) {
+
+			int reduced = reduce(r, block, j);
+
+			if (reduced < 0) return false;
+			if (!reduced) ++j;
+
+			r->changed |= reduced > 0;
+		}
+	}
+
+	for (size_t i = 0; i < r->npointers; ++i) {
+		if (!replace(r, r->pointers[i].counter) || !drop(r, r->pointers[i].counter)) return false;
+	}
+
+	return true;
+}
+
+static bool run_induction(Procedure* function, Analyses* analyses, PassContext* context, bool* changed) {
+
+	Reduction    r     = { function, analyses, NULL, NULL, function->nvregs, NULL, 0, 0, false };
+	Loops const* loops = Analyses_get(analyses, Analysis_LOOPS);
+	bool         ok    = false;
+
+	if (!r.ninside) r.ninside = 1;
+
+	r.inside = Memory_calloc(MemoryTag_IR, r.ninside, sizeof (int));
+	if (!r.inside) goto done;
+
+	for (size_t i = 0; i < loops->count; ++i) {
+		if (!reduce_loop(&r, &loops->loops[i])) goto done;
+	}
+
+	ok = true;
+
+done:
+	Memory_free(r.inside);
+	Memory_free(r.pointers);
+
+	*changed = r.changed;
+	return ok;
+}
+
+/* the pointers are set up in the preheaders the loops already have */
+Pass const Pass_INDUCTION = {
+	.name        = "induction",
+	.requires    = ANALYSIS(Analysis_LOOPS),
+	.invalidates = ANALYSIS(Analysis_LIVENESS),
+	.lowered     = run_induction,
+};
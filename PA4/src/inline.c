@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/memory.h"
+#include "../include/inline.h"
+
+/*
+ * What a call costs in instructions besides the callee's body: saving and
+ * restoring $fp, the jal and popping the arguments, then the callee's
+ * prologue, epilogue and return. Each argument is pushed and read back.
+ */
+#define CALL_COST     12
+#define ARGUMENT_COST 3
+
+/* a call inside a loop runs often enough to be worth this many times its cost in code */
+#define LOOP_FACTOR   2
+
+/* the most instructions inlining grows a caller to */
+#define BUDGET        400
+
+/* the most instructions the kept functions add up to, the oldest go to make room so a long program stays in flat memory */
+#define KEPT_LIMIT    2048
+
+typedef struct Kept {
+
+	/* lowered with the names and symbols it uses copied into strings */
+	Procedure* function;
+
+	int        size;
+
+	/* some path falls off the end, returning whatever was left in $a0 */
+	bool       falls;
+
+	/* the declarations the names came from are freed as codegen goes */
+	char**     strings;
+	size_t     nstrings;
+	size_t     scapacity;
+
+} Kept;
+
+struct Inliner {
+
+	/* oldest first */
+	Kept*  kept;
+	size_t count;
+	size_t capacity;
+
+	/* what the kept functions add up to */
+	int    size;
+
+};
+
+static Instr make(Op op, int dst) {
+	return (Instr) { op, dst, Operand_NONE, Operand_NONE, 0, NULL, -1, NULL, 0, { NULL, NULL } };
+}
+
+/* the instructions a function amounts to, parameters and jumps aside */
+static int measure(Procedure const* function) {
+
+	int size = 0;
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block const* block = function->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+			Op op = block->code[j].op;
+			if (op != Op_PARAM && op != Op_JUMP) ++size;
+		}
+	}
+
+	return size;
+}
+
+static bool falls(Procedure const* function) {
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block const* last = function->blocks[i];
+
+		if (last->count && last->code[last->count - 1].op == Op_RETURN
+			&& last->code[last->count - 1].a.kind == OperandKind_NONE) return true;
+	}
+
+	return false;
+}
+
+static int cost(int nargs, int depth) {
+	return (CALL_COST + ARGUMENT_COST * nargs) * (depth > 0 ? LOOP_FACTOR : 1);
+}
+
+/* the kept copy's own copy of a string, NULL when out of memory */
+static char const* intern(Kept* kept, char const* string) {
+
+	for (size_t i = 0; i < kept->nstrings; ++i) {
+		if (strcmp(kept->strings[i], string) == 0) return kept->strings[i];
+	}
+
+	if (kept->nstrings == kept->scapacity) {
+
+		size_t bigger = kept->scapacity ? kept->scapacity * 2 : 16;
+		char** larger = Memory_realloc(MemoryTag_IR, kept->strings, bigger * sizeof (char*));
+
+		if (!larger) return NULL;
+
+		kept->strings   = larger;
+		kept->scapacity = bigger;
+	}
+
+	size_t length = strlen(string);
+	char*  copy   = Memory_alloc(MemoryTag_IR, length + 1);
+
+	if (!copy) return NULL;
+
+	memcpy(copy, string, length + 1);
+	return kept->strings[kept->nstrings++] = copy;
+}
+
+static void release(Kept* kept) {
+
+	Procedure_free(kept->function);
+
+	for (size_t i = 0; i < kept->nstrings; ++i) {
+		Memory_free(kept->strings[i]);
+	}
+
+	Memory_free(kept->strings);
+}
+
+static Operand mapped(int const* vreg, Operand operand) {
+	return operand.kind == OperandKind_VREG ? Operand_vreg(vreg[operand.value]) : operand;
+}
+
+/*
+ * Copies instr over to block with the virtual registers, slots and blocks it
+ * names mapped, and its symbol interned when there is a kept copy to intern it in.
+ */
+static bool transfer(Procedure* function, Block* block, Instr const* instr, Kept* kept,
+	int const* vreg, int const* slot, Block* const* map) {
+
+	Instr copy = *instr;
+
+	copy.dst  = instr->dst >= 0 ? vreg[instr->dst] : -1;
+	copy.a    = mapped(vreg, instr->a);
+	copy.b    = mapped(vreg, instr->b);
+	copy.slot = instr->slot >= 0 ? slot[instr->slot] : -1;
+	copy.args = NULL;
+
+	for (int i = 0; i < 2; ++i) {
+		copy.targets[i] = instr->targets[i] ? map[instr->targets[i]->id] : NULL;
+	}
+
+	if (instr->symbol && kept && !(copy.symbol = intern(kept, instr->symbol))) return false;
+
+	if (instr->nargs) {
+
+		copy.args = Memory_alloc(MemoryTag_IR, instr->nargs * sizeof (Operand));
+		if (!copy.args) return false;
+
+		for (int i = 0; i < instr->nargs; ++i) {
+			copy.args[i] = mapped(vreg, instr->args[i]);
+		}
+	}
+
+	return Block_append(function, block, &copy) != NULL;
+}
+
+/* a copy of function whose strings all belong to kept, NULL when out of memory */
+static Procedure* keep(Kept* kept, Procedure const* function) {
+
+	char const* name  = intern(kept, function->name);
+	Procedure*  copy  = name ? Procedure_new(name, function->nparams) : NULL;
+	int*        vreg  = Memory_alloc(MemoryTag_IR, (function->nvregs ? function->nvregs : 1) * sizeof (int));
+	int*        slot  = Memory_alloc(MemoryTag_IR, (function->nslots ? function->nslots : 1) * sizeof (int));
+	Block**     map   = Memory_calloc(MemoryTag_IR, function->nextblock ? function->nextblock : 1, sizeof (Block*));
+	bool        ok    = false;
+
+	if (!copy || !vreg || !slot || !map) goto done;
+
+	for (int v = 0; v < function->nvregs; ++v) {
+
+		char const* named = function->names[v];
+
+		if (named && !(named = intern(kept, named))) goto done;
+		if ((vreg[v] = Procedure_vreg(copy, named)) < 0) goto done;
+	}
+
+	for (size_t s = 0; s < function->nslots; ++s) {
+
+		char const* named = intern(kept, function->slots[s].name);
+
+		if (!named || (slot[s] = Procedure_slot(copy, named, function->slots[s].size)) < 0) goto done;
+
+		copy->slots[slot[s]].first = function->slots[s].first;
+		copy->slots[slot[s]].last  = function->slots[s].last;
+	}
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block* block = Procedure_block(copy);
+		if (!block) goto done;
+
+		block->depth = function->blocks[i]->depth;
+		map[function->blocks[i]->id] = block;
+	}
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block const* block = function->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+			if (!transfer(copy, map[block->id], &block->code[j], kept, vreg, slot, map)) goto done;
+		}
+	}
+
+	ok = !copy->failed;
+
+done:
+	Memory_free(vreg);
+	Memory_free(slot);
+	Memory_free(map);
+
+	if (ok) return copy;
+
+	Procedure_free(copy);
+	return NULL;
+}
+
+/* moves the blocks from first on to right after the block at index */
+static bool place(Procedure* function, size_t index, size_t first) {
+
+	size_t  n     = function->nblocks - first;
+	Block** moved = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (Block*));
+
+	if (!moved) return false;
+
+	memcpy(moved, &function->blocks[first], n * sizeof (Block*));
+	memmove(&function->blocks[index + 1 + n], &function->blocks[index + 1], (first - index - 1) * sizeof (Block*));
+	memcpy(&function->blocks[index + 1], moved, n * sizeof (Block*));
+
+	Memory_free(moved);
+	return true;
+}
+
+/*
+ * Replaces the call at code[j] of the block at index with the body of callee,
+ * laid out right after it. The parameters become copies of the arguments,
+ * array arguments being addresses already, each return a copy into the
+ * call's result and a jump to what followed the call. The callee's slots
+ * join the caller's frame, in use throughout it.
+ */
+static bool expand(Procedure* function, size_t index, size_t j, Procedure const* callee) {
+
+	Block*  block = function->blocks[index];
+	Instr   call  = block->code[j];
+	size_t  first = function->nblocks;
+	int*    vreg  = Memory_alloc(MemoryTag_IR, (callee->nvregs ? callee->nvregs : 1) * sizeof (int));
+	int*    slot  = Memory_alloc(MemoryTag_IR, (callee->nslots ? callee->nslots : 1) * sizeof (int));
+	Block** map   = Memory_calloc(MemoryTag_IR, callee->nextblock ? callee->nextblock : 1, sizeof (Block*));
+	bool    taken = false;
+	bool    ok    = false;
+
+	if (!vreg || !slot || !map) goto done;
+
+	for (int v = 0; v < callee->nvregs; ++v) {
+		if ((vreg[v] = Procedure_vreg(function, callee->names[v])) < 0) goto done;
+	}
+
+	for (size_t s = 0; s < callee->nslots; ++s) {
+		if ((slot[s] = Procedure_slot(function, callee->slots[s].name, callee->slots[s].size)) < 0) goto done;
+	}
+
+	for (size_t i = 0; i < callee->nblocks; ++i) {
+
+		Block* body = Procedure_block(function);
+		if (!body) goto done;
+
+		body->depth = callee->blocks[i]->depth + block->depth;
+		map[callee->blocks[i]->id] = body;
+	}
+
+	Block* after = Procedure_block(function);
+	if (!after) goto done;
+
+	size_t count = block->count;
+
+	after->depth = block->depth;
+	block->count = j;
+	taken        = true;
+
+	for (size_t k = j + 1; k < count; ++k) {
+		if (!Block_append(function, after, &block->code[k])) goto done;
+	}
+
+	Instr jump = make(Op_JUMP, -1);
+	jump.targets[0] = map[callee->blocks[0]->id];
+
+	if (!Block_append(function, block, &jump)) goto done;
+
+	jump.targets[0] = after;
+
+	for (size_t i = 0; i < callee->nblocks; ++i) {
+
+		Block const* from = callee->blocks[i];
+		Block*       to   = map[from->id];
+
+		for (size_t k = 0; k < from->count; ++k) {
+
+			Instr const* instr = &from->code[k];
+
+			if (instr->op == Op_PARAM) {
+
+				Instr copy = make(Op_COPY, vreg[instr->dst]);
+				copy.a = call.args[instr->imm];
+
+				if (!Block_append(function, to, &copy)) goto done;
+
+			} else if (instr->op == Op_RETURN) {
+
+				Instr copy = make(Op_COPY, call.dst);
+				copy.a = mapped(vreg, instr->a);
+
+				if (call.dst >= 0 && copy.a.kind != OperandKind_NONE && !Block_append(function, to, &copy)) goto done;
+				if (!Block_append(function, to, &jump)) goto done;
+
+			} else if (instr->op == Op_TAILCALL) {
+
+				Instr again = *instr;
+				again.op = Op_CALL;
+
+				if (!transfer(function, to, &again, NULL, vreg, slot, map)) goto done;
+				to->code[to->count - 1].dst = call.dst;
+
+				if (!Block_append(function, to, &jump)) goto done;
+
+			} else if (!transfer(function, to, instr, NULL, vreg, slot, map)) {
+				goto done;
+			}
+		}
+	}
+
+	ok = place(function, index, first);
+
+done:
+	if (taken) Memory_free(call.args);
+
+	Memory_free(vreg);
+	Memory_free(slot);
+	Memory_free(map);
+
+	return ok && !function->failed;
+}
+
+Inliner* Inliner_new(void) {
+	return Memory_calloc(MemoryTag_IR, 1, sizeof (Inliner));
+}
+
+static bool offer(Inliner* inliner, Procedure const* function) {
+
+	int size = measure(function);
+
+	if (size > cost(function->nparams, 1)) return true;
+
+	if (inliner->count == inliner->capacity) {
+
+		size_t bigger = inliner->capacity ? inliner->capacity * 2 : 8;
+		Kept*  larger = Memory_realloc(MemoryTag_IR, inliner->kept, bigger * sizeof (Kept));
+
+		if (!larger) return false;
+
+		inliner->kept     = larger;
+		inliner->capacity = bigger;
+	}
+
+	Kept* kept = &inliner->kept[inliner->count];
+
+	*kept = (Kept) { NULL, size, falls(function), NULL, 0, 0 };
+
+	if (!(kept->function = keep(kept, function))) {
+		release(kept);
+		return false;
+	}
+
+	inliner->size += size;
+	++inliner->count;
+	return true;
+}
+
+/* drops the oldest copies until the rest fit, only once the function that may have inlined them is written out */
+static void trim(Inliner* inliner) {
+
+	size_t gone = 0;
+
+	while (inliner->size > KEPT_LIMIT && gone < inliner->count) {
+		inliner->size -= inliner->kept[gone].size;
+		release(&inliner->kept[gone++]);
+	}
+
+	if (!gone) return;
+
+	inliner->count -= gone;
+	memmove(inliner->kept, inliner->kept + gone, inliner->count * sizeof (Kept));
+}
+
+static Kept const* find(Inliner const* inliner, char const* name) {
+
+	for (size_t i = 0; i < inliner->count; ++i) {
+		if (strcmp(inliner->kept[i].function->name, name) == 0) return &inliner->kept[i];
+	}
+
+	return NULL;
+}
+
+static bool inline_calls(Inliner* inliner, Procedure* function, Str* report, char const* comment, bool* changed) {
+
+	int size  = measure(function);
+	int calls = 0;
+
+	trim(inliner);
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block* block = function->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+
+			Instr const* call = &block->code[j];
+
+			if (call->op != Op_CALL) continue;
+			++calls;
+
+			Kept const* kept = find(inliner, call->symbol);
+
+			if (!kept || strcmp(call->symbol, function->name) == 0) continue;
+			if (kept->size > cost(call->nargs, block->depth) || size + kept->size > BUDGET) continue;
+
+			/* no copy could stand for what falling off the end leaves in $a0 */
+			if (call->dst >= 0 && kept->falls) continue;
+
+			Str_printf(report, "%s inlined %s, call %d of %s\n", comment, call->symbol, calls, function->name);
+
+			if (!expand(function, i, j, kept->function)) return false;
+
+			size     += kept->size;
+			*changed  = true;
+
+			/* carry on from what followed the call, the body's own calls stay calls */
+			i += kept->function->nblocks;
+			break;
+		}
+	}
+
+	return !*changed || Procedure_edges(function);
+}
+
+static bool run_inline(Procedure* function, Analyses* analyses, PassContext* context, bool* changed) {
+
+	if (!context->inliner && !(context->inliner = Inliner_new())) return false;
+
+	return inline_calls(context->inliner, function, context->report, context->comment, changed);
+}
+
+/* each body substituted adds blocks */
+Pass const Pass_INLINE = {
+	.name        = "inline",
+	.invalidates = ANALYSES_CFG,
+	.lowered     = run_inline,
+};
+
+static bool run_offer(Procedure* function, Analyses* analyses, PassContext* context, bool* changed) {
+
+	if (!context->inliner && !(context->inliner = Inliner_new())) return false;
+
+	return offer(context->inliner, function);
+}
+
+Pass const Pass_OFFER = {
+	.name        = "offer",
+	.lowered     = run_offer,
+};
+
+void Inliner_free(Inliner* inliner) {
+
+	if (!inliner) return;
+
+	for (size_t i = 0; i < inliner->count; ++i) {
+		release(&inliner->kept[i]);
+	}
+
+	Memory_free(inliner->kept);
+	Memory_free(inliner);
+}
@@ -0,0 +1,519 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "../include/memory.h"
+#include "../include/ir.h"
+
+static char const* const OP_NAMES[Op_COUNT] = {
+	[Op_COPY]     = "copy",
+	[Op_ADD]      = "add",
+	[Op_SUB]      = "sub",
+	[Op_MUL]      = "mul",
+	[Op_DIV]      = "div",
+	[Op_LT]       = "lt",
+	[Op_LE]       = "le",
+	[Op_GT]       = "gt",
+	[Op_GE]       = "ge",
+	[Op_EQ]       = "eq",
+	[Op_NE]       = "ne",
+	[Op_ADDU]     = "addu",
+	[Op_SLL]      = "sll",
+	[Op_ADDR]     = "addr",
+	[Op_LOAD]     = "load",
+	[Op_STORE]    = "store",
+	[Op_PARAM]    = "param",
+	[Op_CALL]     = "call",
+	[Op_JUMP]     = "jump",
+	[Op_BRANCH]   = "branch",
+	[Op_RETURN]   = "return",
+	[Op_TAILCALL] = "tailcall",
+};
+
+char const* Op_to_string(Op op) {
+	return op < Op_COUNT ? OP_NAMES[op] : "???";
+}
+
+bool Op_is_terminator(Op op) {
+	return op == Op_JUMP || op == Op_BRANCH || op == Op_RETURN || op == Op_TAILCALL;
+}
+
+Operand const Operand_NONE = { OperandKind_NONE, 0 };
+
+Operand Operand_vreg(int vreg) {
+	return (Operand) { OperandKind_VREG, vreg };
+}
+
+Operand Operand_const(int value) {
+	return (Operand) { OperandKind_CONST, value };
+}
+
+Operand* Instr_use(Instr* instr, size_t i) {
+	if (i == 0) return &instr->a;
+	if (i == 1) return &instr->b;
+	return i - 2 < (size_t) instr->nargs ? &instr->args[i - 2] : NULL;
+}
+
+int Block_successors(Block const* block, Block* successors[2]) {
+
+	if (!block->count) return 0;
+
+	Instr const* last = &block->code[block->count - 1];
+
+	switch (last->op) {
+
+		case Op_JUMP:
+			successors[0] = last->targets[0];
+			return 1;
+
+		case Op_BRANCH:
+			successors[0] = last->targets[0];
+			successors[1] = last->targets[1];
+			return successors[0] == successors[1] ? 1 : 2;
+
+		default:
+			return 0;
+	}
+}
+
+/* makes room for one more element, marking the function failed when there is none */
+static bool grow(Procedure* function, void** array, size_t* capacity, size_t count, size_t size) {
+
+	if (count < *capacity) return true;
+
+	size_t bigger = *capacity ? *capacity * 2 : 8;
+	void*  larger = Memory_realloc(MemoryTag_IR, *array, bigger * size);
+
+	if (!larger) {
+		function->failed = true;
+		return false;
+	}
+
+	*array    = larger;
+	*capacity = bigger;
+	return true;
+}
+
+Procedure* Procedure_new(char const* name, int nparams) {
+
+	Procedure* function = Memory_calloc(MemoryTag_IR, 1, sizeof (Procedure));
+	if (!function) return NULL;
+
+	function->name    = name;
+	function->nparams = nparams;
+
+	return function;
+}
+
+static void Block_free(Block* block) {
+
+	for (size_t i = 0; i < block->count; ++i) {
+		Memory_free(block->code[i].args);
+	}
+
+	Memory_free(block->code);
+	Memory_free(block->preds);
+	Memory_free(block);
+}
+
+void Procedure_free(Procedure* function) {
+
+	if (!function) return;
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+		Block_free(function->blocks[i]);
+	}
+
+	Memory_free(function->blocks);
+	Memory_free(function->names);
+	Memory_free(function->slots);
+	Memory_free(function);
+}
+
+Block* Procedure_block(Procedure* function) {
+
+	if (!grow(function, (void**) &function->blocks, &function->bcapacity, function->nblocks, sizeof (Block*)))
+		return NULL;
+
+	Block* block = Memory_calloc(MemoryTag_IR, 1, sizeof (Block));
+
+	if (!block) {
+		function->failed = true;
+		return NULL;
+	}
+
+	block->id = function->nextblock++;
+	function->blocks[function->nblocks++] = block;
+
+	return block;
+}
+
+int Procedure_vreg(Procedure* function, char const* name) {
+
+	if (!grow(function, (void**) &function->names, &function->ncapacity, function->nvregs, sizeof (char const*)))
+		return -1;
+
+	function->names[function->nvregs] = name;
+	return function->nvregs++;
+}
+
+int Procedure_slot(Procedure* function, char const* name, int size) {
+
+	if (!grow(function, (void**) &function->slots, &function->scapacity, function->nslots, sizeof (Slot)))
+		return -1;
+
+	function->slots[function->nslots] = (Slot) { name, size, 0, INT_MAX };
+	return function->nslots++;
+}
+
+Instr* Block_append(Procedure* function, Block* block, Instr const* instr) {
+
+	if (!block || !grow(function, (void**) &block->code, &block->capacity, block->count, sizeof (Instr))) {
+		Memory_free(instr->args);
+		function->failed = true;
+		return NULL;
+	}
+
+	block->code[block->count] = *instr;
+	return &block->code[block->count++];
+}
+
+static bool add_pred(Procedure* function, Block* block, Block* pred) {
+
+	if (!grow(function, (void**) &block->preds, &block->pcapacity, block->npreds, sizeof (Block*)))
+		return false;
+
+	block->preds[block->npreds++] = pred;
+	return true;
+}
+
+bool Procedure_edges(Procedure* function) {
+
+	size_t  n         = function->nblocks;
+	size_t  ids       = function->nextblock;
+	bool*   reached   = Memory_calloc(MemoryTag_IR, ids ? ids : 1, sizeof (bool));
+	Block** worklist  = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (Block*));
+	size_t  nworklist = 0;
+
+	if (!reached || !worklist) {
+		function->failed = true;
+		goto done;
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		function->blocks[i]->npreds = 0;
+	}
+
+	if (n) {
+		reached[function->blocks[0]->id] = true;
+		worklist[nworklist++] = function->blocks[0];
+	}
+
+	while (nworklist) {
+
+		Block* block = worklist[--nworklist];
+		Block* successors[2];
+		int    count = Block_successors(block, successors);
+
+		for (int s = 0; s < count; ++s) {
+			if (!reached[successors[s]->id]) {
+				reached[successors[s]->id] = true;
+				worklist[nworklist++] = successors[s];
+			}
+		}
+	}
+
+	size_t kept = 0;
+
+	for (size_t i = 0; i < n; ++i) {
+		Block* block = function->blocks[i];
+		if (reached[block->id]) function->blocks[kept++] = block;
+		else                    Block_free(block);
+	}
+
+	function->nblocks = kept;
+
+	for (size_t i = 0; i < kept; ++i) {
+
+		Block* block = function->blocks[i];
+		Block* successors[2];
+		int    count = Block_successors(block, successors);
+
+		for (int s = 0; s < count; ++s) {
+			if (!add_pred(function, successors[s], block)) goto done;
+		}
+	}
+
+done:
+	Memory_free(reached);
+	Memory_free(worklist);
+
+	return !function->failed;
+}
+
+/* walks both blocks up the dominator tree until they meet, blocks later in postorder are higher up */
+static Block* intersect(int const* order, Block* a, Block* b) {
+
+	while (a != b) {
+		while (order[a->id] < order[b->id]) a = a->idom;
+		while (order[b->id] < order[a->id]) b = b->idom;
+	}
+
+	return a;
+}
+
+/*
+ * The iterative algorithm of Cooper, Harvey and Kennedy over the blocks in
+ * reverse postorder. Every block is reachable once Procedure_edges has run.
+ */
+bool Procedure_dominators(Procedure* function) {
+
+	size_t  n      = function->nblocks;
+	size_t  ids    = function->nextblock;
+	int*    order  = Memory_alloc(MemoryTag_IR, (ids ? ids : 1) * sizeof (int));
+	Block** post   = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (Block*));
+	Block** stack  = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (Block*));
+	int*    next   = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (int));
+	size_t  nstack = 0;
+	size_t  count  = 0;
+
+	if (!order || !post || !stack || !next) {
+		function->failed = true;
+		goto done;
+	}
+
+	for (size_t i = 0; i < ids; ++i) order[i] = -1;
+
+	for (size_t i = 0; i < n; ++i) function->blocks[i]->idom = NULL;
+
+	if (!n) goto done;
+
+	Block* entry = function->blocks[0];
+
+	order[entry->id] = -2;
+	stack[nstack]    = entry;
+	next[nstack++]   = 0;
+
+	while (nstack) {
+
+		Block* block = stack[nstack - 1];
+		Block* successors[2];
+		int    nsuccessors = Block_successors(block, successors);
+
+		if (next[nstack - 1] < nsuccessors) {
+
+			Block* successor = successors[next[nstack - 1]++];
+
+			if (order[successor->id] == -1) {
+				order[successor->id] = -2;
+				stack[nstack]        = successor;
+				next[nstack++]       = 0;
+			}
+
+		} else {
+			--nstack;
+			order[block->id] = (int) count;
+			post[count++]    = block;
+		}
+	}
+
+	/* the entry stands for itself while the others are worked out */
+	entry->idom = entry;
+
+	for (bool changed = true; changed;) {
+
+		changed = false;
+
+		for (size_t i = count - 1; i-- > 0;) {
+
+			Block* block = post[i];
+			Block* idom  = NULL;
+
+			for (size_t p = 0; p < block->npreds; ++p) {
+				Block* pred = block->preds[p];
+				if (pred->idom) idom = idom ? intersect(order, pred, idom) : pred;
+			}
+
+			if (idom != block->idom) {
+				block->idom = idom;
+				changed     = true;
+			}
+		}
+	}
+
+	entry->idom = NULL;
+
+done:
+	Memory_free(order);
+	Memory_free(post);
+	Memory_free(stack);
+	Memory_free(next);
+
+	return !function->failed;
+}
+
+bool Block_dominates(Block const* a, Block const* b) {
+
+	for (; b; b = b->idom) {
+		if (b == a) return true;
+	}
+
+	return false;
+}
+
+static void dump_operand(Str* out, Procedure const* function, Operand operand) {
+
+	switch (operand.kind) {
+
+		case OperandKind_VREG:
+			Str_printf(out, "v%d", operand.value);
+			if (function->names[operand.value]) Str_printf(out, ".%s", function->names[operand.value]);
+			break;
+
+		case OperandKind_CONST:
+			Str_printf(out, "%d", operand.value);
+			break;
+
+		default:
+			Str_puts(out, "_");
+			break;
+	}
+}
+
+static void dump_address(Str* out, Procedure const* function, Instr const* instr) {
+
+	char const* separator = "";
+
+	Str_puts(out, "[");
+
+	if (instr->symbol) {
+		Str_printf(out, "%s", instr->symbol);
+		separator = " + ";
+	} else if (instr->slot >= 0) {
+		Str_printf(out, "slot%d.%s", instr->slot, function->slots[instr->slot].name);
+		separator = " + ";
+	}
+
+	if (instr->a.kind != OperandKind_NONE) {
+		Str_puts(out, separator);
+		dump_operand(out, function, instr->a);
+		separator = " + ";
+	}
+
+	if (instr->imm || !*separator) Str_printf(out, "%s%d", separator, instr->imm);
+
+	Str_puts(out, "]");
+}
+
+static void dump_instr(Str* out, Procedure const* function, Instr const* instr) {
+
+	Str_puts(out, "  ");
+
+	if (instr->dst >= 0) {
+		dump_operand(out, function, Operand_vreg(instr->dst));
+		Str_puts(out, " = ");
+	}
+
+	Str_puts(out, Op_to_string(instr->op));
+
+	switch (instr->op) {
+
+		case Op_ADDR:
+		case Op_LOAD:
+			Str_puts(out, " ");
+			dump_address(out, function, instr);
+			break;
+
+		case Op_STORE:
+			Str_puts(out, " ");
+			dump_address(out, function, instr);
+			Str_puts(out, ", ");
+			dump_operand(out, function, instr->b);
+			break;
+
+		case Op_SLL:
+			Str_puts(out, " ");
+			dump_operand(out, function, instr->a);
+			Str_printf(out, ", %d", instr->imm);
+			break;
+
+		case Op_PARAM:
+			Str_printf(out, " %d", instr->imm);
+			break;
+
+		case Op_CALL:
+		case Op_TAILCALL:
+			Str_printf(out, " %s(", instr->symbol);
+			for (int i = 0; i < instr->nargs; ++i) {
+				if (i) Str_puts(out, ", ");
+				dump_operand(out, function, instr->args[i]);
+			}
+			Str_puts(out, ")");
+			break;
+
+		case Op_JUMP:
+			Str_printf(out, " b%d", instr->targets[0]->id);
+			break;
+
+		case Op_BRANCH:
+			Str_printf(out, " %s ", Op_to_string(instr->imm));
+			dump_operand(out, function, instr->a);
+			Str_puts(out, ", ");
+			dump_operand(out, function, instr->b);
+			Str_printf(out, ", b%d, b%d", instr->targets[0]->id, instr->targets[1]->id);
+			break;
+
+		case Op_RETURN:
+			if (instr->a.kind != OperandKind_NONE) {
+				Str_puts(out, " ");
+				dump_operand(out, function, instr->a);
+			}
+			break;
+
+		default:
+			Str_puts(out, " ");
+			dump_operand(out, function, instr->a);
+			if (instr->b.kind != OperandKind_NONE) {
+				Str_puts(out, ", ");
+				dump_operand(out, function, instr->b);
+			}
+			break;
+	}
+
+	Str_puts(out, "\n");
+}
+
+void Procedure_dump(Str* out, Procedure const* function) {
+
+	Str_printf(out, "function %s(%d)\n", function->name, function->nparams);
+
+	for (size_t i = 0; i < function->nslots; ++i) {
+		Slot const* slot = &function->slots[i];
+
+		Str_printf(out, "  slot%zu.%s %d", i, slot->name, slot->size);
+		if (slot->last != INT_MAX) Str_printf(out, " scopes %d-%d", slot->first, slot->last);
+		Str_puts(out, "\n");
+	}
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block const* block = function->blocks[i];
+
+		Str_printf(out, "b%d:", block->id);
+
+		if (block->npreds) {
+			Str_puts(out, " ; preds");
+			for (size_t p = 0; p < block->npreds; ++p) {
+				Str_printf(out, " b%d", block->preds[p]->id);
+			}
+		}
+
+		Str_puts(out, "\n");
+
+		for (size_t j = 0; j < block->count; ++j) {
+			dump_instr(out, function, &block->code[j]);
+		}
+	}
+
+	Str_puts(out, "\n");
+}
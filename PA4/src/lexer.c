@@ -6,10 +6,41 @@
 
 #include "../include/str.h"
 #include "../include/lexer.h"
+#include "../include/memory.h"
+
+Source Source_file(FILE* file) {
+    Source source = { file, NULL, 0, 0 };
+    return source;
+}
+
+Source Source_buffer(char const* buffer, size_t length) {
+    Source source = { NULL, buffer, length, 0 };
+    return source;
+}
+
+int Source_getc(Source* source) {
+
+    if (source->file) return fgetc(source->file);
+
+    return source->position < source->length
+        ? (unsigned char) source->buffer[source->position++]
+        : EOF;
+}
+
+void Source_ungetc(Source* source, int glyph) {
+
+    if (glyph == EOF) return;
+
+    if (source->file) {
+        ungetc(glyph, source->file);
+    } else {
+        --source->position;
+    }
+}
 
 Token* Token_new(void) {
 
-    Token* t = malloc(sizeof(Token));
+    Token* t = Memory_alloc(MemoryTag_TOKENLIST, sizeof(Token));
     if (!t) goto fail_1;
 
     t->lexeme = Str_new(32);
@@ -21,14 +52,14 @@ Token* Token_new(void) {
     return t;
 
 fail_2:
-    free(t);
+    Memory_free(t);
 fail_1:
     return NULL;
 }
 
 void Token_free(Token* token) {
     Str_free(token->lexeme);
-    free(token);
+    Memory_free(token);
 }
 
 char const KEYWORD_IF[]     = "if";
@@ -95,12 +126,12 @@ char const* TokenType_to_string(TokenType type) {
  * 
  * THE TOKEN STATE SHOULD BE TREATED AS READONLY BY CALLER
  */
-bool lex(FILE* source, struct Token* token) {
+bool lex(Source* source, struct Token* token) {
     
     int glyph;
 
 start:
-    if ((glyph = fgetc(source)) == EOF)
+    if ((glyph = Source_getc(source)) == EOF)
         return false;
 
     if (is_letter(glyph)) {
@@ -108,7 +139,7 @@ start:
         Str_clear(token->lexeme);
         while (glyph != EOF && (is_letter(glyph) || is_digit(glyph))) {
             Str_pushchar(token->lexeme, glyph);
-            glyph = fgetc(source);
+            glyph = Source_getc(source);
         }
         Str_pushchar(token->lexeme, '\0');
 
@@ -116,7 +147,7 @@ start:
             ? TokenType_KEY
             : TokenType_ID;
 
-        ungetc(glyph, source);
+        Source_ungetc(source, glyph);
 
         return true;
     }
@@ -126,11 +157,11 @@ start:
         Str_clear(token->lexeme);
         while (glyph != EOF && is_digit(glyph)) {
             Str_pushchar(token->lexeme, glyph);
-            glyph = fgetc(source);
+            glyph = Source_getc(source);
         }
         Str_pushchar(token->lexeme, '\0');
 
-        ungetc(glyph, source);
+        Source_ungetc(source, glyph);
 
         token->symbol = TokenType_NUM;
         return true;
@@ -167,11 +198,11 @@ start:
             return true;
 
         case '/':
-            if ((glyph = fgetc(source)) == '*') {
+            if ((glyph = Source_getc(source)) == '*') {
                 /* this begins a commment, remeber the line in case of error */
                 int error_line = token->lineno;
             comment:
-                if ((glyph = fgetc(source)) == EOF) {
+                if ((glyph = Source_getc(source)) == EOF) {
                     /* the comment runs to EOF, this is an error */
                     token->symbol = TokenType_ERR;
                     Str_copy_nulterm(token->lexeme, "/*");
@@ -182,12 +213,12 @@ start:
                 switch (glyph) {
                     case '*':
                         /* check to see if this is the end */
-                        if ((glyph = fgetc(source)) == '/') {
+                        if ((glyph = Source_getc(source)) == '/') {
                             /* return to normal lexing */
                             goto start;
                         }
                         /* put it back and keep consuming comment */
-                        ungetc(glyph, source);
+                        Source_ungetc(source, glyph);
                         goto comment;
 
                     /* we still need to count lines */
@@ -202,44 +233,44 @@ start:
             } else {
                 token->symbol = TokenType_SYM;
                 Str_copy_nulterm(token->lexeme, "/");
-                ungetc(glyph, source);
+                Source_ungetc(source, glyph);
             }
             return true;
         
         /* these can all have an optional trailing '=' */
         case '<':
             token->symbol = TokenType_SYM;
-            if ((glyph = fgetc(source)) == '=') {
+            if ((glyph = Source_getc(source)) == '=') {
                 Str_copy_nulterm(token->lexeme, "<=");
             } else {
                 Str_copy_nulterm(token->lexeme, "<");
-                ungetc(glyph, source);
+                Source_ungetc(source, glyph);
             }
             return true;
 
         case '>':
             token->symbol = TokenType_SYM;
-            if ((glyph = fgetc(source)) == '=') {
+            if ((glyph = Source_getc(source)) == '=') {
                 Str_copy_nulterm(token->lexeme, ">=");
             } else {
                 Str_copy_nulterm(token->lexeme, ">");
-                ungetc(glyph, source);
+                Source_ungetc(source, glyph);
             }
             return true;
 
         case '=':
             token->symbol = TokenType_SYM;
-            if ((glyph = fgetc(source)) == '=') {
+            if ((glyph = Source_getc(source)) == '=') {
                 Str_copy_nulterm(token->lexeme, "==");
             } else {
                 Str_copy_nulterm(token->lexeme, "=");
-                ungetc(glyph, source);
+                Source_ungetc(source, glyph);
             }
             return true;
 
         /* '!' only occurs in the digraph "!=" */
         case '!':
-            if (fgetc(source) == '=') {
+            if (Source_getc(source) == '=') {
                 token->symbol = TokenType_SYM;
                 Str_copy_nulterm(token->lexeme, "!=");
             } else {
@@ -272,47 +303,81 @@ void lexfree(TokenList* tokens) {
     for (TokenList* t = tokens,* tmp; t; t = tmp) {
         tmp = t->next;
         Str_free(t->value.lexeme);
-        free(t);
+        Memory_free(t);
     }
 }
 
-TokenList* lexlist(FILE* source) {
+/* a top-level declaration ends at a semicolon outside of any
+   braces, or at the brace closing a function body */
+bool lexboundary(Token const* token, int* depth) {
 
-    /* THE TOKEN STATE SHOULD BE TREATED AS READONLY AFTER LEX CALL */
-    Token* token = Token_new();
-    if (!token) goto fail_1;
+    if (token->symbol != TokenType_SYM) return false;
+
+    switch (token->lexeme->buffer[0]) {
+        case '{':
+            ++*depth;
+            return false;
+        case '}':
+            return --*depth <= 0;
+        case ';':
+            return *depth == 0;
+        default:
+            return false;
+    }
+}
+
+static TokenList* lextokens(Source* source, Token* token, bool declaration) {
 
     TokenList* start = NULL;
     TokenList* node  = NULL;
+    int        depth = 0;
 
     while (lex(source, token)) {
 
         if (start) {
-            node->next = malloc(sizeof (TokenList));
-            if (!node->next) goto fail_3;
+            node->next = Memory_alloc(MemoryTag_TOKENLIST, sizeof (TokenList));
+            if (!node->next) goto fail;
             node = node->next;
             node->next = NULL;
         } else {
-            start = malloc(sizeof (TokenList));
-            if (!start) goto fail_2;
+            start = Memory_alloc(MemoryTag_TOKENLIST, sizeof (TokenList));
+            if (!start) goto fail;
             start->next = NULL;
             node = start;
         }
 
         node->value        = *token;
         node->value.lexeme = Str_dup(token->lexeme);
+
+        if (declaration && lexboundary(token, &depth)) break;
     }
 
     return start;
 
-fail_3:
-    for (TokenList* t = start,* tmp; t; t = tmp) {
-        tmp = t->next;
-        Str_free(t->value.lexeme);
-        free(t);
+fail:
+    lexfree(start);
+    return NULL;
+}
+
+TokenList* lexlist(Source* source) {
+
+    /* THE TOKEN STATE SHOULD BE TREATED AS READONLY AFTER LEX CALL */
+    Token* token = Token_new();
+    if (!token) return NULL;
+
+    TokenList* tokens = lextokens(source, token, false);
+
+    Token_free(token);
+    return tokens;
+}
+
+TokenList* lexdeclaration(Source* source, Token* token) {
+    return lextokens(source, token, true);
+}
+
+TokenList* lexinvalid(TokenList* tokens) {
+    for (TokenList* t = tokens; t; t = t->next) {
+        if (t->value.symbol == TokenType_ERR) return t;
     }
-fail_2:
-    free(token);
-fail_1:
     return NULL;
-}
\ No newline at end of file
+}
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <limits.h>
+
+#include "../include/memory.h"
+#include "../include/liveness.h"
+
+#define WORD_BITS (sizeof (unsigned long) * CHAR_BIT)
+
+struct Liveness {
+
+	/* words per set */
+	size_t         words;
+
+	/* four sets per block id, what it uses before defining, defines, and is live in and out */
+	unsigned long* sets;
+
+};
+
+static unsigned long* set(Liveness const* liveness, Block const* block, int which) {
+	return liveness->sets + ((size_t) block->id * 4 + which) * liveness->words;
+}
+
+enum { USE, DEF, IN, OUT };
+
+static bool has(unsigned long const* set, int vreg) {
+	return set[vreg / WORD_BITS] >> (vreg % WORD_BITS) & 1;
+}
+
+static void put(unsigned long* set, int vreg) {
+	set[vreg / WORD_BITS] |= 1ul << (vreg % WORD_BITS);
+}
+
+Liveness* Liveness_compute(Procedure const* function) {
+
+	Liveness* liveness = Memory_alloc(MemoryTag_IR, sizeof (Liveness));
+	if (!liveness) return NULL;
+
+	liveness->words = (function->nvregs + WORD_BITS - 1) / WORD_BITS;
+	liveness->sets  = Memory_calloc(MemoryTag_IR, (size_t) function->nextblock * 4 * liveness->words + 1, sizeof (unsigned long));
+
+	if (!liveness->sets) {
+		Memory_free(liveness);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block*         block = function->blocks[i];
+		unsigned long* use   = set(liveness, block, USE);
+		unsigned long* def   = set(liveness, block, DEF);
+
+		for (size_t j = 0; j < block->count; ++j) {
+
+			Instr*   instr = &block->code[j];
+			Operand* operand;
+
+			for (size_t k = 0; (operand = Instr_use(instr, k)); ++k) {
+				if (operand->kind == OperandKind_VREG && !has(def, operand->value)) put(use, operand->value);
+			}
+
+			if (instr->dst >= 0) put(def, instr->dst);
+		}
+	}
+
+	/* backwards over the layout, which mostly visits successors first */
+	for (bool changed = true; changed;) {
+
+		changed = false;
+
+		for (size_t i = function->nblocks; i-- > 0;) {
+
+			Block*         block = function->blocks[i];
+			unsigned long* in    = set(liveness, block, IN);
+			unsigned long* out   = set(liveness, block, OUT);
+			unsigned long* use   = set(liveness, block, USE);
+			unsigned long* def   = set(liveness, block, DEF);
+			Block*         successors[2];
+			int            count = Block_successors(block, successors);
+
+			for (size_t w = 0; w < liveness->words; ++w) {
+
+				unsigned long live = 0;
+
+				for (int s = 0; s < count; ++s) {
+					live |= set(liveness, successors[s], IN)[w];
+				}
+
+				unsigned long entry = use[w] | (live & ~def[w]);
+
+				if (live != out[w] || entry != in[w]) changed = true;
+
+				out[w] = live;
+				in[w]  = entry;
+			}
+		}
+	}
+
+	return liveness;
+}
+
+bool Liveness_in(Liveness const* liveness, Block const* block, int vreg) {
+	return has(set(liveness, block, IN), vreg);
+}
+
+bool Liveness_out(Liveness const* liveness, Block const* block, int vreg) {
+	return has(set(liveness, block, OUT), vreg);
+}
+
+void Liveness_free(Liveness* liveness) {
+
+	if (!liveness) return;
+
+	Memory_free(liveness->sets);
+	Memory_free(liveness);
+}
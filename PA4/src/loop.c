@@ -0,0 +1,155 @@
+#include <stdlib.h>
+
+#include "../include/memory.h"
+#include "../include/loop.h"
+
+static int by_size(void const* a, void const* b) {
+
+	Loop const* x = a;
+	Loop const* y = b;
+
+	if (x->count != y->count) return x->count < y->count ? -1 : 1;
+	return (x->header->id > y->header->id) - (x->header->id < y->header->id);
+}
+
+/* the single predecessor of the header from outside the loop, when it goes nowhere else */
+static Block* preheader(Block const* header, bool const* contains) {
+
+	Block* outside = NULL;
+
+	for (size_t p = 0; p < header->npreds; ++p) {
+
+		Block* pred = header->preds[p];
+		if (contains[pred->id]) continue;
+
+		if (outside) return NULL;
+		outside = pred;
+	}
+
+	Block* successors[2];
+
+	return outside && Block_successors(outside, successors) == 1 ? outside : NULL;
+}
+
+static bool add(Loops* loops, size_t* capacity, Loop const* loop) {
+
+	if (loops->count == *capacity) {
+
+		size_t bigger = *capacity ? *capacity * 2 : 4;
+		Loop*  larger = Memory_realloc(MemoryTag_IR, loops->loops, bigger * sizeof (Loop));
+
+		if (!larger) return false;
+
+		loops->loops = larger;
+		*capacity    = bigger;
+	}
+
+	loops->loops[loops->count++] = *loop;
+	return true;
+}
+
+/* a block is a header when it dominates one of its predecessors, the loop is whatever reaches that back edge without passing the header */
+bool Loops_find(Procedure* function, Loops* loops) {
+
+	size_t  ids      = function->nextblock;
+	size_t  n        = function->nblocks;
+	size_t  capacity = 0;
+	Block** worklist = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (Block*));
+	Loop    loop     = { NULL, NULL, NULL, 0, NULL };
+
+	loops->loops = NULL;
+	loops->count = 0;
+
+	if (!worklist) goto fail;
+
+	for (size_t i = 0; i < n; ++i) {
+
+		Block* header    = function->blocks[i];
+		size_t nworklist = 0;
+
+		loop = (Loop) { header, NULL, NULL, 0, Memory_calloc(MemoryTag_IR, ids ? ids : 1, sizeof (bool)) };
+		if (!loop.contains) goto fail;
+
+		loop.contains[header->id] = true;
+
+		for (size_t p = 0; p < header->npreds; ++p) {
+
+			Block* latch = header->preds[p];
+
+			if (Block_dominates(header, latch) && !loop.contains[latch->id]) {
+				loop.contains[latch->id] = true;
+				worklist[nworklist++]    = latch;
+			}
+		}
+
+		bool back = nworklist > 0;
+
+		for (size_t p = 0; p < header->npreds; ++p) {
+			if (header->preds[p] == header) back = true;
+		}
+
+		while (nworklist) {
+
+			Block* block = worklist[--nworklist];
+
+			for (size_t p = 0; p < block->npreds; ++p) {
+
+				Block* pred = block->preds[p];
+
+				if (!loop.contains[pred->id]) {
+					loop.contains[pred->id] = true;
+					worklist[nworklist++]   = pred;
+				}
+			}
+		}
+
+		if (back) loop.preheader = preheader(header, loop.contains);
+
+		if (!loop.preheader) {
+			Memory_free(loop.contains);
+			continue;
+		}
+
+		for (size_t j = 0; j < n; ++j) {
+			if (loop.contains[function->blocks[j]->id]) ++loop.count;
+		}
+
+		loop.blocks = Memory_alloc(MemoryTag_IR, loop.count * sizeof (Block*));
+		if (!loop.blocks) goto fail;
+
+		loop.count = 0;
+
+		for (size_t j = 0; j < n; ++j) {
+			if (loop.contains[function->blocks[j]->id]) loop.blocks[loop.count++] = function->blocks[j];
+		}
+
+		if (!add(loops, &capacity, &loop)) goto fail;
+	}
+
+	if (loops->count) qsort(loops->loops, loops->count, sizeof (Loop), by_size);
+
+	Memory_free(worklist);
+	return true;
+
+fail:
+	Memory_free(loop.blocks);
+	Memory_free(loop.contains);
+	Memory_free(worklist);
+	Loops_release(loops);
+
+	function->failed = true;
+	return false;
+}
+
+void Loops_release(Loops* loops) {
+
+	for (size_t i = 0; i < loops->count; ++i) {
+		Memory_free(loops->loops[i].blocks);
+		Memory_free(loops->loops[i].contains);
+	}
+
+	Memory_free(loops->loops);
+
+	loops->loops = NULL;
+	loops->count = 0;
+}
@@ -0,0 +1,665 @@
+#include <stdlib.h>
+#include <limits.h>
+
+#include "../include/memory.h"
+#include "../include/type.h"
+#include "../include/lower.h"
+
+/* what a frame offset stands for in the scopes being lowered */
+typedef struct Binding {
+
+	int offset;
+
+	/* the virtual register of a scalar or an array parameter, else -1 */
+	int vreg;
+
+	/* the frame slot of a local array, else -1 */
+	int slot;
+
+} Binding;
+
+typedef struct Lowering {
+
+	Procedure* function;
+
+	/* where instructions go next */
+	Block*     block;
+
+	/* while loops around the statement being lowered */
+	int        depth;
+
+	/* innermost last, scopes pop theirs on the way out */
+	Binding*   bindings;
+	size_t     nbindings;
+	size_t     capacity;
+
+	/* the number of the innermost scope, and how many have opened */
+	int        scope;
+	int        scopes;
+
+} Lowering;
+
+static Operand lower_expression(Lowering* l, Pair* ast);
+
+static void lower_statement(Lowering* l, Pair* ast);
+
+static Instr make(Op op, int dst) {
+	return (Instr) { op, dst, Operand_NONE, Operand_NONE, 0, NULL, -1, NULL, 0, { NULL, NULL } };
+}
+
+static Instr* emit(Lowering* l, Instr instr) {
+	return Block_append(l->function, l->block, &instr);
+}
+
+static int temporary(Lowering* l) {
+	return Procedure_vreg(l->function, NULL);
+}
+
+static Block* new_block(Lowering* l) {
+
+	Block* block = Procedure_block(l->function);
+	if (block) block->depth = l->depth;
+
+	return block;
+}
+
+static void jump(Lowering* l, Block* target) {
+	Instr instr = make(Op_JUMP, -1);
+	instr.targets[0] = target;
+	emit(l, instr);
+}
+
+static void bind(Lowering* l, int offset, int vreg, int slot) {
+
+	if (l->nbindings == l->capacity) {
+
+		size_t   capacity = l->capacity ? l->capacity * 2 : 16;
+		Binding* bindings = Memory_realloc(MemoryTag_IR, l->bindings, capacity * sizeof *bindings);
+
+		if (!bindings) {
+			l->function->failed = true;
+			return;
+		}
+
+		l->bindings = bindings;
+		l->capacity = capacity;
+	}
+
+	l->bindings[l->nbindings++] = (Binding) { offset, vreg, slot };
+}
+
+/* variables of sibling scopes may share an offset, the latest declaration is the one in scope */
+static Binding lookup(Lowering* l, int offset) {
+
+	for (size_t i = l->nbindings; i-- > 0;) {
+		if (l->bindings[i].offset == offset) return l->bindings[i];
+	}
+
+	/* only once a failed bind has lost the declaration */
+	l->function->failed = true;
+	return (Binding) { offset, -1, -1 };
+}
+
+/* true when evaluating the expression may store to a variable */
+static bool assigns(Pair* ast) {
+
+	switch (ast->val) {
+
+		case ASType_NUM:
+			return false;
+
+		case ASType_VAR:
+			return ast->dyn && assigns(ast->cdr->cdr->car);
+
+		case ASType_SET:
+			return true;
+
+		case ASType_CALL:
+			for (Pair* node = ast->cdr->cdr->car->cdr; node; node = node->cdr) {
+				if (assigns(node->car)) return true;
+			}
+			return false;
+
+		default:
+			return assigns(ast->cdr->car) || assigns(ast->cdr->cdr->car);
+	}
+}
+
+/* true when evaluating the expression stores to a variable or makes a call, whose order is observable */
+static bool effects(Pair* ast) {
+
+	switch (ast->val) {
+
+		case ASType_NUM:
+			return false;
+
+		case ASType_VAR:
+			return ast->dyn && effects(ast->cdr->cdr->car);
+
+		case ASType_SET: case ASType_CALL:
+			return true;
+
+		default:
+			return effects(ast->cdr->car) || effects(ast->cdr->cdr->car);
+	}
+}
+
+/* a variable's register may be assigned again before an operand read from it is used, a copy keeps its value */
+static Operand pin(Lowering* l, Operand operand) {
+
+	if (operand.kind != OperandKind_VREG || !l->function->names[operand.value]) return operand;
+
+	int   dst   = temporary(l);
+	Instr instr = make(Op_COPY, dst);
+
+	instr.a = operand;
+	emit(l, instr);
+
+	return Operand_vreg(dst);
+}
+
+static bool in_memory(Pair* var) {
+	return var->dyn || var->num == PrimativeType_ARRAY || var->cdr->car->num == 0;
+}
+
+/* the Sethi-Ullman number of the expression, how many registers it takes to evaluate with none to spare */
+static int need(Pair* ast) {
+
+	switch (ast->val) {
+
+		case ASType_NUM:
+			return 0;
+
+		case ASType_VAR: {
+
+			if (!in_memory(ast)) return 0;
+
+			int subscript = ast->dyn ? need(ast->cdr->cdr->car) : 0;
+			return subscript > 1 ? subscript : 1;
+		}
+
+		case ASType_SET: case ASType_CALL:
+			return 1;
+
+		default: {
+
+			int left  = need(ast->cdr->car);
+			int right = need(ast->cdr->cdr->car);
+
+			return left == right ? left + 1 : left > right ? left : right;
+		}
+	}
+}
+
+/* where a variable in memory lives, evaluating its subscript, an unsubscripted array means its first element */
+static void locate(Lowering* l, Pair* var, Instr* access) {
+
+	Pair*   id    = var->cdr->car;
+	Operand index = Operand_NONE;
+
+	if (var->dyn) {
+
+		Operand subscript = lower_expression(l, var->cdr->cdr->car);
+
+		if (subscript.kind == OperandKind_CONST) {
+			access->imm = (int) ((unsigned) subscript.value << 2);
+		} else {
+			Instr scale = make(Op_SLL, temporary(l));
+			scale.a   = subscript;
+			scale.imm = 2;
+			emit(l, scale);
+			index = Operand_vreg(scale.dst);
+		}
+	}
+
+	if (id->num == 0) {
+		access->symbol = id->dyn;
+		access->a      = index;
+		return;
+	}
+
+	Binding binding = lookup(l, id->num);
+
+	if (binding.slot >= 0) {
+		access->slot = binding.slot;
+		access->a    = index;
+		return;
+	}
+
+	/* the parameter holds the address of the array */
+	if (index.kind == OperandKind_NONE) {
+		access->a = Operand_vreg(binding.vreg);
+		return;
+	}
+
+	Instr add = make(Op_ADDU, temporary(l));
+	add.a = Operand_vreg(binding.vreg);
+	add.b = index;
+	emit(l, add);
+
+	access->a = Operand_vreg(add.dst);
+}
+
+static Operand lower_variable(Lowering* l, Pair* var) {
+
+	if (!in_memory(var)) return Operand_vreg(lookup(l, var->cdr->car->num).vreg);
+
+	Instr load = make(Op_LOAD, -1);
+
+	locate(l, var, &load);
+	load.dst = temporary(l);
+	emit(l, load);
+
+	return Operand_vreg(load.dst);
+}
+
+static Operand lower_assignment(Lowering* l, Pair* ast) {
+
+	Pair* var   = ast->cdr->car;
+	Pair* value = ast->cdr->cdr->car;
+
+	if (!in_memory(var)) {
+
+		int     vreg   = lookup(l, var->cdr->car->num).vreg;
+		Operand result = lower_expression(l, value);
+		Block*  block  = l->block;
+
+		/* a temporary computed just now can be computed into the variable instead */
+		if (result.kind == OperandKind_VREG && !l->function->names[result.value]
+			&& block && block->count && block->code[block->count - 1].dst == result.value) {
+			block->code[block->count - 1].dst = vreg;
+		} else {
+			Instr copy = make(Op_COPY, vreg);
+			copy.a = result;
+			emit(l, copy);
+		}
+
+		return Operand_vreg(vreg);
+	}
+
+	Instr store = make(Op_STORE, -1);
+
+	/* the element is located before the value is worked out */
+	locate(l, var, &store);
+	if (assigns(value)) store.a = pin(l, store.a);
+
+	store.b = lower_expression(l, value);
+	emit(l, store);
+
+	return store.b;
+}
+
+/* arrays are passed by address, everything else by value */
+static Operand lower_argument(Lowering* l, Pair* ast) {
+
+	if (ast->val != ASType_VAR || ast->dyn) return lower_expression(l, ast);
+
+	Pair* id = ast->cdr->car;
+
+	switch ((PrimativeType) ast->num) {
+
+		case PrimativeType_ARRAY: {
+
+			Instr address = make(Op_ADDR, temporary(l));
+
+			if (id->num == 0) address.symbol = id->dyn;
+			else              address.slot   = lookup(l, id->num).slot;
+
+			emit(l, address);
+			return Operand_vreg(address.dst);
+		}
+
+		default:
+			return lower_expression(l, ast);
+	}
+}
+
+/* the last argument is evaluated first, as the stack calling convention pushes them */
+static void lower_arguments(Lowering* l, Pair* node, Operand* args, int i, int nargs) {
+
+	if (!node) return;
+
+	lower_arguments(l, node->cdr, args, i + 1, nargs);
+
+	if (assigns(node->car)) {
+		for (int j = i + 1; j < nargs; ++j) args[j] = pin(l, args[j]);
+	}
+
+	args[i] = lower_argument(l, node->car);
+}
+
+static Operand lower_call(Lowering* l, Pair* ast) {
+
+	Pair* list  = ast->cdr->cdr->car->cdr;
+	int   nargs = 0;
+
+	for (Pair* node = list; node; node = node->cdr) ++nargs;
+
+	Instr call = make(Op_CALL, -1);
+
+	call.symbol = ast->cdr->car->dyn;
+	call.nargs  = nargs;
+
+	if (nargs) {
+
+		call.args = Memory_alloc(MemoryTag_IR, nargs * sizeof (Operand));
+
+		if (!call.args) {
+			l->function->failed = true;
+			return Operand_const(0);
+		}
+
+		lower_arguments(l, list, call.args, 0, nargs);
+	}
+
+	call.dst = temporary(l);
+	emit(l, call);
+
+	return Operand_vreg(call.dst);
+}
+
+static Op binary(ASType type) {
+	switch (type) {
+		case ASType_LE:  return Op_LE;
+		case ASType_LT:  return Op_LT;
+		case ASType_GT:  return Op_GT;
+		case ASType_GE:  return Op_GE;
+		case ASType_EQ:  return Op_EQ;
+		case ASType_NE:  return Op_NE;
+		case ASType_ADD: return Op_ADD;
+		case ASType_SUB: return Op_SUB;
+		case ASType_MUL: return Op_MUL;
+		default:         return Op_DIV;
+	}
+}
+
+/*
+ * Both sides of a binary operator, the one needing more registers first so
+ * that fewer are live at once, as long as neither has an effect whose order
+ * could be told apart.
+ */
+static void lower_operands(Lowering* l, Pair* ast, Operand* a, Operand* b) {
+
+	Pair* left  = ast->cdr->car;
+	Pair* right = ast->cdr->cdr->car;
+
+	if (need(right) > need(left) && !effects(left) && !effects(right)) {
+		*b = lower_expression(l, right);
+		*a = lower_expression(l, left);
+		return;
+	}
+
+	*a = lower_expression(l, left);
+	if (assigns(right)) *a = pin(l, *a);
+
+	*b = lower_expression(l, right);
+}
+
+static Operand lower_expression(Lowering* l, Pair* ast) {
+
+	switch (ast->val) {
+
+		case ASType_NUM:
+			return Operand_const(ast->num);
+
+		case ASType_VAR:
+			return lower_variable(l, ast);
+
+		case ASType_SET:
+			return lower_assignment(l, ast);
+
+		case ASType_CALL:
+			return lower_call(l, ast);
+
+		default: {
+
+			Instr instr = make(binary(ast->val), -1);
+
+			lower_operands(l, ast, &instr.a, &instr.b);
+			instr.dst = temporary(l);
+			emit(l, instr);
+
+			return Operand_vreg(instr.dst);
+		}
+	}
+}
+
+/* a comparison decides the branch itself, anything else branches on not being zero */
+static void lower_condition(Lowering* l, Pair* ast, Instr* branch) {
+
+	switch (ast->val) {
+
+		case ASType_LT: case ASType_LE: case ASType_GT:
+		case ASType_GE: case ASType_EQ: case ASType_NE: {
+
+			branch->imm = binary(ast->val);
+			lower_operands(l, ast, &branch->a, &branch->b);
+			break;
+		}
+
+		default:
+			branch->imm = Op_NE;
+			branch->a   = lower_expression(l, ast);
+			branch->b   = Operand_const(0);
+			break;
+	}
+}
+
+/* local scalars get a register, local arrays a slot, at the offset semantic analysis gave them */
+static void declare(Lowering* l, Pair* declaration) {
+
+	Pair* id   = declaration->cdr->cdr->car;
+	Pair* size = declaration->cdr->cdr->cdr;
+
+	if (!size) {
+		bind(l, id->num, Procedure_vreg(l->function, id->dyn), -1);
+		return;
+	}
+
+	int slot = Procedure_slot(l->function, id->dyn, size->car->num << 2);
+
+	if (slot >= 0) l->function->slots[slot].first = l->scope;
+	bind(l, id->num, -1, slot);
+}
+
+static void lower_compound(Lowering* l, Pair* ast) {
+
+	size_t scope = l->nbindings;
+	size_t slots = l->function->nslots;
+	int    outer = l->scope;
+
+	l->scope = l->scopes++;
+
+	for (Pair* node = ast->cdr; node; node = node->cdr) {
+		if (node->car->val == ASType_VAR_DECLARATION) declare(l, node->car);
+		else                                          lower_statement(l, node->car);
+	}
+
+	/* the arrays declared here are done with once the scopes opened inside have closed */
+	for (size_t i = slots; i < l->function->nslots; ++i) {
+		Slot* slot = &l->function->slots[i];
+		if (slot->first == l->scope && slot->last == INT_MAX) slot->last = l->scopes - 1;
+	}
+
+	l->nbindings = scope;
+	l->scope     = outer;
+}
+
+static void lower_selection(Lowering* l, Pair* ast) {
+
+	Pair*  node  = ast->cdr;
+	Instr  test  = make(Op_BRANCH, -1);
+	Block* head;
+	Block* then;
+	Block* other = NULL;
+	Block* join;
+
+	lower_condition(l, node->car, &test);
+	head = l->block;
+
+	/* the branch is added once every block it goes to exists */
+	l->block = test.targets[0] = new_block(l);
+	lower_statement(l, node->cdr->car);
+	then = l->block;
+
+	if (node->cdr->cdr) {
+		l->block = test.targets[1] = new_block(l);
+		lower_statement(l, node->cdr->cdr->car);
+		other = l->block;
+	}
+
+	join = new_block(l);
+	if (!join) return;
+
+	if (!test.targets[1]) test.targets[1] = join;
+
+	l->block = then;
+	jump(l, join);
+
+	if (other) {
+		l->block = other;
+		jump(l, join);
+	}
+
+	l->block = head;
+	emit(l, test);
+
+	l->block = join;
+}
+
+/*
+ * Rotated so each iteration ends in one branch back while the condition holds,
+ * with a copy of the test in front guarding the first. The preheader between
+ * the guard and the body is where code that leaves the loop goes.
+ */
+static void lower_iteration(Lowering* l, Pair* ast) {
+
+	Pair*  node  = ast->cdr;
+	Instr  guard = make(Op_BRANCH, -1);
+	Instr  test  = make(Op_BRANCH, -1);
+	Block* head;
+	Block* preheader;
+	Block* body;
+	Block* latch;
+	Block* exit;
+
+	lower_condition(l, node->car, &guard);
+	head = l->block;
+
+	l->block = preheader = new_block(l);
+
+	++l->depth;
+
+	body = new_block(l);
+	jump(l, body);
+
+	l->block = body;
+	lower_statement(l, node->cdr->car);
+	lower_condition(l, node->car, &test);
+	latch = l->block;
+
+	--l->depth;
+
+	exit = new_block(l);
+
+	guard.targets[0] = preheader;
+	guard.targets[1] = exit;
+	test.targets[0]  = body;
+	test.targets[1]  = exit;
+
+	l->block = latch;
+	emit(l, test);
+
+	l->block = head;
+	emit(l, guard);
+
+	l->block = exit;
+}
+
+static void lower_statement(Lowering* l, Pair* ast) {
+
+	switch (ast->val) {
+
+		case ASType_EMPTY_STMT:
+			break;
+
+		case ASType_RETURN_STMT: {
+
+			Instr instr = make(Op_RETURN, -1);
+			if (ast->cdr) instr.a = lower_expression(l, ast->cdr->car);
+			emit(l, instr);
+
+			/* whatever follows is unreachable, Procedure_edges drops it */
+			l->block = new_block(l);
+			break;
+		}
+
+		case ASType_SELECTION_STMT:
+			lower_selection(l, ast);
+			break;
+
+		case ASType_ITERATION_STMT:
+			lower_iteration(l, ast);
+			break;
+
+		case ASType_COMPOUND_STMT:
+			lower_compound(l, ast);
+			break;
+
+		case ASType_CALL: {
+
+			lower_expression(l, ast);
+
+			/* nobody looks at the value of a call made for its effect */
+			if (l->block && l->block->count) l->block->code[l->block->count - 1].dst = -1;
+			break;
+		}
+
+		default:
+			lower_expression(l, ast);
+			break;
+	}
+}
+
+Procedure* lower_function(Pair* declaration) {
+
+	/* type, identifier, parameters, body */
+	Pair* node   = declaration->cdr->cdr;
+	Pair* params = node->cdr->car->cdr;
+	Pair* body   = node->cdr->cdr->car;
+	int   count  = 0;
+
+	for (Pair* param = params; param; param = param->cdr) ++count;
+
+	Lowering l = { Procedure_new(node->car->dyn, count), NULL, 0, NULL, 0, 0, 0, 0 };
+	if (!l.function) return NULL;
+
+	l.block = new_block(&l);
+
+	/* parameters are registers like any other local, whatever their type */
+	count = 0;
+
+	for (Pair* param = params; param; param = param->cdr) {
+
+		Pair* id    = param->car->cdr->cdr->car;
+		Instr instr = make(Op_PARAM, Procedure_vreg(l.function, id->dyn));
+
+		instr.imm = count++;
+		emit(&l, instr);
+		bind(&l, id->num, instr.dst, -1);
+	}
+
+	lower_statement(&l, body);
+
+	/* falling off the end returns whatever is in $a0, as it always has */
+	emit(&l, make(Op_RETURN, -1));
+
+	Memory_free(l.bindings);
+
+	if (l.function->failed || !Procedure_edges(l.function)) {
+		Procedure_free(l.function);
+		return NULL;
+	}
+
+	return l.function;
+}
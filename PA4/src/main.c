@@ -1,61 +1,262 @@
-
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
 #include <signal.h>
 
-#include "../include/pair.h"
-#include "../include/lexer.h"
-#include "../include/parser.h"
+#include "../include/str.h"
 #include "../include/semantics.h"
-#include "../include/codegen.h"
+#include "../include/cminus.h"
+#include "../include/trace.h"
 
 void segfault_handler(int signal) {
     fprintf(stderr, "(segmentation fault)\n");
     exit(2);
 }
 
+static Str* read_source(FILE* source) {
+
+    char   chunk[4096];
+    size_t count;
+
+    Str* text = Str_new(sizeof chunk);
+    if (!text) return NULL;
+
+    while ((count = fread(chunk, 1, sizeof chunk, source)) > 0) {
+        Str_append(text, chunk, count);
+    }
+
+    return text;
+}
+
+static void write_sink(void* state, char const* text, size_t length) {
+    fwrite(text, 1, length, state);
+}
+
+static void print_pipeline(PipelineStats const* stats) {
+
+    fprintf(stderr, "%-10s %10s %10s %12s %8s %10s %8s %10s\n",
+        "stage", "items", "seconds", "items/s", "starved", "seconds", "blocked", "seconds");
+
+    for (int i = 0; i <= Phase_CODEGEN; ++i) {
+
+        StageStats const* s = &stats->stages[i];
+        double rate = s->seconds > 0 ? s->items / s->seconds : 0;
+
+        fprintf(stderr, "%-10s %10zu %10.6f %12.0f %8zu %10.6f %8zu %10.6f\n",
+            Phase_to_string(i), s->items, s->seconds, rate,
+            s->starved, s->starved_seconds, s->blocked, s->blocked_seconds);
+    }
+}
+
+static void print_profile(Timings const* timings, MemoryStats const* memory) {
+
+    fprintf(stderr, "%-10s %10s %10s\n", "phase", "wall (s)", "cpu (s)");
+
+    for (int i = 0; i <= Phase_CODEGEN; ++i) {
+        fprintf(stderr, "%-10s %10.6f %10.6f\n",
+            Phase_to_string(i), timings->phases[i].wall, timings->phases[i].cpu);
+    }
+
+    fprintf(stderr, "\n%-10s %12s %12s %12s\n", "subsystem", "allocations", "bytes", "peak bytes");
+
+    for (int i = 0; i < MemoryTag_COUNT; ++i) {
+        fprintf(stderr, "%-10s %12zu %12zu %12zu\n",
+            MemoryTag_to_string(i), memory[i].allocations, memory[i].bytes, memory[i].peak);
+    }
+}
+
+static void print_peephole(size_t const* fired) {
+
+    fprintf(stderr, "\n%-18s %8s\n", "peephole rule", "fired");
+
+    for (int i = 0; i < Rule_COUNT; ++i) {
+        fprintf(stderr, "%-18s %8zu\n", Rule_to_string(i), fired[i]);
+    }
+}
+
+static void print_passes(PassManager const* passes) {
+
+    fprintf(stderr, "\n-O%d %-10s %8s %8s %10s %10s\n",
+        passes->level, "pass", "runs", "changed", "unchanged", "seconds");
+
+    for (size_t i = 0; i < passes->npasses; ++i) {
+        PassStats const* s = &passes->stats[i];
+        fprintf(stderr, "%-14s %8zu %8zu %10zu %10.6f\n",
+            s->name, s->runs, s->changed, s->runs - s->changed, s->seconds);
+    }
+
+    fprintf(stderr, "\n%-14s %8s %8s\n", "analysis", "computed", "reused");
+
+    for (int i = 0; i < Analysis_COUNT; ++i) {
+        fprintf(stderr, "%-14s %8zu %8zu\n",
+            Analysis_to_string(i), passes->analyses.computed[i] + passes->lowered.computed[i],
+            passes->analyses.reused[i] + passes->lowered.reused[i]);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: ./compiler [-O0 | -O1 | -O2] [--stream | --pipeline] [--stats] [--trace <json file>]\n"
+        "                  [--emit-ir] [--buffer-output] [--buffer-input] [--stack-calls]\n"
+        "                  <input file> <output file>\n");
+    exit(1);
+}
+
 int main(int argc, char** argv) {
 
     signal(SIGSEGV, segfault_handler);
 
-    if (argc != 3) {
-        fprintf(stderr, "usage: ./semantics <input file> <output file>\n");
-        exit(1);
+    bool        stream   = false;
+    bool        threaded = false;
+    bool        profile  = false;
+    bool        buffered = false;
+    bool        bulk     = false;
+    bool        stack    = false;
+    Target      target   = Target_MIPS;
+    char const* tracing  = NULL;
+    int         level    = 0;
+    int         npaths   = 0;
+    char const* paths[2];
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--stream") == 0) {
+            /* compile one declaration at a time in constant memory */
+            stream = true;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            /* the same, with a thread per phase, reporting how each kept up */
+            threaded = true;
+        } else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "-O2") == 0) {
+            /* which pass pipeline runs between semantic analysis and codegen */
+            level = argv[i][2] - '0';
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            /* time each phase and account memory to each subsystem */
+            profile = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            /* per phase and per function spans for chrome://tracing */
+            tracing = argv[++i];
+        } else if (strcmp(argv[i], "--emit-ir") == 0) {
+            /* write what each function is lowered to instead of assembly */
+            target = Target_IR;
+        } else if (strcmp(argv[i], "--buffer-output") == 0) {
+            /* the program prints through a buffer instead of two syscalls per output */
+            buffered = true;
+        } else if (strcmp(argv[i], "--buffer-input") == 0) {
+            /* the program reads stdin in bulk and parses each input itself */
+            bulk = true;
+        } else if (strcmp(argv[i], "--stack-calls") == 0) {
+            /* keep every argument on the stack and the result in $a0 at any level */
+            stack = true;
+        } else if (argv[i][0] == '-' || npaths == 2) {
+            usage();
+        } else {
+            paths[npaths++] = argv[i];
+        }
     }
-    
-    FILE* source = fopen(argv[1], "r");
+
+    if (npaths != 2) usage();
+
+    /* the accounting and the trace are not safe to share between threads */
+    if (threaded && (profile || tracing)) usage();
+
+    Timings     timings = { 0 };
+    MemoryStats memory[MemoryTag_COUNT] = { { 0 } };
+
+    /* before anything has been allocated */
+    if (profile) Memory_track(memory);
+
+    FILE* source = fopen(paths[0], "r");
     if (!source) {
-        fprintf(stderr, "Was unable to open input file %s\n", argv[1]);
+        fprintf(stderr, "Was unable to open input file %s\n", paths[0]);
         exit(1);
     }
 
-    FILE* sink = fopen(argv[2], "w");
+    FILE* sink = fopen(paths[1], "w");
     if (!sink) {
-        fprintf(stderr, "Was unable to open output file %s\n", argv[2]);
+        fprintf(stderr, "Was unable to open output file %s\n", paths[1]);
         exit(1);
     }
 
-    TokenList* tokens = lexlist(source);
-    if (!tokens) exit(1);
+    Trace trace;
+
+    if (tracing) {
+
+        FILE* file = fopen(tracing, "w");
+        if (!file) {
+            fprintf(stderr, "Was unable to open trace file %s\n", tracing);
+            exit(1);
+        }
+
+        Trace_open(&trace, file);
+        Trace_use(&trace);
+    }
+
+    CMinus* cminus = CMinus_new(NULL);
+    if (!cminus) exit(1);
+
+    if (profile) CMinus_profile(cminus, &timings);
+    CMinus_optimize(cminus, level);
+    CMinus_target(cminus, target);
+    CMinus_buffer_output(cminus, buffered);
+    CMinus_buffer_input(cminus, bulk);
+    CMinus_stack_calls(cminus, stack);
+
+    int         status = 0;
+    Str*        text   = NULL;
+    Compilation result;
+
+    if (stream) {
+
+        Source input = Source_file(source);
+        CMinus_stream(cminus, &input, write_sink, sink, &result);
 
-    Pair* ast = parse(tokens);
-    if (!ast) goto fail;
+    } else if (threaded) {
+
+        PipelineStats stats;
+        Source        input = Source_file(source);
+
+        CMinus_pipeline(cminus, &input, write_sink, sink, &result, &stats);
+        print_pipeline(&stats);
 
-    Semantic s;
-    if ((s = check_semantics(ast)) == Semantic_OK) {
-        // write_ast(stderr, ast);
-        codegen(sink, ast);
     } else {
-        fprintf(stderr, "Failed semantic analysis: %x\n", s);
-        exit(3);
+
+        text = read_source(source);
+        if (!text) exit(1);
+
+        if (CMinus_compile(cminus, text->buffer, text->length, &result)) {
+            fwrite(result.output, 1, result.length, sink);
+        }
     }
 
-fail:
-	Pair_free(ast);
-	lexfree(tokens);
+    for (size_t i = 0; i < result.ndiagnostics; ++i) {
+
+        Diagnostic const* d = &result.diagnostics[i];
+
+        if (d->phase == Phase_SEMANTICS) {
+            fprintf(stderr, "Failed semantic analysis: %x\n", d->code);
+            status = 3;
+        } else {
+            fprintf(stderr, "%s error on line %d: %s\n", Phase_to_string(d->phase), d->lineno, d->message);
+            status = 1;
+        }
+    }
+
+    if (profile) {
+        print_profile(&timings, memory);
+        print_passes(CMinus_passes(cminus));
+        print_peephole(CMinus_peephole(cminus));
+    }
+
+    CMinus_free(cminus);
+    if (text) Str_free(text);
+
+    if (tracing) {
+        Trace_close(&trace);
+        fclose(trace.file);
+    }
 
     fclose(source);
     fclose(sink);
 
-    return 0;
+    return status;
 }
@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <stddef.h>
+
+#include "../include/memory.h"
+
+static void* default_allocate(void* state, size_t size) {
+	return malloc(size);
+}
+
+static void* default_reallocate(void* state, void* block, size_t size) {
+	return realloc(block, size);
+}
+
+static void default_release(void* state, void* block) {
+	free(block);
+}
+
+Allocator const Allocator_DEFAULT = {
+	NULL, default_allocate, default_reallocate, default_release
+};
+
+/* per thread, so that compiles running on different threads each draw from their own */
+static _Thread_local Allocator const* current = &Allocator_DEFAULT;
+
+Allocator const* Memory_use(Allocator const* allocator) {
+	Allocator const* previous = current;
+	current = allocator ? allocator : &Allocator_DEFAULT;
+	return previous;
+}
+
+char const* MemoryTag_to_string(MemoryTag tag) {
+	switch (tag) {
+		case MemoryTag_OTHER:     return "other";
+		case MemoryTag_STR:       return "Str";
+		case MemoryTag_TOKENLIST: return "TokenList";
+		case MemoryTag_PAIR:      return "Pair";
+		case MemoryTag_IDTABLE:   return "IDTable";
+		case MemoryTag_TYPE:      return "Type";
+		case MemoryTag_IR:        return "IR";
+		case MemoryTag_ASM:       return "Asm";
+		default:                  return "???";
+	}
+}
+
+/* tracked blocks start with their size and tag, padded to keep the payload aligned */
+typedef struct Tracked {
+	size_t    size;
+	MemoryTag tag;
+} Tracked;
+
+#define TRACKED_HEADER ((sizeof (Tracked) + alignof (max_align_t) - 1) & ~(alignof (max_align_t) - 1))
+
+static _Thread_local MemoryStats* tracking = NULL;
+
+void Memory_track(MemoryStats stats[MemoryTag_COUNT]) {
+	tracking = stats;
+}
+
+static void* charge(char* raw, MemoryTag tag, size_t size) {
+
+	Tracked* header = (Tracked*) raw;
+	header->size = size;
+	header->tag  = tag;
+
+	MemoryStats* stats = &tracking[tag];
+	stats->allocations += 1;
+	stats->bytes       += size;
+	stats->live        += size;
+	if (stats->live > stats->peak) stats->peak = stats->live;
+
+	return raw + TRACKED_HEADER;
+}
+
+static Tracked* refund(void* block) {
+	Tracked* header = (Tracked*) ((char*) block - TRACKED_HEADER);
+	tracking[header->tag].live -= header->size;
+	return header;
+}
+
+void* Memory_alloc(MemoryTag tag, size_t size) {
+
+	if (!tracking) return current->allocate(current->state, size);
+
+	char* raw = current->allocate(current->state, TRACKED_HEADER + size);
+	return raw ? charge(raw, tag, size) : NULL;
+}
+
+void* Memory_calloc(MemoryTag tag, size_t count, size_t size) {
+
+	/* refuse sizes that would wrap around */
+	if (size && count > (size_t) -1 / size) return NULL;
+
+	void* block = Memory_alloc(tag, count * size);
+	if (block) memset(block, 0, count * size);
+	return block;
+}
+
+void* Memory_realloc(MemoryTag tag, void* block, size_t size) {
+
+	if (!tracking) return current->reallocate(current->state, block, size);
+	if (!block) return Memory_alloc(tag, size);
+
+	/* a resize counts as a fresh allocation replacing the old one */
+	Tracked* header = (Tracked*) ((char*) block - TRACKED_HEADER);
+	MemoryTag owner = header->tag;
+	size_t    old   = header->size;
+
+	char* raw = current->reallocate(current->state, header, TRACKED_HEADER + size);
+	if (!raw) return NULL;
+
+	tracking[owner].live -= old;
+	return charge(raw, owner, size);
+}
+
+void Memory_free(void* block) {
+
+	if (!block) return;
+
+	if (tracking) block = refund(block);
+	current->release(current->state, block);
+}
+
+/* every arena block is prefixed with its size so it can be reallocated */
+#define ARENA_ALIGN  (alignof (max_align_t))
+#define ARENA_HEADER (ARENA_ALIGN > sizeof (size_t) ? ARENA_ALIGN : sizeof (size_t))
+#define ARENA_CHUNK  ((size_t) 64 * 1024)
+
+static size_t align_up(size_t size) {
+	return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static char* chunk_data(ArenaChunk* chunk) {
+	return (char*) chunk + align_up(sizeof (ArenaChunk));
+}
+
+static ArenaChunk* Arena_chunk(Arena* arena, size_t need) {
+
+	/* reuse a chunk left over from a previous workload when possible */
+	ArenaChunk* chunk = arena->here ? arena->here->next : arena->first;
+
+	while (chunk && chunk->size < need) {
+		chunk = chunk->next;
+	}
+
+	if (chunk) {
+		chunk->used = 0;
+		return chunk;
+	}
+
+	size_t size = need > ARENA_CHUNK ? need : ARENA_CHUNK;
+
+	chunk = arena->backing->allocate(arena->backing->state, align_up(sizeof (ArenaChunk)) + size);
+	if (!chunk) return NULL;
+
+	chunk->size = size;
+	chunk->used = 0;
+
+	/* splice in after the current chunk so the order stays stable across resets */
+	if (arena->here) {
+		chunk->next       = arena->here->next;
+		arena->here->next = chunk;
+	} else {
+		chunk->next   = arena->first;
+		arena->first  = chunk;
+	}
+
+	return chunk;
+}
+
+static void* arena_allocate(void* state, size_t size) {
+
+	Arena* arena = state;
+	size_t need  = ARENA_HEADER + align_up(size);
+
+	if (!arena->here || arena->here->size - arena->here->used < need) {
+
+		ArenaChunk* chunk = Arena_chunk(arena, need);
+		if (!chunk) return NULL;
+
+		arena->here = chunk;
+	}
+
+	char* block = chunk_data(arena->here) + arena->here->used + ARENA_HEADER;
+	*(size_t*) (block - sizeof (size_t)) = size;
+	arena->here->used += need;
+
+	return block;
+}
+
+static void* arena_reallocate(void* state, void* block, size_t size) {
+
+	if (!block) return arena_allocate(state, size);
+
+	Arena* arena = state;
+	size_t old   = *(size_t*) ((char*) block - sizeof (size_t));
+	char*  end   = chunk_data(arena->here) + arena->here->used;
+
+	/* the most recent block can grow in place */
+	if ((char*) block + align_up(old) == end) {
+		size_t grow = align_up(size) - align_up(old);
+
+		if (align_up(size) <= align_up(old) || arena->here->size - arena->here->used >= grow) {
+			arena->here->used += grow;
+			*(size_t*) ((char*) block - sizeof (size_t)) = size;
+			return block;
+		}
+	}
+
+	void* moved = arena_allocate(state, size);
+	if (!moved) return NULL;
+
+	memcpy(moved, block, old < size ? old : size);
+	return moved;
+}
+
+static void arena_release(void* state, void* block) {
+	/* everything is released at once by Arena_reset */
+}
+
+static void* locked_allocate(void* state, size_t size) {
+
+	Locked* locked = state;
+
+	mtx_lock(&locked->lock);
+	void* block = locked->backing->allocate(locked->backing->state, size);
+	mtx_unlock(&locked->lock);
+
+	return block;
+}
+
+static void* locked_reallocate(void* state, void* block, size_t size) {
+
+	Locked* locked = state;
+
+	mtx_lock(&locked->lock);
+	void* moved = locked->backing->reallocate(locked->backing->state, block, size);
+	mtx_unlock(&locked->lock);
+
+	return moved;
+}
+
+static void locked_release(void* state, void* block) {
+
+	Locked* locked = state;
+
+	mtx_lock(&locked->lock);
+	locked->backing->release(locked->backing->state, block);
+	mtx_unlock(&locked->lock);
+}
+
+bool Locked_init(Locked* locked, Allocator const* backing) {
+	locked->backing              = backing ? backing : &Allocator_DEFAULT;
+	locked->allocator.state      = locked;
+	locked->allocator.allocate   = locked_allocate;
+	locked->allocator.reallocate = locked_reallocate;
+	locked->allocator.release    = locked_release;
+	return mtx_init(&locked->lock, mtx_plain) == thrd_success;
+}
+
+void Locked_release(Locked* locked) {
+	mtx_destroy(&locked->lock);
+}
+
+void Arena_init(Arena* arena, Allocator const* backing) {
+	arena->backing              = backing ? backing : &Allocator_DEFAULT;
+	arena->allocator.state      = arena;
+	arena->allocator.allocate   = arena_allocate;
+	arena->allocator.reallocate = arena_reallocate;
+	arena->allocator.release    = arena_release;
+	arena->first                = NULL;
+	arena->here                 = NULL;
+}
+
+void Arena_reset(Arena* arena) {
+
+	for (ArenaChunk* chunk = arena->first; chunk; chunk = chunk->next) {
+		chunk->used = 0;
+	}
+
+	arena->here = arena->first;
+}
+
+void Arena_release(Arena* arena) {
+
+	ArenaChunk *chunk = arena->first, *next;
+
+	while (chunk) {
+		next = chunk->next;
+		arena->backing->release(arena->backing->state, chunk);
+		chunk = next;
+	}
+
+	arena->first = NULL;
+	arena->here  = NULL;
+}
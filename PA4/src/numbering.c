@@ -0,0 +1,520 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/memory.h"
+#include "../include/numbering.h"
+
+/* an expression worked out on every path to where the walk is, and the operand holding its result */
+typedef struct Value {
+
+	/* the instruction with value numbers for registers and a constant address folded into imm */
+	Instr   key;
+
+	/* and the number holder had then, the value is gone once holder is written again */
+	Operand holder;
+	int     number;
+
+	/* some store or call on the way may have changed the word a load read */
+	bool    dead;
+
+} Value;
+
+/* what to put back on leaving a block, the old number of a register, or a Value to bring back when vreg is -1 */
+typedef struct Change {
+	int vreg;
+	int old;
+} Change;
+
+/* a block of the dominator tree being walked, and how much there was to undo before it */
+typedef struct Visit {
+	Block* block;
+	size_t child;
+	size_t nvalues;
+	size_t nchanges;
+} Visit;
+
+typedef struct Numbering {
+
+	Procedure* function;
+
+	/* how often each virtual register is written, and the number of what it holds */
+	int*       defs;
+	int*       number;
+	int        next;
+
+	/* the register used instead of a temporary that was dropped, -1 for none */
+	int*       replaced;
+
+	Value*     values;
+	size_t     nvalues;
+	size_t     vcapacity;
+
+	Change*    changes;
+	size_t     nchanges;
+	size_t     ccapacity;
+
+	/* the children of each block in the dominator tree, kids[first[id]] on */
+	size_t*    first;
+	Block**    kids;
+
+	/* by block id, for the walks back from a block to its immediate dominator */
+	int*       seen;
+	int        stamp;
+	Block**    worklist;
+
+	int        eliminated;
+
+} Numbering;
+
+static Instr make(Op op, int dst) {
+	return (Instr) { op, dst, Operand_NONE, Operand_NONE, 0, NULL, -1, NULL, 0, { NULL, NULL } };
+}
+
+/* what cannot do anything but compute the same result from the same operands */
+static bool pure(Op op) {
+
+	switch (op) {
+
+		case Op_ADD: case Op_SUB: case Op_MUL: case Op_DIV:
+		case Op_LT: case Op_LE: case Op_GT: case Op_GE: case Op_EQ: case Op_NE:
+		case Op_ADDU: case Op_SLL: case Op_ADDR: case Op_LOAD:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+static bool commutative(Op op) {
+	return op == Op_ADD || op == Op_MUL || op == Op_EQ || op == Op_NE || op == Op_ADDU;
+}
+
+/* the order the operands of a commutative key are put in, the lower number first and a constant last */
+static bool before(Operand x, Operand y) {
+	return x.kind == OperandKind_VREG && (y.kind == OperandKind_CONST || (y.kind == OperandKind_VREG && x.value < y.value));
+}
+
+static bool change(Numbering* g, int vreg, int old) {
+
+	if (g->nchanges == g->ccapacity) {
+
+		size_t  bigger = g->ccapacity ? g->ccapacity * 2 : 64;
+		Change* larger = Memory_realloc(MemoryTag_IR, g->changes, bigger * sizeof (Change));
+
+		if (!larger) return false;
+
+		g->changes   = larger;
+		g->ccapacity = bigger;
+	}
+
+	g->changes[g->nchanges++] = (Change) { vreg, old };
+	return true;
+}
+
+static bool renumber(Numbering* g, int vreg, int number) {
+
+	if (!change(g, vreg, g->number[vreg])) return false;
+
+	g->number[vreg] = number;
+	return true;
+}
+
+static bool kill(Numbering* g, size_t i) {
+
+	if (g->values[i].dead) return true;
+	if (!change(g, -1, (int) i)) return false;
+
+	g->values[i].dead = true;
+	return true;
+}
+
+static Operand value(Numbering const* g, Operand operand) {
+	return operand.kind == OperandKind_VREG ? Operand_vreg(g->number[operand.value]) : operand;
+}
+
+/* instr as a Value is filed, a store filed as the load reading back what it wrote */
+static Instr key(Numbering const* g, Instr const* instr) {
+
+	Instr key = make(instr->op == Op_STORE ? Op_LOAD : instr->op, -1);
+
+	key.a      = value(g, instr->a);
+	key.imm    = instr->imm;
+	key.symbol = instr->symbol;
+	key.slot   = instr->slot;
+
+	if (instr->op == Op_LOAD || instr->op == Op_STORE) {
+
+		if (key.a.kind == OperandKind_CONST) {
+			key.imm += key.a.value;
+			key.a    = Operand_NONE;
+		}
+
+		return key;
+	}
+
+	key.b = value(g, instr->b);
+
+	if (commutative(key.op) && before(key.b, key.a)) {
+		Operand a = key.a;
+		key.a = key.b;
+		key.b = a;
+	}
+
+	return key;
+}
+
+static bool same_operand(Operand x, Operand y) {
+	return x.kind == y.kind && (x.kind == OperandKind_NONE || x.value == y.value);
+}
+
+static bool same(Instr const* x, Instr const* y) {
+
+	if (x->op != y->op || x->imm != y->imm || x->slot != y->slot) return false;
+	if (!same_operand(x->a, y->a) || !same_operand(x->b, y->b)) return false;
+
+	if (!x->symbol || !y->symbol) return x->symbol == y->symbol;
+	return strcmp(x->symbol, y->symbol) == 0;
+}
+
+/* whether a store may write the word a load reads, both as keys, a register alone may point anywhere */
+static bool aliases(Instr const* store, Instr const* load) {
+
+	if (!store->symbol && store->slot < 0) return true;
+	if (!load->symbol && load->slot < 0) return true;
+
+	if (store->symbol && load->symbol) {
+		if (strcmp(store->symbol, load->symbol) != 0) return false;
+	} else if (store->slot < 0 || store->slot != load->slot) {
+		return false;
+	}
+
+	/* the same array, apart only when both are at constant offsets that differ */
+	return store->a.kind == OperandKind_VREG || load->a.kind == OperandKind_VREG || store->imm == load->imm;
+}
+
+/* forgets the loads an instruction may change the word of, a call may change any */
+static bool clobber(Numbering* g, Instr const* instr) {
+
+	if (instr->op != Op_STORE && instr->op != Op_CALL && instr->op != Op_TAILCALL) return true;
+
+	Instr stored = key(g, instr);
+
+	for (size_t i = 0; i < g->nvalues; ++i) {
+
+		Value const* v = &g->values[i];
+		if (v->dead || v->key.op != Op_LOAD) continue;
+
+		if ((instr->op != Op_STORE || aliases(&stored, &v->key)) && !kill(g, i)) return false;
+	}
+
+	return true;
+}
+
+static bool record(Numbering* g, Instr const* key, Operand holder) {
+
+	if (g->nvalues == g->vcapacity) {
+
+		size_t bigger = g->vcapacity ? g->vcapacity * 2 : 64;
+		Value* larger = Memory_realloc(MemoryTag_IR, g->values, bigger * sizeof (Value));
+
+		if (!larger) return false;
+
+		g->values    = larger;
+		g->vcapacity = bigger;
+	}
+
+	int number = holder.kind == OperandKind_VREG ? g->number[holder.value] : 0;
+
+	g->values[g->nvalues++] = (Value) { *key, holder, number, false };
+	return true;
+}
+
+/* the latest Value for key whose holder still holds it */
+static Value const* lookup(Numbering const* g, Instr const* key) {
+
+	for (size_t i = g->nvalues; i-- > 0;) {
+
+		Value const* v = &g->values[i];
+
+		if (v->dead || !same(&v->key, key)) continue;
+		if (v->holder.kind != OperandKind_VREG || g->number[v->holder.value] == v->number) return v;
+	}
+
+	return NULL;
+}
+
+/* what a block does to the registers and memory of anything walked before it */
+static bool effects(Numbering* g, Block const* block) {
+
+	for (size_t j = 0; j < block->count; ++j) {
+
+		Instr const* instr = &block->code[j];
+
+		if (!clobber(g, instr)) return false;
+		if (instr->dst >= 0 && !renumber(g, instr->dst, ++g->next)) return false;
+	}
+
+	return true;
+}
+
+static void reach(Numbering* g, Block* block, size_t* count) {
+
+	if (block == g->worklist[0] || g->seen[block->id] == g->stamp) return;
+
+	g->seen[block->id]      = g->stamp;
+	g->worklist[(*count)++] = block;
+}
+
+/*
+ * What held at the end of the immediate dominator holds on entry, less what
+ * the blocks on some path between the two change. Those reach the block
+ * going back without passing the dominator, or go around a loop through it,
+ * running it once more.
+ */
+static bool enter(Numbering* g, Block* block) {
+
+	Block* idom = block->idom;
+
+	if (block->npreds == 1 && block->preds[0] == idom) return true;
+
+	size_t count = 1;
+	bool   again = false;
+
+	++g->stamp;
+	g->worklist[0] = idom;
+
+	for (size_t p = 0; p < block->npreds; ++p) reach(g, block->preds[p], &count);
+
+	for (size_t p = 0; idom && p < idom->npreds; ++p) {
+		if (Block_dominates(idom, idom->preds[p])) {
+			reach(g, idom->preds[p], &count);
+			again = true;
+		}
+	}
+
+	if (again && !effects(g, idom)) return false;
+
+	for (size_t i = 1; i < count; ++i) {
+
+		Block const* on = g->worklist[i];
+
+		for (size_t p = 0; p < on->npreds; ++p) reach(g, on->preds[p], &count);
+		if (!effects(g, on)) return false;
+	}
+
+	return true;
+}
+
+static bool visit(Numbering* g, Block* block) {
+
+	if (!enter(g, block)) return false;
+
+	for (size_t j = 0; j < block->count;) {
+
+		Instr*   instr = &block->code[j];
+		Operand* operand;
+
+		for (size_t k = 0; (operand = Instr_use(instr, k)); ++k) {
+			if (operand->kind == OperandKind_VREG && g->replaced[operand->value] >= 0) operand->value = g->replaced[operand->value];
+		}
+
+		if (!clobber(g, instr)) return false;
+
+		if (instr->op == Op_STORE) {
+
+			Instr stored = key(g, instr);
+
+			if (!record(g, &stored, instr->b)) return false;
+			++j;
+			continue;
+		}
+
+		if (instr->dst < 0) {
+			++j;
+			continue;
+		}
+
+		if (!pure(instr->op)) {
+
+			bool copied = instr->op == Op_COPY && instr->a.kind == OperandKind_VREG;
+
+			if (!renumber(g, instr->dst, copied ? g->number[instr->a.value] : ++g->next)) return false;
+			++j;
+			continue;
+		}
+
+		Instr        computed = key(g, instr);
+		Value const* earlier  = lookup(g, &computed);
+
+		if (!earlier) {
+
+			if (!renumber(g, instr->dst, ++g->next) || !record(g, &computed, Operand_vreg(instr->dst))) return false;
+			++j;
+			continue;
+		}
+
+		Operand holder = earlier->holder;
+
+		++g->eliminated;
+
+		if (holder.kind == OperandKind_VREG && g->defs[holder.value] == 1 && g->defs[instr->dst] == 1) {
+			g->replaced[instr->dst] = holder.value;
+			memmove(&block->code[j], &block->code[j + 1], (block->count - j - 1) * sizeof (Instr));
+			--block->count;
+			continue;
+		}
+
+		int dst = instr->dst;
+
+		*instr   = make(Op_COPY, dst);
+		instr->a = holder;
+
+		if (!renumber(g, dst, holder.kind == OperandKind_VREG ? g->number[holder.value] : ++g->next)) return false;
+		++j;
+	}
+
+	return true;
+}
+
+/* back to how things were before visit entered the block */
+static void leave(Numbering* g, Visit const* visit) {
+
+	while (g->nchanges > visit->nchanges) {
+
+		Change const* c = &g->changes[--g->nchanges];
+
+		if (c->vreg >= 0) g->number[c->vreg] = c->old;
+		else              g->values[c->old].dead = false;
+	}
+
+	g->nvalues = visit->nvalues;
+}
+
+/* the children of each block in the dominator tree, in layout order */
+static bool tree(Numbering* g) {
+
+	Procedure* function = g->function;
+	size_t     n        = function->nblocks;
+	size_t     ids      = function->nextblock;
+
+	g->first = Memory_calloc(MemoryTag_IR, ids + 1, sizeof (size_t));
+	g->kids  = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (Block*));
+
+	if (!g->first || !g->kids) return false;
+
+	for (size_t i = 1; i < n; ++i) ++g->first[function->blocks[i]->idom->id + 1];
+	for (size_t id = 0; id < ids; ++id) g->first[id + 1] += g->first[id];
+
+	size_t* at = Memory_alloc(MemoryTag_IR, (ids ? ids : 1) * sizeof (size_t));
+	if (!at) return false;
+
+	memcpy(at, g->first, ids * sizeof (size_t));
+
+	for (size_t i = 1; i < n; ++i) {
+		Block* block = function->blocks[i];
+		g->kids[at[block->idom->id]++] = block;
+	}
+
+	Memory_free(at);
+	return true;
+}
+
+static bool number(Procedure* function, int* eliminated) {
+
+	size_t    nvregs = function->nvregs;
+	size_t    n      = function->nblocks;
+	size_t    ids    = function->nextblock;
+	Numbering g      = { function, NULL, NULL, (int) nvregs, NULL, NULL, 0, 0, NULL, 0, 0, NULL, NULL, NULL, 0, NULL, 0 };
+	Visit*    stack  = NULL;
+	size_t    depth  = 0;
+	bool      ok     = false;
+
+	*eliminated = 0;
+
+	if (!n) return true;
+
+	g.defs     = Memory_calloc(MemoryTag_IR, nvregs ? nvregs : 1, sizeof (int));
+	g.number   = Memory_alloc(MemoryTag_IR, (nvregs ? nvregs : 1) * sizeof (int));
+	g.replaced = Memory_alloc(MemoryTag_IR, (nvregs ? nvregs : 1) * sizeof (int));
+	g.seen     = Memory_calloc(MemoryTag_IR, ids ? ids : 1, sizeof (int));
+	g.worklist = Memory_alloc(MemoryTag_IR, (n + 1) * sizeof (Block*));
+	stack      = Memory_alloc(MemoryTag_IR, n * sizeof (Visit));
+
+	if (!g.defs || !g.number || !g.replaced || !g.seen || !g.worklist || !stack || !tree(&g)) goto done;
+
+	/* a register read before anything writes it holds one value of its own, whatever it is */
+	for (size_t v = 0; v < nvregs; ++v) {
+		g.number[v]   = (int) v + 1;
+		g.replaced[v] = -1;
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+
+		Block const* block = function->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+			if (block->code[j].dst >= 0) ++g.defs[block->code[j].dst];
+		}
+	}
+
+	stack[depth++] = (Visit) { function->blocks[0], 0, 0, 0 };
+	if (!visit(&g, function->blocks[0])) goto done;
+
+	while (depth) {
+
+		Visit* top   = &stack[depth - 1];
+		size_t first = g.first[top->block->id];
+		size_t last  = g.first[top->block->id + 1];
+
+		if (first + top->child == last) {
+			leave(&g, top);
+			--depth;
+			continue;
+		}
+
+		Block* child = g.kids[first + top->child++];
+
+		stack[depth++] = (Visit) { child, 0, g.nvalues, g.nchanges };
+		if (!visit(&g, child)) goto done;
+	}
+
+	*eliminated = g.eliminated;
+	ok = true;
+
+done:
+	Memory_free(g.defs);
+	Memory_free(g.number);
+	Memory_free(g.replaced);
+	Memory_free(g.values);
+	Memory_free(g.changes);
+	Memory_free(g.first);
+	Memory_free(g.kids);
+	Memory_free(g.seen);
+	Memory_free(g.worklist);
+	Memory_free(stack);
+
+	return ok;
+}
+
+static bool run_numbering(Procedure* function, Analyses* analyses, PassContext* context, bool* changed) {
+
+	int eliminated = 0;
+
+	if (!number(function, &eliminated)) return false;
+
+	if (eliminated) {
+		Str_printf(context->report, "%s eliminated %d redundant expression%s in %s\n",
+			context->comment, eliminated, eliminated == 1 ? "" : "s", function->name);
+	}
+
+	*changed = eliminated > 0;
+	return true;
+}
+
+/* walks the dominator tree, only instructions change */
+Pass const Pass_NUMBERING = {
+	.name        = "numbering",
+	.requires    = ANALYSIS(Analysis_DOMINATORS),
+	.invalidates = ANALYSIS(Analysis_LIVENESS),
+	.lowered     = run_numbering,
+};
@@ -3,10 +3,11 @@
 
 #include "../include/str.h"
 #include "../include/pair.h"
+#include "../include/memory.h"
 
 Pair* Pair_new(ASType val, Pair* car, Pair* cdr) {
 
-	Pair* pair = malloc(sizeof(Pair));
+	Pair* pair = Memory_alloc(MemoryTag_PAIR, sizeof(Pair));
 
 	if (!pair) return NULL;
 
@@ -22,7 +23,7 @@ Pair* Pair_new(ASType val, Pair* car, Pair* cdr) {
 
 Pair* Pair_dyn(ASType val, char const* dyn, Pair* car, Pair* cdr) {
 
-	Pair* pair = malloc(sizeof(Pair));
+	Pair* pair = Memory_alloc(MemoryTag_PAIR, sizeof(Pair));
 
 	if (!pair) return NULL;
 
@@ -38,16 +39,22 @@ Pair* Pair_dyn(ASType val, char const* dyn, Pair* car, Pair* cdr) {
 
 void Pair_free(Pair* pair) {
 
-	if (!pair) return;
+	Pair* next;
 
-	if (pair->dyn) {
-		free((void*) pair->dyn);
-	}
-	
-	if (pair->car) free(pair->car);
-	if (pair->cdr) free(pair->cdr);
+	/* walk down the cdr so long lists don't eat the stack */
+	while (pair) {
+
+		/* variables reuse dyn as a subscript flag after semantic analysis */
+		if (pair->dyn && pair->val != ASType_VAR) {
+			Memory_free((void*) pair->dyn);
+		}
 
-	free(pair);
+		Pair_free(pair->car);
+
+		next = pair->cdr;
+		Memory_free(pair);
+		pair = next;
+	}
 }
 
 Pair* Pair_last(Pair* pair) {
@@ -13,7 +13,16 @@ static Pair* p_statement();
 
 static Pair* p_expression();
 
-static TokenList* token;
+/* per thread, a parse runs on one from start to end and another thread may be parsing something else */
+static _Thread_local TokenList* token;
+
+/* line of the deepest token the parser has examined */
+static _Thread_local int furthest;
+
+static void reached(void) {
+	if (token && token->value.lineno > furthest)
+		furthest = token->value.lineno;
+}
 
 // static void look(size_t depth) {
 
@@ -110,6 +119,7 @@ void write_ast(FILE* file, Pair* root) {
 
 static bool is_terminal(char const* terminal) {
 
+	reached();
 	return token && strcmp(token->value.lexeme->buffer, terminal) == 0;
 }
 
@@ -185,6 +195,7 @@ static Pair* p_type_specifier(void) {
 static Pair* p_identifier(void) {
 
 	if (!token) return NULL;
+	reached();
 
 	if (token->value.symbol == TokenType_ID) {
 		return Pair_dyn(ASType_ID, token->value.lexeme->buffer, NULL, NULL);
@@ -197,6 +208,7 @@ static Pair* p_identifier(void) {
 static Pair* p_number(void) {
 
 	if (!token) return NULL;
+	reached();
 
 	if (token->value.symbol == TokenType_NUM) {
 		return Pair_dyn(ASType_NUM, token->value.lexeme->buffer, NULL, NULL);
@@ -432,42 +444,36 @@ static Pair* p_additive_expression(void) {
 	return NULL;
 }
 
-/* <additive-expression> <relop> <additive-expression> */
-static Pair* p_simple_expression_1(void) {
+/* <simple-expression> ::= <additive-expression> <relop> <additive-expression> 
+
+                       | <additive-expression>
+
+   both alternatives start with the same additive expression, parsing it
+   twice would double the work for every level of nested parentheses */
+static Pair* p_simple_expression(void) {
 	INITPAIRS(3);
 
-	NOPTURE(p_additive_expression());
-	CAPTURE(p_relop());
 	NOPTURE(p_additive_expression());
 
-	pairs[1]->cdr = Pair_new(ASType_NONE, pairs[0], Pair_new(ASType_NONE, pairs[2], NULL));
-	return pairs[1];
+	TokenList* save = token;
 
-	CLEANUP();
-}
+	pairs[index] = p_relop();
+	if (!pairs[index]) {
+		token = save;
+		return pairs[0];
+	}
 
-/* <additive-expression> */
-static Pair* p_simple_expression_2(void) {
-	INITPAIRS(1);
+	if (token) token = token->next;
+	++index;
 
 	NOPTURE(p_additive_expression());
 
-	return pairs[0];
+	pairs[1]->cdr = Pair_new(ASType_NONE, pairs[0], Pair_new(ASType_NONE, pairs[2], NULL));
+	return pairs[1];
 
 	CLEANUP();
 }
 
-/* <simple-expression> ::= <additive-expression> <relop> <additive-expression> 
-
-                       | <additive-expression>*/
-static Pair* p_simple_expression(void) {
-	INITMATCH();
-
-	ATTEMPT(p_simple_expression_1());
-	ATTEMPT(p_simple_expression_2());
-	return NULL;
-}
-
 /* <var> = <expression> */
 static Pair* p_expression_1(void) {
 	INITPAIRS(2);
@@ -898,8 +904,27 @@ static Pair* p_program(void) {
 }
 
 Pair* parse(TokenList* tokens) {
-	token = tokens;
+	token    = tokens;
+	furthest = tokens ? tokens->value.lineno : 0;
 	// look(0);
 	return p_program();
 }
 
+Pair* parse_declaration(TokenList* tokens) {
+	token    = tokens;
+	furthest = tokens ? tokens->value.lineno : 0;
+
+	Pair* out = p_declaration();
+
+	/* the declaration has to account for every token handed over */
+	if (out && token) {
+		Pair_free(out);
+		return NULL;
+	}
+
+	return out;
+}
+
+int parse_lineno(void) {
+	return furthest;
+}
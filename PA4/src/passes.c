@@ -0,0 +1,248 @@
+#include "../include/memory.h"
+#include "../include/trace.h"
+#include "../include/prune.h"
+#include "../include/fold.h"
+#include "../include/loop.h"
+#include "../include/liveness.h"
+#include "../include/inline.h"
+#include "../include/tail.h"
+#include "../include/numbering.h"
+#include "../include/propagate.h"
+#include "../include/hoist.h"
+#include "../include/induction.h"
+#include "../include/passes.h"
+
+typedef struct AnalysisInfo {
+	char const* name;
+	void*     (*compute)(Analyses* analyses);
+	void      (*release)(void* result);
+} AnalysisInfo;
+
+static void* flow_compute(Analyses* analyses) {
+	return Flow_compute(analyses->function);
+}
+
+static void flow_release(void* result) {
+	Flow_free(result);
+}
+
+/* the idoms are kept in the blocks themselves, the procedure stands for them */
+static void* dominators_compute(Analyses* analyses) {
+	return Procedure_dominators(analyses->procedure) ? analyses->procedure : NULL;
+}
+
+static void dominators_release(void* result) {
+}
+
+static void* loops_compute(Analyses* analyses) {
+
+	Loops* loops = Memory_alloc(MemoryTag_IR, sizeof (Loops));
+	if (!loops) return NULL;
+
+	*loops = (Loops) { NULL, 0 };
+
+	if (!Analyses_get(analyses, Analysis_DOMINATORS) || !Loops_find(analyses->procedure, loops)) {
+		Loops_release(loops);
+		Memory_free(loops);
+		return NULL;
+	}
+
+	return loops;
+}
+
+static void loops_release(void* result) {
+	Loops_release(result);
+	Memory_free(result);
+}
+
+static void* liveness_compute(Analyses* analyses) {
+	return Liveness_compute(analyses->procedure);
+}
+
+static void liveness_release(void* result) {
+	Liveness_free(result);
+}
+
+static AnalysisInfo const ANALYSES[Analysis_COUNT] = {
+	[Analysis_FLOW]       = { "flow",       flow_compute,       flow_release },
+	[Analysis_DOMINATORS] = { "dominators", dominators_compute, dominators_release },
+	[Analysis_LOOPS]      = { "loops",      loops_compute,      loops_release },
+	[Analysis_LIVENESS]   = { "liveness",   liveness_compute,   liveness_release },
+};
+
+char const* Analysis_to_string(Analysis analysis) {
+	return analysis < Analysis_COUNT ? ANALYSES[analysis].name : "???";
+}
+
+/* pipelines, in the order the passes run, those over the tree before those over the lowered function */
+static Pass const* const PIPELINE_O1[] = {
+	&Pass_FOLD,
+	&Pass_UNREACHABLE,
+	&Pass_TAIL,
+	&Pass_NUMBERING,
+	&Pass_PROPAGATE,
+	&Pass_HOIST,
+};
+
+/* inlining grows the code and stepping pointers keeps more registers busy across a loop, so only -O2 does them */
+static Pass const* const PIPELINE_O2[] = {
+	&Pass_FOLD,
+	&Pass_DEAD_BRANCHES,
+	&Pass_UNREACHABLE,
+	&Pass_INLINE,
+	&Pass_TAIL,
+	&Pass_OFFER,
+	&Pass_NUMBERING,
+	&Pass_PROPAGATE,
+	&Pass_HOIST,
+	&Pass_INDUCTION,
+};
+
+static void Analyses_drop(Analyses* analyses, unsigned which) {
+
+	for (int i = 0; i < Analysis_COUNT; ++i) {
+
+		if (!(which & ANALYSIS(i)) || !analyses->results[i]) continue;
+
+		ANALYSES[i].release(analyses->results[i]);
+		analyses->results[i] = NULL;
+	}
+
+	analyses->valid &= ~which;
+}
+
+void const* Analyses_get(Analyses* analyses, Analysis analysis) {
+
+	if (analyses->valid & ANALYSIS(analysis)) {
+		++analyses->reused[analysis];
+		return analyses->results[analysis];
+	}
+
+	Analyses_drop(analyses, ANALYSIS(analysis));
+
+	analyses->results[analysis] = ANALYSES[analysis].compute(analyses);
+	if (!analyses->results[analysis]) return NULL;
+
+	analyses->valid |= ANALYSIS(analysis);
+	++analyses->computed[analysis];
+
+	return analyses->results[analysis];
+}
+
+void Analyses_clear(Analyses* analyses) {
+	Analyses_drop(analyses, ~0u);
+	analyses->function  = NULL;
+	analyses->procedure = NULL;
+}
+
+void PassManager_init(PassManager* manager, int level) {
+
+	Pass const* const* pipeline = NULL;
+
+	manager->level   = level < 0 ? 0 : level > 2 ? 2 : level;
+	manager->npasses = 0;
+
+	switch (manager->level) {
+		case 1:
+			pipeline         = PIPELINE_O1;
+			manager->npasses = sizeof PIPELINE_O1 / sizeof *PIPELINE_O1;
+			break;
+		case 2:
+			pipeline         = PIPELINE_O2;
+			manager->npasses = sizeof PIPELINE_O2 / sizeof *PIPELINE_O2;
+			break;
+	}
+
+	for (size_t i = 0; i < manager->npasses; ++i) {
+		manager->passes[i] = pipeline[i];
+		manager->stats[i]  = (PassStats) { pipeline[i]->name, 0, 0, 0 };
+	}
+
+	manager->analyses = (Analyses) { 0 };
+	manager->lowered  = (Analyses) { 0 };
+}
+
+bool PassManager_run(PassManager* manager, Pair* function) {
+
+	Analyses* analyses = &manager->analyses;
+	bool      changed  = false;
+
+	/* nothing carries over from the previous function */
+	Analyses_clear(analyses);
+	analyses->function = function;
+
+	for (size_t i = 0; i < manager->npasses; ++i) {
+
+		Pass const* pass  = manager->passes[i];
+		PassStats*  stats = &manager->stats[i];
+
+		if (!pass->run) continue;
+
+		double start = Trace_wall();
+
+		Trace_begin("pass", pass->name);
+
+		for (int a = 0; a < Analysis_COUNT; ++a) {
+			if (pass->requires & ANALYSIS(a)) Analyses_get(analyses, a);
+		}
+
+		bool did = pass->run(function, analyses);
+		if (did) Analyses_drop(analyses, pass->invalidates);
+
+		Trace_end("pass", pass->name);
+
+		stats->runs    += 1;
+		stats->changed += did;
+		stats->seconds += Trace_wall() - start;
+
+		changed |= did;
+	}
+
+	Analyses_clear(analyses);
+
+	return changed;
+}
+
+bool PassManager_run_lowered(PassManager* manager, Procedure* function, PassContext* context) {
+
+	Analyses* analyses = &manager->lowered;
+
+	Analyses_clear(analyses);
+	analyses->procedure = function;
+
+	for (size_t i = 0; i < manager->npasses; ++i) {
+
+		Pass const* pass  = manager->passes[i];
+		PassStats*  stats = &manager->stats[i];
+
+		if (!pass->lowered) continue;
+
+		double start = Trace_wall();
+		bool   did   = false;
+		bool   ok    = true;
+
+		Trace_begin("pass", pass->name);
+
+		for (int a = 0; a < Analysis_COUNT && ok; ++a) {
+			if (pass->requires & ANALYSIS(a)) ok = Analyses_get(analyses, a) != NULL;
+		}
+
+		ok = ok && pass->lowered(function, analyses, context, &did);
+		if (did) Analyses_drop(analyses, pass->invalidates);
+
+		Trace_end("pass", pass->name);
+
+		stats->runs    += 1;
+		stats->changed += did;
+		stats->seconds += Trace_wall() - start;
+
+		if (!ok) return false;
+	}
+
+	return true;
+}
+
+void PassManager_release(PassManager* manager) {
+	Analyses_clear(&manager->analyses);
+	Analyses_clear(&manager->lowered);
+}
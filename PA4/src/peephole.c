@@ -0,0 +1,234 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include "../include/peephole.h"
+
+#define WINDOW    4
+#define VARIABLES 26
+
+/* what the variables %A to %Z of a rule stand for, as places in the operand pool */
+typedef struct Bindings {
+	bool   bound[VARIABLES];
+	size_t at[VARIABLES];
+} Bindings;
+
+/* an instruction with the mnemonic op, or a label when op is empty, and up to three operands
+   that are either %A to %Z, which match any operand but the same one everywhere, or literal text */
+typedef struct Pattern {
+	char const* op;
+	char const* operands[ASM_OPERANDS];
+} Pattern;
+
+typedef struct RuleInfo {
+
+	char const* name;
+
+	size_t      length;
+	Pattern     match[WINDOW];
+
+	/* what the matched instructions become, never more of them */
+	size_t      count;
+	Pattern     replace[WINDOW];
+
+	/* a further condition on the bindings */
+	bool      (*guard)(Asm* code, Bindings* bindings);
+
+} RuleInfo;
+
+static char const* text(Asm const* code, Bindings const* bindings, char variable) {
+	return code->text + bindings->at[variable - 'A'];
+}
+
+/* loading %A does not move the address %M */
+static bool other_base(Asm* code, Bindings* bindings) {
+
+	char const* m    = text(code, bindings, 'M');
+	char const* base = strchr(m, '(');
+
+	if (!base) return true;
+
+	size_t length = strlen(text(code, bindings, 'A'));
+	return strncmp(base + 1, text(code, bindings, 'A'), length) != 0 || base[1 + length] != ')';
+}
+
+/* %A = %B + %C leaves both of them as they were, so working it out again gives the same */
+static bool same_sum(Asm* code, Bindings* bindings) {
+
+	char const* a = text(code, bindings, 'A');
+	return strcmp(a, text(code, bindings, 'B')) != 0 && strcmp(a, text(code, bindings, 'C')) != 0;
+}
+
+/* the first of two moves into %A is only dead when the second does not read it */
+static bool other_source(Asm* code, Bindings* bindings) {
+	return strcmp(text(code, bindings, 'A'), text(code, bindings, 'C')) != 0;
+}
+
+/*
+ * Only sequences the IR backend emits: a value moved straight back where it
+ * came from, a $v1 element address worked out again around the store it was
+ * for, a word stored or loaded twice in a row, and writes overwritten by the
+ * next instruction. None of them drops an instruction that could trap.
+ */
+static RuleInfo const RULES[Rule_COUNT] = {
+
+	[Rule_MOVE_BACK] = { "move-back",
+		2, { { "move", { "%A", "%B" } }, { "move", { "%B", "%A" } } },
+		1, { { "move", { "%A", "%B" } } },
+		NULL },
+
+	[Rule_SAME_ADDRESS] = { "same-address",
+		3, { { "addu", { "%A", "%B", "%C" } }, { "sw", { "%D", "%M" } }, { "addu", { "%A", "%B", "%C" } } },
+		2, { { "addu", { "%A", "%B", "%C" } }, { "sw", { "%D", "%M" } } },
+		same_sum },
+
+	[Rule_STORE_STORE] = { "store-store",
+		2, { { "sw", { "%A", "%M" } }, { "sw", { "%B", "%M" } } },
+		1, { { "sw", { "%B", "%M" } } },
+		NULL },
+
+	[Rule_LOAD_LOAD] = { "load-load",
+		2, { { "lw", { "%A", "%M" } }, { "lw", { "%B", "%M" } } },
+		2, { { "lw", { "%A", "%M" } }, { "move", { "%B", "%A" } } },
+		other_base },
+
+	[Rule_LOAD_STORE] = { "load-store",
+		2, { { "lw", { "%A", "%M" } }, { "sw", { "%A", "%M" } } },
+		1, { { "lw", { "%A", "%M" } } },
+		other_base },
+
+	[Rule_LI_LOAD] = { "li-load",
+		2, { { "li", { "%A", "%K" } }, { "lw", { "%A", "%M" } } },
+		1, { { "lw", { "%A", "%M" } } },
+		other_base },
+
+	[Rule_LI_LI] = { "li-li",
+		2, { { "li", { "%A", "%J" } }, { "li", { "%A", "%K" } } },
+		1, { { "li", { "%A", "%K" } } },
+		NULL },
+
+	[Rule_MOVE_LI] = { "move-li",
+		2, { { "move", { "%A", "%B" } }, { "li", { "%A", "%K" } } },
+		1, { { "li", { "%A", "%K" } } },
+		NULL },
+
+	[Rule_MOVE_MOVE] = { "move-move",
+		2, { { "move", { "%A", "%B" } }, { "move", { "%A", "%C" } } },
+		1, { { "move", { "%A", "%C" } } },
+		other_source },
+
+	[Rule_MFLO_LI] = { "mflo-li",
+		2, { { "mflo", { "%A" } }, { "li", { "%A", "%K" } } },
+		1, { { "li", { "%A", "%K" } } },
+		NULL },
+};
+
+char const* Rule_to_string(Rule rule) {
+	return rule < Rule_COUNT ? RULES[rule].name : "???";
+}
+
+static bool variable(char const* operand) {
+	return operand[0] == '%' && operand[1] >= 'A' && operand[1] <= 'Z' && !operand[2];
+}
+
+static int noperands(Pattern const* pattern) {
+	int count = 0;
+	while (count < ASM_OPERANDS && pattern->operands[count]) ++count;
+	return count;
+}
+
+static bool match(Asm const* code, size_t at, RuleInfo const* rule, Bindings* bindings) {
+
+	if (at + rule->length > code->count) return false;
+
+	memset(bindings->bound, 0, sizeof bindings->bound);
+
+	for (size_t i = 0; i < rule->length; ++i) {
+
+		Insn const*    insn    = &code->code[at + i];
+		Pattern const* pattern = &rule->match[i];
+
+		if (strcmp(insn->op, pattern->op) != 0 || insn->noperands != noperands(pattern)) return false;
+
+		for (int k = 0; k < insn->noperands; ++k) {
+
+			char const* operand = Asm_operand(code, insn, k);
+			char const* wanted  = pattern->operands[k];
+
+			if (!variable(wanted)) {
+				if (strcmp(operand, wanted) != 0) return false;
+				continue;
+			}
+
+			int v = wanted[1] - 'A';
+
+			if (bindings->bound[v]) {
+				if (strcmp(operand, code->text + bindings->at[v]) != 0) return false;
+			} else {
+				bindings->bound[v] = true;
+				bindings->at[v]    = insn->operands[k];
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool rewrite(Asm* code, size_t at, RuleInfo const* rule, Bindings const* bindings) {
+
+	Insn replacement[WINDOW];
+
+	for (size_t i = 0; i < rule->count; ++i) {
+
+		Pattern const* pattern = &rule->replace[i];
+		Insn*          insn    = &replacement[i];
+
+		strcpy(insn->op, pattern->op);
+		insn->noperands = noperands(pattern);
+
+		for (int k = 0; k < insn->noperands; ++k) {
+
+			char const* operand = pattern->operands[k];
+
+			if (variable(operand)) insn->operands[k] = bindings->at[operand[1] - 'A'];
+			else if (!Asm_intern(code, operand, strlen(operand), &insn->operands[k])) return false;
+		}
+	}
+
+	memmove(&code->code[at + rule->count], &code->code[at + rule->length],
+		(code->count - at - rule->length) * sizeof (Insn));
+	memcpy(&code->code[at], replacement, rule->count * sizeof (Insn));
+
+	code->count -= rule->length - rule->count;
+	return true;
+}
+
+void Peephole_run(Asm* code, size_t fired[Rule_COUNT]) {
+
+	Bindings bindings;
+	size_t   at = 0;
+
+	while (at < code->count && !code->failed) {
+
+		int r = 0;
+
+		while (r < Rule_COUNT) {
+
+			RuleInfo const* rule = &RULES[r];
+
+			if (match(code, at, rule, &bindings) && (!rule->guard || rule->guard(code, &bindings))
+			    && rewrite(code, at, rule, &bindings)) break;
+
+			++r;
+		}
+
+		if (r == Rule_COUNT) {
+			++at;
+			continue;
+		}
+
+		if (fired) ++fired[r];
+
+		/* what was rewritten may now complete a window that starts a little earlier */
+		at = at >= WINDOW - 1 ? at - (WINDOW - 1) : 0;
+	}
+}
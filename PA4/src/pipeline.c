@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+#include "../include/str.h"
+#include "../include/pair.h"
+#include "../include/memory.h"
+#include "../include/ring.h"
+#include "../include/trace.h"
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "../include/semantics.h"
+#include "../include/codegen.h"
+#include "../include/passes.h"
+#include "../include/pipeline.h"
+
+/* tokens are small and plentiful, declarations are few and large */
+#define TOKEN_RING       1024
+#define DECLARATION_RING 64
+
+#define STAGES (Phase_CODEGEN + 1)
+
+typedef struct Pipeline {
+
+	Source*               source;
+	Sink                  sink;
+	void*                 state;
+	Allocator const*      allocator;
+	PassManager*          passes;
+	CodegenOptions const* codegen;
+
+	/* lexer to parser carries single TokenList nodes, the rest carry trees */
+	Ring                  tokens;
+	Ring                  parsed;
+	Ring                  checked;
+	Ring                  optimized;
+
+	/* raised on the first error so the lexer stops reading */
+	atomic_bool           stop;
+
+	/* each slot is only written by its own stage, and read after the join */
+	bool                  failed[STAGES];
+	Diagnostic            errors[STAGES];
+	char*                 text;
+	size_t                size;
+
+	size_t                items[STAGES];
+	double                seconds[STAGES];
+
+} Pipeline;
+
+static void fail(Pipeline* p, Phase phase, int code, int lineno, char const* message) {
+	p->failed[phase]         = true;
+	p->errors[phase].phase   = phase;
+	p->errors[phase].code    = code;
+	p->errors[phase].lineno  = lineno;
+	p->errors[phase].message = message;
+	atomic_store(&p->stop, true);
+}
+
+/* every stage draws from the compile's allocator, a thread of its own would start out on the default one */
+static Pipeline* enter(void* arg) {
+	Pipeline* p = arg;
+	Memory_use(p->allocator);
+	return p;
+}
+
+static int lexer_stage(void* arg) {
+
+	Pipeline* p     = enter(arg);
+	double    start = Trace_wall();
+
+	Token* token = Token_new();
+	if (!token) {
+		fail(p, Phase_LEXER, 0, 0, "out of memory");
+		goto done;
+	}
+
+	while (!atomic_load_explicit(&p->stop, memory_order_relaxed) && lex(p->source, token)) {
+
+		TokenList* node = Memory_alloc(MemoryTag_TOKENLIST, sizeof (TokenList));
+		if (!node) {
+			fail(p, Phase_LEXER, 0, token->lineno, "out of memory");
+			break;
+		}
+
+		node->value        = *token;
+		node->value.lexeme = Str_dup(token->lexeme);
+		node->next         = NULL;
+
+		Ring_push(&p->tokens, node);
+		++p->items[Phase_LEXER];
+	}
+
+	Token_free(token);
+
+done:
+	Ring_push(&p->tokens, NULL);
+	p->seconds[Phase_LEXER] = Trace_wall() - start;
+	return 0;
+}
+
+/* hand one declaration's worth of tokens on as a tree */
+static bool parse_tokens(Pipeline* p, TokenList* tokens) {
+
+	TokenList* bad = lexinvalid(tokens);
+	if (bad) {
+		snprintf(p->text, p->size, "invalid token \"%s\"", bad->value.lexeme->buffer);
+		fail(p, Phase_LEXER, TokenType_ERR, bad->value.lineno, p->text);
+		return false;
+	}
+
+	Pair* ast = parse_declaration(tokens);
+	if (!ast) {
+		fail(p, Phase_PARSER, 0, parse_lineno(), "syntax error");
+		return false;
+	}
+
+	Ring_push(&p->parsed, ast);
+	++p->items[Phase_PARSER];
+	return true;
+}
+
+static int parser_stage(void* arg) {
+
+	Pipeline*  p      = enter(arg);
+	double     start  = Trace_wall();
+	bool       ok     = true;
+	TokenList* first  = NULL;
+	TokenList* last   = NULL;
+	int        depth  = 0;
+	TokenList* node;
+
+	while ((node = Ring_pop(&p->tokens))) {
+
+		/* after an error keep draining so the lexer never blocks */
+		if (!ok) {
+			lexfree(node);
+			continue;
+		}
+
+		if (last) last->next = node;
+		else      first      = node;
+		last = node;
+
+		if (!lexboundary(&node->value, &depth)) continue;
+
+		ok = parse_tokens(p, first);
+		if (!ok) Ring_push(&p->parsed, NULL);
+
+		lexfree(first);
+		first = last = NULL;
+		depth = 0;
+	}
+
+	/* a declaration cut short by the end of the input, unless an error downstream is what stopped the lexer */
+	if (ok && first && !atomic_load(&p->stop)) {
+		ok = parse_tokens(p, first);
+		if (!ok) Ring_push(&p->parsed, NULL);
+	}
+
+	lexfree(first);
+
+	/* unless it was ended on an error already, the checker may still be draining it */
+	if (ok) Ring_push(&p->parsed, NULL);
+	p->seconds[Phase_PARSER] = Trace_wall() - start;
+	return 0;
+}
+
+static int checker_stage(void* arg) {
+
+	Pipeline* p     = enter(arg);
+	double    start = Trace_wall();
+	bool      ok    = true;
+	Semantic  s;
+	Pair*     ast;
+
+	Checker* checker = Checker_new();
+	if (!checker) {
+		fail(p, Phase_SEMANTICS, 0, 0, "out of memory");
+		ok = false;
+		Ring_push(&p->checked, NULL);
+	}
+
+	while ((ast = Ring_pop(&p->parsed))) {
+
+		if (!ok) {
+			Pair_free(ast);
+			continue;
+		}
+
+		s = Checker_declaration(checker, ast);
+		if (s != Semantic_OK) {
+			fail(p, Phase_SEMANTICS, s, 0, Semantic_to_string(s));
+			Pair_free(ast);
+			Ring_push(&p->checked, NULL);
+			ok = false;
+			continue;
+		}
+
+		Ring_push(&p->checked, ast);
+		++p->items[Phase_SEMANTICS];
+	}
+
+	/* only now is it known whether main came last, unless the parser gave up */
+	if (ok && !p->failed[Phase_LEXER] && !p->failed[Phase_PARSER]) {
+		s = Checker_finish(checker);
+		if (s != Semantic_OK) fail(p, Phase_SEMANTICS, s, 0, Semantic_to_string(s));
+	}
+
+	Checker_free(checker);
+
+	if (ok) Ring_push(&p->checked, NULL);
+	p->seconds[Phase_SEMANTICS] = Trace_wall() - start;
+	return 0;
+}
+
+static int optimizer_stage(void* arg) {
+
+	Pipeline* p     = enter(arg);
+	double    start = Trace_wall();
+	Pair*     ast;
+
+	/* nothing here can fail, so this only ever forwards the end of the stream */
+	while ((ast = Ring_pop(&p->checked))) {
+
+		if (ast->val == ASType_FUN_DECLARATION) {
+			PassManager_run(p->passes, ast);
+		}
+
+		Ring_push(&p->optimized, ast);
+		++p->items[Phase_OPTIMIZER];
+	}
+
+	Ring_push(&p->optimized, NULL);
+	p->seconds[Phase_OPTIMIZER] = Trace_wall() - start;
+	return 0;
+}
+
+static void flush(Pipeline* p, Str* out) {
+	p->sink(p->state, out->buffer, out->length);
+	Str_clear(out);
+}
+
+static int codegen_stage(void* arg) {
+
+	Pipeline* p     = enter(arg);
+	double    start = Trace_wall();
+	Pair*     ast;
+
+	Str*     out = Str_new(4096);
+	Codegen* gen = out ? codegen_begin(out, p->codegen) : NULL;
+
+	if (!gen) fail(p, Phase_CODEGEN, 0, 0, "out of memory");
+	else      flush(p, out);
+
+	while ((ast = Ring_pop(&p->optimized))) {
+
+		if (gen && !p->failed[Phase_CODEGEN]) {
+			if (codegen_declaration(gen, out, ast)) {
+				flush(p, out);
+				++p->items[Phase_CODEGEN];
+			} else {
+				fail(p, Phase_CODEGEN, 0, 0, "out of memory");
+			}
+		}
+
+		Pair_free(ast);
+	}
+
+	/* every upstream error was recorded before the end of the stream reached here */
+	bool ok = gen != NULL;
+	for (int i = 0; i <= Phase_CODEGEN; ++i) {
+		if (p->failed[i]) ok = false;
+	}
+
+	if (ok) {
+		codegen_end(gen, out);
+		flush(p, out);
+	} else {
+		codegen_abandon(gen);
+	}
+
+	if (out) Str_free(out);
+
+	p->seconds[Phase_CODEGEN] = Trace_wall() - start;
+	return 0;
+}
+
+static void collect(Pipeline* p, PipelineStats* stats) {
+
+	Ring* inputs[STAGES]  = { NULL, &p->tokens, &p->parsed, &p->checked, &p->optimized };
+	Ring* outputs[STAGES] = { &p->tokens, &p->parsed, &p->checked, &p->optimized, NULL };
+
+	for (int i = 0; i < STAGES; ++i) {
+
+		StageStats* stage = &stats->stages[i];
+
+		stage->items           = p->items[i];
+		stage->seconds         = p->seconds[i];
+		stage->starved         = inputs[i]  ? inputs[i]->empty_stalls  : 0;
+		stage->starved_seconds = inputs[i]  ? inputs[i]->empty_seconds : 0;
+		stage->blocked         = outputs[i] ? outputs[i]->full_stalls  : 0;
+		stage->blocked_seconds = outputs[i] ? outputs[i]->full_seconds : 0;
+	}
+}
+
+bool pipeline(Source* source, Sink sink, void* state, Allocator const* allocator, PassManager* passes, CodegenOptions const* codegen, PipelineStats* stats, Diagnostic* error, char* text, size_t size) {
+
+	static thrd_start_t const stages[STAGES] = {
+		lexer_stage, parser_stage, checker_stage, optimizer_stage, codegen_stage
+	};
+
+	Pipeline p = {
+		.source = source, .sink = sink, .state = state, .allocator = allocator, .passes = passes, .codegen = codegen, .text = text, .size = size
+	};
+	atomic_init(&p.stop, false);
+
+	thrd_t threads[STAGES];
+	int    started = STAGES;
+
+	if (!Ring_init(&p.tokens, TOKEN_RING)) goto fail_0;
+	if (!Ring_init(&p.parsed, DECLARATION_RING)) goto fail_1;
+	if (!Ring_init(&p.checked, DECLARATION_RING)) goto fail_2;
+	if (!Ring_init(&p.optimized, DECLARATION_RING)) goto fail_3;
+
+	/* start from the back so a stage that cannot start can be stood in for by ending its output */
+	Ring* outputs[STAGES] = { &p.tokens, &p.parsed, &p.checked, &p.optimized, NULL };
+
+	while (started > 1) {
+
+		int i = started - 1;
+
+		if (thrd_create(&threads[i], stages[i], &p) != thrd_success) {
+			fail(&p, i, 0, 0, "could not start thread");
+			if (outputs[i]) Ring_push(outputs[i], NULL);
+			break;
+		}
+
+		--started;
+	}
+
+	/* the lexer runs on the calling thread */
+	if (started == 1) lexer_stage(&p);
+
+	for (int i = started; i < STAGES; ++i) {
+		thrd_join(threads[i], NULL);
+	}
+
+	if (stats) collect(&p, stats);
+
+	Ring_release(&p.optimized);
+	Ring_release(&p.checked);
+	Ring_release(&p.parsed);
+	Ring_release(&p.tokens);
+
+	/* a later phase only ever sees earlier declarations, so its error comes first in the source */
+	for (int i = STAGES - 1; i >= 0; --i) {
+		if (p.failed[i]) {
+			*error = p.errors[i];
+			return false;
+		}
+	}
+
+	return true;
+
+fail_3:
+	Ring_release(&p.checked);
+fail_2:
+	Ring_release(&p.parsed);
+fail_1:
+	Ring_release(&p.tokens);
+fail_0:
+	error->phase   = Phase_CODEGEN;
+	error->code    = 0;
+	error->lineno  = 0;
+	error->message = "out of memory";
+	return false;
+}
@@ -0,0 +1,855 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "../include/memory.h"
+#include "../include/propagate.h"
+
+/* what is known of a value, which only ever goes down from UNKNOWN through CONSTANT to VARYING */
+typedef enum Level {
+	Level_UNKNOWN, Level_CONSTANT, Level_VARYING
+} Level;
+
+/* a definition of the SSA form, by an instruction, by a phi, or the one every register has on entry */
+typedef struct Def {
+	Level level;
+	int   constant;
+
+	/* a phi that is no constant reads it on a taken edge, so the register has to hold it even when it is one */
+	bool  merged;
+} Def;
+
+/* where definitions of vreg meet at the start of block, the definition reaching from each predecessor from args[arg] on */
+typedef struct Phi {
+	int    block;
+	int    vreg;
+	int    def;
+	size_t arg;
+	int    next;
+} Phi;
+
+typedef struct Propagation {
+
+	Procedure* function;
+	Block**    blocks;
+	size_t     n;
+
+	/* by block id, where the block is in blocks */
+	int*       index;
+
+	/* the instructions numbered through the blocks, those of blocks[b] from start[b] on, and the block of each */
+	size_t*    start;
+	int*       owner;
+	size_t     ninstrs;
+
+	/* the definition each operand of an instruction reads, from reads[first[i]] on, -1 for none */
+	size_t*    first;
+	int*       reads;
+
+	/* the definition each instruction makes, -1 for none */
+	int*       made;
+
+	Def*       defs;
+	size_t     ndefs;
+	size_t     dcapacity;
+
+	Phi*       phis;
+	size_t     nphis;
+	size_t     pcapacity;
+	int*       args;
+
+	/* the first phi of each block, -1 for none */
+	int*       head;
+
+	/* the instructions and phis reading each definition from users[ufirst[d]] on, phi p as -(p + 1) */
+	size_t*    ufirst;
+	int*       users;
+
+	/* the blocks found to run, and the edges found to be taken, two per block */
+	bool*      live;
+	bool*      taken;
+
+	int*       edges;
+	size_t     nedges;
+
+	int*       lowered;
+	size_t     nlowered;
+
+} Propagation;
+
+/* room for one more element, false when there is none */
+static bool room(void** array, size_t* capacity, size_t count, size_t size) {
+
+	if (count < *capacity) return true;
+
+	size_t bigger = *capacity ? *capacity * 2 : 16;
+	void*  larger = Memory_realloc(MemoryTag_IR, *array, bigger * size);
+
+	if (!larger) return false;
+
+	*array    = larger;
+	*capacity = bigger;
+
+	return true;
+}
+
+static int define(Propagation* p, Level level) {
+
+	if (!room((void**) &p->defs, &p->dcapacity, p->ndefs, sizeof (Def))) return -1;
+
+	p->defs[p->ndefs] = (Def) { level, 0, false };
+	return (int) p->ndefs++;
+}
+
+static Instr* instruction(Propagation const* p, size_t i) {
+	return &p->blocks[p->owner[i]]->code[i - p->start[p->owner[i]]];
+}
+
+/* the result of op on constants, false when the instruction would trap instead or is no arithmetic */
+static bool fold(Op op, int x, int y, int imm, int* result) {
+
+	long long wide;
+
+	switch (op) {
+
+		case Op_COPY: *result = x;      return true;
+		case Op_LT:   *result = x < y;  return true;
+		case Op_LE:   *result = x <= y; return true;
+		case Op_GT:   *result = x > y;  return true;
+		case Op_GE:   *result = x >= y; return true;
+		case Op_EQ:   *result = x == y; return true;
+		case Op_NE:   *result = x != y; return true;
+
+		case Op_ADD: case Op_SUB:
+			wide = op == Op_ADD ? (long long) x + y : (long long) x - y;
+			if (wide < INT_MIN || wide > INT_MAX) return false;
+			*result = (int) wide;
+			return true;
+
+		/* mult keeps the low word, addu and sll wrap */
+		case Op_MUL:  *result = (int) ((unsigned) x * (unsigned) y);    return true;
+		case Op_ADDU: *result = (int) ((unsigned) x + (unsigned) y);    return true;
+		case Op_SLL:  *result = (int) ((unsigned) x << (imm & 31));     return true;
+
+		case Op_DIV:
+			if (y == 0 || (x == INT_MIN && y == -1)) return false;
+			*result = x / y;
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+static Def known(Propagation const* p, size_t i, size_t k, Operand operand) {
+
+	if (operand.kind == OperandKind_CONST) return (Def) { Level_CONSTANT, operand.value, false };
+	if (operand.kind == OperandKind_NONE)  return (Def) { Level_CONSTANT, 0, false };
+
+	return p->defs[p->reads[p->first[i] + k]];
+}
+
+static Def meet(Def x, Def y) {
+
+	if (x.level == Level_UNKNOWN) return y;
+	if (y.level == Level_UNKNOWN) return x;
+
+	if (x.level == Level_CONSTANT && y.level == Level_CONSTANT && x.constant == y.constant) return x;
+	return (Def) { Level_VARYING, 0, false };
+}
+
+static void lower(Propagation* p, int d, Def to) {
+
+	Def* def = &p->defs[d];
+
+	if (to.level == Level_UNKNOWN || def->level == Level_VARYING) return;
+	if (def->level == Level_CONSTANT && to.level == Level_CONSTANT && def->constant == to.constant) return;
+
+	/* a constant that changes is no constant */
+	if (def->level == Level_CONSTANT) to.level = Level_VARYING;
+
+	def->level    = to.level;
+	def->constant = to.constant;
+
+	p->lowered[p->nlowered++] = d;
+}
+
+static void follow(Propagation* p, int b, int s) {
+
+	if (p->taken[2 * b + s]) return;
+
+	p->taken[2 * b + s]    = true;
+	p->edges[p->nedges++] = 2 * b + s;
+}
+
+/* whether an edge from pred to block has been found to be taken */
+static bool crossed(Propagation const* p, Block const* pred, Block const* block) {
+
+	Block* successors[2];
+	int    count = Block_successors(pred, successors);
+	int    b     = p->index[pred->id];
+
+	for (int s = 0; s < count; ++s) {
+		if (successors[s] == block && p->taken[2 * b + s]) return true;
+	}
+
+	return false;
+}
+
+static void evaluate_phi(Propagation* p, Phi const* phi) {
+
+	Block const* block  = p->blocks[phi->block];
+	Def          merged = { Level_UNKNOWN, 0, false };
+
+	for (size_t i = 0; i < block->npreds; ++i) {
+		if (crossed(p, block->preds[i], block)) merged = meet(merged, p->defs[p->args[phi->arg + i]]);
+	}
+
+	lower(p, phi->def, merged);
+}
+
+static void evaluate(Propagation* p, size_t i) {
+
+	Instr const* instr = instruction(p, i);
+	int          b     = p->owner[i];
+
+	Def x = known(p, i, 0, instr->a);
+	Def y = known(p, i, 1, instr->b);
+
+	switch (instr->op) {
+
+		case Op_JUMP:
+			follow(p, b, 0);
+			return;
+
+		case Op_BRANCH: {
+
+			Block* successors[2];
+			int    count = Block_successors(p->blocks[b], successors);
+			int    holds;
+
+			if (x.level == Level_UNKNOWN || y.level == Level_UNKNOWN) return;
+
+			if (x.level == Level_VARYING || y.level == Level_VARYING || !fold((Op) instr->imm, x.constant, y.constant, 0, &holds)) {
+				for (int s = 0; s < count; ++s) follow(p, b, s);
+			} else {
+				follow(p, b, count == 2 && !holds ? 1 : 0);
+			}
+
+			return;
+		}
+
+		default:
+			break;
+	}
+
+	if (p->made[i] < 0) return;
+
+	Def result = { Level_VARYING, 0, false };
+	int folded;
+
+	switch (instr->op) {
+
+		case Op_COPY: case Op_ADD: case Op_SUB: case Op_MUL: case Op_DIV:
+		case Op_LT: case Op_LE: case Op_GT: case Op_GE: case Op_EQ: case Op_NE:
+		case Op_ADDU: case Op_SLL:
+
+			if (x.level == Level_VARYING || y.level == Level_VARYING) break;
+
+			if (x.level == Level_UNKNOWN || y.level == Level_UNKNOWN) {
+				result.level = Level_UNKNOWN;
+			} else if (fold(instr->op, x.constant, y.constant, instr->imm, &folded)) {
+				result.level    = Level_CONSTANT;
+				result.constant = folded;
+			}
+
+			break;
+
+		/* what memory, a parameter or a call gives, and addresses, are not known here */
+		default:
+			break;
+	}
+
+	lower(p, p->made[i], result);
+}
+
+/* every instruction and phi of a block, when an edge to it is first taken, or only the phis after */
+static void arrive(Propagation* p, int b) {
+
+	for (int phi = p->head[b]; phi >= 0; phi = p->phis[phi].next) evaluate_phi(p, &p->phis[phi]);
+
+	if (p->live[b]) return;
+
+	p->live[b] = true;
+
+	for (size_t i = p->start[b]; i < p->start[b + 1]; ++i) evaluate(p, i);
+}
+
+static void propagate(Propagation* p) {
+
+	arrive(p, 0);
+
+	while (p->nedges || p->nlowered) {
+
+		if (p->nedges) {
+
+			int    edge = p->edges[--p->nedges];
+			Block* successors[2];
+
+			Block_successors(p->blocks[edge / 2], successors);
+			arrive(p, p->index[successors[edge % 2]->id]);
+			continue;
+		}
+
+		int d = p->lowered[--p->nlowered];
+
+		for (size_t u = p->ufirst[d]; u < p->ufirst[d + 1]; ++u) {
+
+			int user = p->users[u];
+
+			if (user >= 0) {
+				if (p->live[p->owner[user]]) evaluate(p, (size_t) user);
+			} else {
+				Phi const* phi = &p->phis[-user - 1];
+				if (p->live[phi->block]) evaluate_phi(p, phi);
+			}
+		}
+	}
+}
+
+/*
+ * The blocks where the definitions of each register meet, the iterated
+ * dominance frontier of the blocks writing it. A register written once and
+ * only read after that in the same block needs none.
+ */
+static bool place(Propagation* p) {
+
+	size_t nvregs = p->function->nvregs;
+	size_t n      = p->n;
+	bool   ok     = false;
+
+	bool*   written  = Memory_calloc(MemoryTag_IR, nvregs ? nvregs : 1, sizeof (bool));
+	bool*   global   = Memory_calloc(MemoryTag_IR, nvregs ? nvregs : 1, sizeof (bool));
+	int*    where    = Memory_alloc(MemoryTag_IR, (nvregs ? nvregs : 1) * sizeof (int));
+	size_t* wfirst   = Memory_calloc(MemoryTag_IR, nvregs + 1, sizeof (size_t));
+	int*    wblocks  = Memory_alloc(MemoryTag_IR, (p->ninstrs ? p->ninstrs : 1) * sizeof (int));
+	size_t* ffirst   = Memory_calloc(MemoryTag_IR, n + 1, sizeof (size_t));
+	int*    frontier = NULL;
+	int*    pairs    = NULL;
+	size_t  npairs   = 0;
+	size_t  capacity = 0;
+	int*    worklist = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (int));
+	int*    queued   = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (int));
+	int*    placed   = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (int));
+
+	if (!written || !global || !where || !wfirst || !wblocks || !ffirst || !worklist || !queued || !placed) goto done;
+
+	/* in layout order, a read in another block or before the write is caught either way */
+	for (size_t i = 0; i < p->ninstrs; ++i) {
+
+		Instr*   instr = instruction(p, i);
+		Operand* operand;
+
+		for (size_t k = 0; (operand = Instr_use(instr, k)); ++k) {
+
+			int v = operand->kind == OperandKind_VREG ? operand->value : -1;
+			if (v >= 0 && (!written[v] || where[v] != p->owner[i])) global[v] = true;
+		}
+
+		if (instr->dst < 0) continue;
+
+		if (written[instr->dst]) global[instr->dst] = true;
+
+		written[instr->dst] = true;
+		where[instr->dst]   = p->owner[i];
+		++wfirst[instr->dst + 1];
+	}
+
+	/* the blocks writing each register, from wblocks[wfirst[v]] on */
+	for (size_t v = 0; v < nvregs; ++v) wfirst[v + 1] += wfirst[v];
+
+	for (size_t i = 0; i < p->ninstrs; ++i) {
+
+		int dst = instruction(p, i)->dst;
+		if (dst >= 0) wblocks[wfirst[dst]++] = p->owner[i];
+	}
+
+	for (size_t v = nvregs; v-- > 0;) wfirst[v + 1] = wfirst[v];
+	wfirst[0] = 0;
+
+	/* a join is in the frontier of each block on the way up from a predecessor to its immediate dominator */
+	for (size_t b = 0; b < n; ++b) {
+
+		Block const* block = p->blocks[b];
+		if (block->npreds < 2) continue;
+
+		for (size_t q = 0; q < block->npreds; ++q) {
+
+			for (Block const* runner = block->preds[q]; runner && runner != block->idom; runner = runner->idom) {
+
+				if (!room((void**) &pairs, &capacity, npairs + 1, 2 * sizeof (int))) goto done;
+
+				pairs[2 * npairs]     = p->index[runner->id];
+				pairs[2 * npairs + 1] = (int) b;
+				++ffirst[p->index[runner->id] + 1];
+				++npairs;
+			}
+		}
+	}
+
+	frontier = Memory_alloc(MemoryTag_IR, (npairs ? npairs : 1) * sizeof (int));
+	if (!frontier) goto done;
+
+	for (size_t b = 0; b < n; ++b) ffirst[b + 1] += ffirst[b];
+
+	for (size_t i = 0; i < npairs; ++i) frontier[ffirst[pairs[2 * i]]++] = pairs[2 * i + 1];
+
+	for (size_t b = n; b-- > 0;) ffirst[b + 1] = ffirst[b];
+	ffirst[0] = 0;
+
+	for (size_t b = 0; b < n; ++b) queued[b] = placed[b] = -1;
+
+	for (size_t v = 0; v < nvregs; ++v) {
+
+		if (!global[v]) continue;
+
+		size_t count = 0;
+
+		for (size_t w = wfirst[v]; w < wfirst[v + 1]; ++w) {
+			if (queued[wblocks[w]] != (int) v) {
+				queued[wblocks[w]]  = (int) v;
+				worklist[count++] = wblocks[w];
+			}
+		}
+
+		while (count) {
+
+			int x = worklist[--count];
+
+			for (size_t f = ffirst[x]; f < ffirst[x + 1]; ++f) {
+
+				int y = frontier[f];
+
+				if (placed[y] != (int) v) {
+
+					placed[y] = (int) v;
+
+					int def = define(p, Level_UNKNOWN);
+					if (def < 0 || !room((void**) &p->phis, &p->pcapacity, p->nphis, sizeof (Phi))) goto done;
+
+					p->phis[p->nphis] = (Phi) { y, (int) v, def, 0, p->head[y] };
+					p->head[y]        = (int) p->nphis++;
+				}
+
+				if (queued[y] != (int) v) {
+					queued[y]         = (int) v;
+					worklist[count++] = y;
+				}
+			}
+		}
+	}
+
+	ok = true;
+
+done:
+	Memory_free(written);
+	Memory_free(global);
+	Memory_free(where);
+	Memory_free(wfirst);
+	Memory_free(wblocks);
+	Memory_free(ffirst);
+	Memory_free(frontier);
+	Memory_free(pairs);
+	Memory_free(worklist);
+	Memory_free(queued);
+	Memory_free(placed);
+
+	return ok;
+}
+
+/* what a block of the dominator tree being renamed had to undo, and the next child to go down to */
+typedef struct Visit {
+	int    block;
+	size_t child;
+	size_t nchanges;
+} Visit;
+
+/*
+ * Gives each write a definition of its own and each read the definition
+ * reaching it, going down the dominator tree with the latest definition of
+ * every register, which starts out as the one it has on entry.
+ */
+static bool rename(Propagation* p) {
+
+	size_t nvregs   = p->function->nvregs;
+	size_t n        = p->n;
+	size_t nchanges = 0;
+	size_t depth    = 0;
+	bool   ok       = false;
+
+	int*    current  = Memory_calloc(MemoryTag_IR, nvregs ? nvregs : 1, sizeof (int));
+	int*    changes  = NULL;
+	size_t  capacity = 0;
+	size_t* kfirst   = Memory_calloc(MemoryTag_IR, n + 1, sizeof (size_t));
+	int*    kids     = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (int));
+	Visit*  stack    = Memory_alloc(MemoryTag_IR, (n ? n : 1) * sizeof (Visit));
+
+	if (!current || !kfirst || !kids || !stack) goto done;
+
+	/* the children of each block in the dominator tree, in layout order */
+	for (size_t b = 1; b < n; ++b) ++kfirst[p->index[p->blocks[b]->idom->id] + 1];
+	for (size_t b = 0; b < n; ++b) kfirst[b + 1] += kfirst[b];
+
+	for (size_t b = 1; b < n; ++b) kids[kfirst[p->index[p->blocks[b]->idom->id]]++] = (int) b;
+
+	for (size_t b = n; b-- > 0;) kfirst[b + 1] = kfirst[b];
+	kfirst[0] = 0;
+
+	stack[depth++] = (Visit) { 0, 0, 0 };
+
+	for (bool entering = true; depth;) {
+
+		Visit* top = &stack[depth - 1];
+		int    b   = top->block;
+
+		if (entering) {
+
+			for (int phi = p->head[b]; phi >= 0; phi = p->phis[phi].next) {
+
+				if (!room((void**) &changes, &capacity, nchanges + 1, 2 * sizeof (int))) goto done;
+
+				changes[2 * nchanges]     = p->phis[phi].vreg;
+				changes[2 * nchanges + 1] = current[p->phis[phi].vreg];
+				++nchanges;
+
+				current[p->phis[phi].vreg] = p->phis[phi].def;
+			}
+
+			for (size_t i = p->start[b]; i < p->start[b + 1]; ++i) {
+
+				Instr*   instr = instruction(p, i);
+				Operand* operand;
+
+				for (size_t k = 0; (operand = Instr_use(instr, k)); ++k) {
+					p->reads[p->first[i] + k] = operand->kind == OperandKind_VREG ? current[operand->value] : -1;
+				}
+
+				p->made[i] = -1;
+				if (instr->dst < 0) continue;
+
+				if ((p->made[i] = define(p, Level_UNKNOWN)) < 0) goto done;
+				if (!room((void**) &changes, &capacity, nchanges + 1, 2 * sizeof (int))) goto done;
+
+				changes[2 * nchanges]     = instr->dst;
+				changes[2 * nchanges + 1] = current[instr->dst];
+				++nchanges;
+
+				current[instr->dst] = p->made[i];
+			}
+
+			Block* successors[2];
+			int    count = Block_successors(p->blocks[b], successors);
+
+			for (int s = 0; s < count; ++s) {
+
+				Block const* next = successors[s];
+				size_t       q    = 0;
+
+				while (next->preds[q] != p->blocks[b]) ++q;
+
+				for (int phi = p->head[p->index[next->id]]; phi >= 0; phi = p->phis[phi].next) {
+					p->args[p->phis[phi].arg + q] = current[p->phis[phi].vreg];
+				}
+			}
+		}
+
+		if (kfirst[b] + top->child < kfirst[b + 1]) {
+
+			int child = kids[kfirst[b] + top->child++];
+
+			stack[depth++] = (Visit) { child, 0, nchanges };
+			entering       = true;
+			continue;
+		}
+
+		/* back to the latest definitions of the parent */
+		while (nchanges > top->nchanges) {
+			--nchanges;
+			current[changes[2 * nchanges]] = changes[2 * nchanges + 1];
+		}
+
+		--depth;
+		entering = false;
+	}
+
+	ok = true;
+
+done:
+	Memory_free(current);
+	Memory_free(changes);
+	Memory_free(kfirst);
+	Memory_free(kids);
+	Memory_free(stack);
+
+	return ok;
+}
+
+/* the readers of every definition */
+static bool link(Propagation* p) {
+
+	size_t ndefs = p->ndefs;
+	size_t total = 0;
+
+	p->ufirst = Memory_calloc(MemoryTag_IR, ndefs + 1, sizeof (size_t));
+	if (!p->ufirst) return false;
+
+	for (size_t r = 0; r < p->first[p->ninstrs]; ++r) {
+		if (p->reads[r] >= 0) ++p->ufirst[p->reads[r] + 1];
+	}
+
+	for (size_t phi = 0; phi < p->nphis; ++phi) {
+
+		Block const* block = p->blocks[p->phis[phi].block];
+
+		for (size_t q = 0; q < block->npreds; ++q) {
+			++p->ufirst[p->args[p->phis[phi].arg + q] + 1];
+		}
+	}
+
+	for (size_t d = 0; d < ndefs; ++d) p->ufirst[d + 1] += p->ufirst[d];
+
+	total    = p->ufirst[ndefs];
+	p->users = Memory_alloc(MemoryTag_IR, (total ? total : 1) * sizeof (int));
+
+	if (!p->users) return false;
+
+	for (size_t i = 0; i < p->ninstrs; ++i) {
+		for (size_t r = p->first[i]; r < p->first[i + 1]; ++r) {
+			if (p->reads[r] >= 0) p->users[p->ufirst[p->reads[r]]++] = (int) i;
+		}
+	}
+
+	for (size_t phi = 0; phi < p->nphis; ++phi) {
+
+		Block const* block = p->blocks[p->phis[phi].block];
+
+		for (size_t q = 0; q < block->npreds; ++q) {
+			p->users[p->ufirst[p->args[p->phis[phi].arg + q]]++] = -(int) phi - 1;
+		}
+	}
+
+	for (size_t d = ndefs; d-- > 0;) p->ufirst[d + 1] = p->ufirst[d];
+	p->ufirst[0] = 0;
+
+	return true;
+}
+
+/*
+ * The definitions a register still has to hold where phis meet: those a phi
+ * that is no constant reads, and those a constant phi reads when it is one of
+ * them, since the register then carries the constant in.
+ */
+static bool hold(Propagation* p) {
+
+	int*   phi_of = Memory_alloc(MemoryTag_IR, p->ndefs * sizeof (int));
+	int*   stack  = Memory_alloc(MemoryTag_IR, (p->nphis ? p->nphis : 1) * sizeof (int));
+	size_t depth  = 0;
+
+	if (!phi_of || !stack) {
+		Memory_free(phi_of);
+		Memory_free(stack);
+		return false;
+	}
+
+	for (size_t d = 0; d < p->ndefs; ++d) phi_of[d] = -1;
+
+	for (size_t phi = 0; phi < p->nphis; ++phi) {
+
+		phi_of[p->phis[phi].def] = (int) phi;
+
+		if (p->live[p->phis[phi].block] && p->defs[p->phis[phi].def].level != Level_CONSTANT) {
+			p->defs[p->phis[phi].def].merged = true;
+			stack[depth++]                   = (int) phi;
+		}
+	}
+
+	while (depth) {
+
+		Phi const*   phi   = &p->phis[stack[--depth]];
+		Block const* block = p->blocks[phi->block];
+
+		for (size_t q = 0; q < block->npreds; ++q) {
+
+			Def* def = &p->defs[p->args[phi->arg + q]];
+
+			if (def->merged || !crossed(p, block->preds[q], block)) continue;
+
+			def->merged = true;
+			if (phi_of[p->args[phi->arg + q]] >= 0) stack[depth++] = phi_of[p->args[phi->arg + q]];
+		}
+	}
+
+	Memory_free(phi_of);
+	Memory_free(stack);
+
+	return true;
+}
+
+/*
+ * Constants take the place of the reads of them, and their writes go
+ * unless a phi still needs the register to hold them. A branch that only
+ * ever goes one way becomes a jump, leaving what it no longer reaches to
+ * Procedure_edges. True when anything was rewritten.
+ */
+static bool rewrite(Propagation* p) {
+
+	bool changed = false;
+
+	for (size_t b = 0; b < p->n; ++b) {
+
+		Block* block = p->blocks[b];
+
+		if (!p->live[b]) continue;
+
+		for (size_t i = p->start[b + 1]; i-- > p->start[b];) {
+
+			Instr*   instr = instruction(p, i);
+			size_t   j     = i - p->start[b];
+			Operand* operand;
+
+			for (size_t k = 0; (operand = Instr_use(instr, k)); ++k) {
+
+				int read = p->reads[p->first[i] + k];
+
+				if (read >= 0 && p->defs[read].level == Level_CONSTANT) {
+					*operand = Operand_const(p->defs[read].constant);
+					changed  = true;
+				}
+			}
+
+			Def const* made = p->made[i] >= 0 ? &p->defs[p->made[i]] : NULL;
+
+			if (made && made->level == Level_CONSTANT && !made->merged) {
+				memmove(&block->code[j], &block->code[j + 1], (block->count - j - 1) * sizeof (Instr));
+				--block->count;
+				changed = true;
+				continue;
+			}
+
+			if (made && made->level == Level_CONSTANT) {
+				*instr  = (Instr) { Op_COPY, instr->dst, Operand_const(made->constant), Operand_NONE, 0, NULL, -1, NULL, 0, { NULL, NULL } };
+				changed = true;
+				continue;
+			}
+
+			if (instr->op == Op_BRANCH && p->taken[2 * b] != p->taken[2 * b + 1]) {
+
+				Block* to = instr->targets[p->taken[2 * b] ? 0 : 1];
+
+				*instr  = (Instr) { Op_JUMP, -1, Operand_NONE, Operand_NONE, 0, NULL, -1, NULL, 0, { to, NULL } };
+				changed = true;
+			}
+		}
+	}
+
+	return changed;
+}
+
+static bool run_propagate(Procedure* function, Analyses* analyses, PassContext* context, bool* changed) {
+
+	Propagation p  = { 0 };
+	bool        ok = false;
+
+	if (!function->nblocks) return true;
+
+	size_t n   = function->nblocks;
+	size_t ids = function->nextblock;
+
+	p.function = function;
+	p.blocks   = function->blocks;
+	p.n        = n;
+
+	p.index = Memory_alloc(MemoryTag_IR, (ids ? ids : 1) * sizeof (int));
+	p.start = Memory_calloc(MemoryTag_IR, n + 1, sizeof (size_t));
+	p.head  = Memory_alloc(MemoryTag_IR, n * sizeof (int));
+	p.live  = Memory_calloc(MemoryTag_IR, n, sizeof (bool));
+	p.taken = Memory_calloc(MemoryTag_IR, 2 * n, sizeof (bool));
+	p.edges = Memory_alloc(MemoryTag_IR, 2 * n * sizeof (int));
+
+	if (!p.index || !p.start || !p.head || !p.live || !p.taken || !p.edges) goto done;
+
+	for (size_t b = 0; b < n; ++b) {
+		p.index[p.blocks[b]->id] = (int) b;
+		p.start[b + 1]           = p.start[b] + p.blocks[b]->count;
+		p.head[b]                = -1;
+	}
+
+	p.ninstrs = p.start[n];
+	p.owner   = Memory_alloc(MemoryTag_IR, (p.ninstrs ? p.ninstrs : 1) * sizeof (int));
+	p.first   = Memory_calloc(MemoryTag_IR, p.ninstrs + 1, sizeof (size_t));
+	p.made    = Memory_alloc(MemoryTag_IR, (p.ninstrs ? p.ninstrs : 1) * sizeof (int));
+
+	if (!p.owner || !p.first || !p.made) goto done;
+
+	for (size_t b = 0; b < n; ++b) {
+		for (size_t i = p.start[b]; i < p.start[b + 1]; ++i) p.owner[i] = (int) b;
+	}
+
+	for (size_t i = 0; i < p.ninstrs; ++i) p.first[i + 1] = p.first[i] + 2 + instruction(&p, i)->nargs;
+
+	p.reads = Memory_alloc(MemoryTag_IR, (p.first[p.ninstrs] ? p.first[p.ninstrs] : 1) * sizeof (int));
+	if (!p.reads) goto done;
+
+	/* definition 0 is what every register holds on entry, which could be anything */
+	if (define(&p, Level_VARYING) < 0 || !place(&p)) goto done;
+
+	size_t nargs = 0;
+
+	for (size_t phi = 0; phi < p.nphis; ++phi) {
+		p.phis[phi].arg = nargs;
+		nargs          += p.blocks[p.phis[phi].block]->npreds;
+	}
+
+	p.args = Memory_calloc(MemoryTag_IR, nargs ? nargs : 1, sizeof (int));
+
+	if (!p.args || !rename(&p) || !link(&p)) goto done;
+
+	/* a definition is only lowered twice */
+	p.lowered = Memory_alloc(MemoryTag_IR, 2 * p.ndefs * sizeof (int));
+	if (!p.lowered) goto done;
+
+	propagate(&p);
+	if (!hold(&p)) goto done;
+
+	*changed = rewrite(&p);
+
+	ok = !*changed || Procedure_edges(function);
+
+done:
+	Memory_free(p.index);
+	Memory_free(p.start);
+	Memory_free(p.owner);
+	Memory_free(p.first);
+	Memory_free(p.reads);
+	Memory_free(p.made);
+	Memory_free(p.defs);
+	Memory_free(p.phis);
+	Memory_free(p.args);
+	Memory_free(p.head);
+	Memory_free(p.ufirst);
+	Memory_free(p.users);
+	Memory_free(p.live);
+	Memory_free(p.taken);
+	Memory_free(p.edges);
+	Memory_free(p.lowered);
+
+	return ok;
+}
+
+/* the phis are placed on the dominance frontiers, a decided branch drops blocks */
+Pass const Pass_PROPAGATE = {
+	.name        = "propagate",
+	.requires    = ANALYSIS(Analysis_DOMINATORS),
+	.invalidates = ANALYSES_CFG,
+	.lowered     = run_propagate,
+};
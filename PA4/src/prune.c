@@ -0,0 +1,233 @@
+#include <stdlib.h>
+
+#include "../include/memory.h"
+#include "../include/prune.h"
+
+struct Flow {
+	/* sorted so membership is a binary search */
+	Pair const** stuck;
+	size_t       count;
+	size_t       capacity;
+	bool         failed;
+};
+
+static Pair* function_body(Pair* function) {
+	/* type, identifier, parameters, body */
+	return function->cdr->cdr->cdr->cdr->car;
+}
+
+static bool literal(Pair* expression, bool* truth) {
+	if (expression->val != ASType_NUM) return false;
+	*truth = expression->num != 0;
+	return true;
+}
+
+static void mark(Flow* flow, Pair const* statement) {
+
+	if (flow->count == flow->capacity) {
+
+		size_t       capacity = flow->capacity ? flow->capacity * 2 : 16;
+		Pair const** stuck    = Memory_realloc(MemoryTag_OTHER, flow->stuck, capacity * sizeof *stuck);
+
+		if (!stuck) {
+			flow->failed = true;
+			return;
+		}
+
+		flow->stuck    = stuck;
+		flow->capacity = capacity;
+	}
+
+	flow->stuck[flow->count++] = statement;
+}
+
+/* whether control can leave the statement at its end, marking the ones it cannot */
+static bool completes(Flow* flow, Pair* statement) {
+
+	Pair* node = statement->cdr;
+	bool  truth;
+	bool  result = true;
+
+	switch (statement->val) {
+
+		case ASType_RETURN_STMT:
+			result = false;
+			break;
+
+		case ASType_ITERATION_STMT:
+			/* there is no break, so a loop on a true literal only leaves by returning */
+			completes(flow, node->cdr->car);
+			result = !literal(node->car, &truth) || !truth;
+			break;
+
+		case ASType_SELECTION_STMT: {
+			bool then = completes(flow, node->cdr->car);
+			bool other = node->cdr->cdr ? completes(flow, node->cdr->cdr->car) : true;
+			result = then || other;
+			break;
+		}
+
+		case ASType_COMPOUND_STMT:
+			for (; node; node = node->cdr) {
+				if (!completes(flow, node->car)) result = false;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	if (!result) mark(flow, statement);
+	return result;
+}
+
+static int compare(void const* a, void const* b) {
+	Pair const* x = *(Pair const* const*) a;
+	Pair const* y = *(Pair const* const*) b;
+	return (x > y) - (x < y);
+}
+
+Flow* Flow_compute(Pair* function) {
+
+	Flow* flow = Memory_calloc(MemoryTag_OTHER, 1, sizeof (Flow));
+	if (!flow) return NULL;
+
+	completes(flow, function_body(function));
+
+	if (flow->failed) {
+		Flow_free(flow);
+		return NULL;
+	}
+
+	if (flow->count) qsort(flow->stuck, flow->count, sizeof *flow->stuck, compare);
+	return flow;
+}
+
+bool Flow_completes(Flow const* flow, Pair* statement) {
+	Pair const* key = statement;
+	return !flow->count || !bsearch(&key, flow->stuck, flow->count, sizeof *flow->stuck, compare);
+}
+
+void Flow_free(Flow* flow) {
+	if (!flow) return;
+	Memory_free(flow->stuck);
+	Memory_free(flow);
+}
+
+/* overwrite statement with one of its children, or an empty statement when child is NULL */
+static void replace(Pair* statement, Pair** child) {
+
+	Pair* keep = child ? *child : NULL;
+	if (child) *child = NULL;
+
+	Pair_free(statement->cdr);
+
+	if (keep) {
+		*statement = *keep;
+		Memory_free(keep);
+	} else {
+		statement->val = ASType_EMPTY_STMT;
+		statement->cdr = NULL;
+	}
+}
+
+static bool dead_branches(Pair* statement) {
+
+	Pair* node    = statement->cdr;
+	bool  changed = false;
+	bool  truth;
+
+	switch (statement->val) {
+
+		case ASType_ITERATION_STMT:
+			if (literal(node->car, &truth) && !truth) {
+				replace(statement, NULL);
+				return true;
+			}
+			return dead_branches(node->cdr->car);
+
+		case ASType_SELECTION_STMT:
+			if (literal(node->car, &truth)) {
+
+				Pair** kept = truth ? &node->cdr->car : node->cdr->cdr ? &node->cdr->cdr->car : NULL;
+
+				replace(statement, kept);
+
+				/* the branch kept may have more to remove */
+				dead_branches(statement);
+				return true;
+			}
+
+			changed |= dead_branches(node->cdr->car);
+			if (node->cdr->cdr) changed |= dead_branches(node->cdr->cdr->car);
+			return changed;
+
+		case ASType_COMPOUND_STMT:
+			for (; node; node = node->cdr) {
+				changed |= dead_branches(node->car);
+			}
+			return changed;
+
+		default:
+			return false;
+	}
+}
+
+static bool run_dead_branches(Pair* function, Analyses* analyses) {
+	return dead_branches(function_body(function));
+}
+
+Pass const Pass_DEAD_BRANCHES = {
+	.name        = "dead-branches",
+	.invalidates = ANALYSIS(Analysis_FLOW),
+	.run         = run_dead_branches,
+};
+
+static bool unreachable(Flow const* flow, Pair* statement) {
+
+	Pair* node    = statement->cdr;
+	bool  changed = false;
+
+	switch (statement->val) {
+
+		case ASType_ITERATION_STMT:
+			return unreachable(flow, node->cdr->car);
+
+		case ASType_SELECTION_STMT:
+			changed |= unreachable(flow, node->cdr->car);
+			if (node->cdr->cdr) changed |= unreachable(flow, node->cdr->cdr->car);
+			return changed;
+
+		case ASType_COMPOUND_STMT:
+			for (; node; node = node->cdr) {
+
+				changed |= unreachable(flow, node->car);
+
+				if (node->cdr && !Flow_completes(flow, node->car)) {
+					Pair_free(node->cdr);
+					node->cdr = NULL;
+					changed   = true;
+				}
+			}
+			return changed;
+
+		default:
+			return false;
+	}
+}
+
+static bool run_unreachable(Pair* function, Analyses* analyses) {
+
+	Flow const* flow = Analyses_get(analyses, Analysis_FLOW);
+	if (!flow) return false;
+
+	return unreachable(flow, function_body(function));
+}
+
+/* flow would still hold for what is left, but it names statements that were just freed */
+Pass const Pass_UNREACHABLE = {
+	.name        = "unreachable",
+	.requires    = ANALYSIS(Analysis_FLOW),
+	.invalidates = ANALYSIS(Analysis_FLOW),
+	.run         = run_unreachable,
+};
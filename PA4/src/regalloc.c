@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "../include/regalloc.h"
+
+#define MAX_REGISTERS 32
+
+static int by_start(void const* a, void const* b) {
+
+	Interval const* x = a;
+	Interval const* y = b;
+
+	if (x->start != y->start) return x->start < y->start ? -1 : 1;
+	return (x->key > y->key) - (x->key < y->key);
+}
+
+/* the cheaper of two intervals to keep in memory, the one reaching further on a tie */
+static bool cheaper(Interval const* x, Interval const* y) {
+	return x->weight != y->weight ? x->weight < y->weight : x->end > y->end;
+}
+
+unsigned Interval_allocate(Interval* intervals, size_t count) {
+
+	Interval* active[MAX_REGISTERS];
+	size_t    nactive = 0;
+	unsigned  used    = 0;
+	unsigned  free    = ~0u;
+
+	if (count) qsort(intervals, count, sizeof *intervals, by_start);
+
+	for (size_t i = 0; i < count; ++i) {
+
+		Interval* current = &intervals[i];
+		size_t    kept    = 0;
+
+		/* give back the registers of intervals that are over */
+		for (size_t j = 0; j < nactive; ++j) {
+			if (active[j]->end < current->start) free |= 1u << active[j]->reg;
+			else                                 active[kept++] = active[j];
+		}
+
+		nactive = kept;
+
+		unsigned choice = free & current->allowed;
+
+		if (choice) {
+
+			int reg = 0;
+			while (!(choice & 1u << reg)) ++reg;
+
+			current->reg = reg;
+			free &= ~(1u << reg);
+			used |= 1u << reg;
+			active[nactive++] = current;
+			continue;
+		}
+
+		Interval* victim = NULL;
+		size_t    index  = 0;
+
+		for (size_t j = 0; j < nactive; ++j) {
+			if (!(current->allowed & 1u << active[j]->reg)) continue;
+			if (!victim || cheaper(active[j], victim)) {
+				victim = active[j];
+				index  = j;
+			}
+		}
+
+		if (!victim || cheaper(current, victim)) {
+			current->reg = -1;
+		} else {
+			current->reg  = victim->reg;
+			victim->reg   = -1;
+			active[index] = current;
+		}
+	}
+
+	return used;
+}
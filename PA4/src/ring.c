@@ -0,0 +1,73 @@
+#include <threads.h>
+
+#include "../include/memory.h"
+#include "../include/trace.h"
+#include "../include/ring.h"
+
+bool Ring_init(Ring* ring, size_t capacity) {
+
+	size_t size = 2;
+	while (size < capacity) size <<= 1;
+
+	ring->slots = Memory_calloc(MemoryTag_OTHER, size, sizeof (void*));
+	if (!ring->slots) return false;
+
+	ring->mask          = size - 1;
+	ring->empty_stalls  = 0;
+	ring->empty_seconds = 0;
+	ring->full_stalls   = 0;
+	ring->full_seconds  = 0;
+
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+
+	return true;
+}
+
+void Ring_push(Ring* ring, void* item) {
+
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	/* only the consumer moves head, and only ever towards tail */
+	if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) > ring->mask) {
+
+		double start = Trace_wall();
+		++ring->full_stalls;
+
+		while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) > ring->mask) {
+			thrd_yield();
+		}
+
+		ring->full_seconds += Trace_wall() - start;
+	}
+
+	ring->slots[tail & ring->mask] = item;
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void* Ring_pop(Ring* ring) {
+
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	if (atomic_load_explicit(&ring->tail, memory_order_acquire) == head) {
+
+		double start = Trace_wall();
+		++ring->empty_stalls;
+
+		while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head) {
+			thrd_yield();
+		}
+
+		ring->empty_seconds += Trace_wall() - start;
+	}
+
+	void* item = ring->slots[head & ring->mask];
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+	return item;
+}
+
+void Ring_release(Ring* ring) {
+	Memory_free(ring->slots);
+	ring->slots = NULL;
+}
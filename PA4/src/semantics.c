@@ -5,6 +5,25 @@
 #include "../include/type.h"
 #include "../include/semantics.h"
 #include "../include/symboltable.h"
+#include "../include/memory.h"
+#include "../include/trace.h"
+
+char const* Semantic_to_string(Semantic semantic) {
+    switch (semantic) {
+        case Semantic_OK:                      return "ok";
+        case Semantic_TYPE_ERROR:              return "type error";
+        case Semantic_REDECLARATION:           return "redeclaration";
+        case Semantic_RETURN_ERROR:            return "bad return";
+        case Semantic_UNDECLARED_SYMBOL:       return "undeclared symbol";
+        case Semantic_VOID_VAR:                return "variable declared void";
+        case Semantic_NO_FINAL_VOID_MAIN_VOID: return "last declaration is not void main(void)";
+        case Semantic_INTERNAL_ERROR:          return "internal error";
+        case Semantic_INVALID_STATE:           return "invalid state";
+        case Semantic_ARITY_MISMATCH:          return "arity mismatch";
+        case Semantic_BAD_LITERAL_VALUE:       return "bad literal value";
+        default:                               return "???";
+    }
+}
 
 static Semantic check_var_declaration(Pair* ast, SymbolTable* table, Type** o_type, char const** o_id, bool is_param);
 
@@ -395,6 +414,9 @@ static Semantic check_var_declaration(Pair* ast, SymbolTable* table, Type** o_ty
 
     if (result != Semantic_OK) {
         Type_free(type);
+    } else if (table->here != table->root) {
+        /* the same frame offset references to it get, for lowering */
+        ast->cdr->cdr->car->num = is_param ? table->here->parmax : table->here->varmax;
     }
 
     if (o_type) *o_type = type;
@@ -493,8 +515,17 @@ static Semantic check_declaration(Pair* ast, SymbolTable* table, Type** o_type,
 
     switch (ast->val) {
 
-        case ASType_FUN_DECLARATION:
-            return check_fun_declaration(ast, table, o_type, o_id);
+        case ASType_FUN_DECLARATION: {
+
+            /* one trace span per function */
+            char const* name   = ast->cdr->cdr->car->dyn;
+            Trace_begin("semantics", name);
+
+            Semantic result = check_fun_declaration(ast, table, o_type, o_id);
+
+            Trace_end("semantics", name);
+            return result;
+        }
 
         case ASType_VAR_DECLARATION:
             return check_var_declaration(ast, table, o_type, o_id, false);
@@ -504,27 +535,79 @@ static Semantic check_declaration(Pair* ast, SymbolTable* table, Type** o_type,
     }
 }
 
-Semantic check_semantics(Pair* ast) {
+Checker* Checker_new(void) {
 
-    Semantic result;
-    Pair* node = ast;
+    Checker* checker = Memory_alloc(MemoryTag_OTHER, sizeof (Checker));
+    if (!checker) goto fail_1;
 
     /* create the type for main */
-    Type* main_type = Type_takes(
+    checker->main_type = Type_takes(
         Type_new(DefinitionType_FUNCTION, PrimativeType_VOID), PrimativeType_VOID
     );
 
+    if (!checker->main_type) goto fail_2;
+
+    /* create the global symbol table */
+    checker->table = SymbolTable_new();
+    if (!checker->table) goto fail_3;
+
+    checker->declared  = false;
+    checker->last_main = false;
+
+    return checker;
+
+fail_3:
+    Type_free(checker->main_type);
+fail_2:
+    Memory_free(checker);
+fail_1:
+    return NULL;
+}
+
+Semantic Checker_declaration(Checker* checker, Pair* ast) {
+
     /* out parameters to check delcarations */
     Type*       d_type = NULL;
     char const* d_id   = NULL;
 
-    /* create the global symbol table */
-    SymbolTable* table = SymbolTable_new();
+    Semantic result = check_declaration(ast, checker->table, &d_type, &d_id);
+    if (result != Semantic_OK) return result;
 
-    if (!table) {
-        result = Semantic_INTERNAL_ERROR;
-        goto fail_1;
-    }
+    /* only the verdict is kept, the identifier belongs to the tree */
+    checker->declared  = d_type && d_id;
+    checker->last_main = checker->declared
+        && Type_equals(d_type, checker->main_type)
+        && strcmp(d_id, "main") == 0;
+
+    return Semantic_OK;
+}
+
+Semantic Checker_finish(Checker* checker) {
+
+    /* ensure there were actually delcarations and that
+       "void main(void)" is the last of them */
+    if (!checker->declared || !checker->last_main)
+        return Semantic_NO_FINAL_VOID_MAIN_VOID;
+
+    return Semantic_OK;
+}
+
+void Checker_free(Checker* checker) {
+
+    if (!checker) return;
+
+    SymbolTable_free(checker->table);
+    Type_free(checker->main_type);
+    Memory_free(checker);
+}
+
+Semantic check_semantics(Pair* ast) {
+
+    Semantic result;
+    Pair* node = ast;
+
+    Checker* checker = Checker_new();
+    if (!checker) return Semantic_INTERNAL_ERROR;
 
     /* skip program node to get into declaration list */
     node = node->cdr;
@@ -532,33 +615,19 @@ Semantic check_semantics(Pair* ast) {
     while (node) {
         
         /* check the declaration in the car of this node */
-        result = check_declaration(node->car, table, &d_type, &d_id);
-        if (result != Semantic_OK) goto fail_2;
+        result = Checker_declaration(checker, node->car);
+        if (result != Semantic_OK) goto done;
 
         node = node->cdr;
     }
 
-    /* ensure there were actually delcarations */
-    if (!d_type || !d_id) {
-        result = Semantic_NO_FINAL_VOID_MAIN_VOID;
-        goto fail_2;
-    }
-
-    /* ensure that "void main(void)" is the last declaration */
-    if (!Type_equals(d_type, main_type) || strcmp(d_id, "main") != 0) {
-        result = Semantic_NO_FINAL_VOID_MAIN_VOID;
-        goto fail_2;
-    }
-
     // IDTable_write(stdout, table->here->symbols);
 
-    result = Semantic_OK;
-
-fail_2:
+    result = Checker_finish(checker);
 
-    SymbolTable_free(table);
+done:
 
-fail_1:
+    Checker_free(checker);
 
     return result;
-}
\ No newline at end of file
+}
@@ -1,11 +1,13 @@
 #include <stddef.h>
-#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "../include/str.h"
+#include "../include/memory.h"
 
 char* strdup(char const* original) {
-    char* dup = malloc(strlen(original) + 1);
+    char* dup = Memory_alloc(MemoryTag_STR, strlen(original) + 1);
     if (!dup) return NULL;
     strcpy(dup, original);
     return dup;
@@ -13,10 +15,10 @@ char* strdup(char const* original) {
 
 Str* Str_new(size_t capacity) {
 
-    Str* s = malloc(sizeof(Str));
+    Str* s = Memory_alloc(MemoryTag_STR, sizeof(Str));
     if (!s) goto fail_1;
 
-    s->buffer = calloc(sizeof(char), capacity);
+    s->buffer = Memory_calloc(MemoryTag_STR, sizeof(char), capacity);
     if (!s->buffer) goto fail_2;
 
     s->length   = 0;
@@ -25,7 +27,7 @@ Str* Str_new(size_t capacity) {
     return s;
 
 fail_2:
-    free(s);
+    Memory_free(s);
 fail_1:
     return NULL;
 }
@@ -40,8 +42,8 @@ Str* Str_dup(Str* original) {
 }
 
 void Str_free(Str* s) {
-    free(s->buffer);
-    free(s);
+    Memory_free(s->buffer);
+    Memory_free(s);
 }
 
 void Str_clear(Str* s) {
@@ -52,7 +54,7 @@ void Str_pushchar(Str* s, char glyph) {
 
     if (s->length + 1 == s->capacity) {
         s->capacity *= 2;
-        s->buffer = realloc(s->buffer, s->capacity);
+        s->buffer = Memory_realloc(MemoryTag_STR, s->buffer, s->capacity);
     }
 
     s->buffer[s->length] = glyph;
@@ -67,7 +69,7 @@ void Str_copy_nulterm(Str* s, char* nulterm) {
     size_t nullen = strlen(nulterm);
 
     if (s->capacity < nullen + 1) {
-        s->buffer   = realloc(s->buffer, nullen + 1);
+        s->buffer   = Memory_realloc(MemoryTag_STR, s->buffer, nullen + 1);
         s->capacity = nullen + 1;
     }
 
@@ -77,4 +79,54 @@ void Str_copy_nulterm(Str* s, char* nulterm) {
     s->buffer[nullen] = '\0';
     s->length         = nullen;
 
-}
\ No newline at end of file
+}
+
+/* make room for at least extra more characters and a terminator */
+static void Str_reserve(Str* s, size_t extra) {
+
+    size_t capacity = s->capacity ? s->capacity : 1;
+
+    while (capacity < s->length + extra + 1) {
+        capacity *= 2;
+    }
+
+    if (capacity != s->capacity) {
+        s->buffer   = Memory_realloc(MemoryTag_STR, s->buffer, capacity);
+        s->capacity = capacity;
+    }
+}
+
+void Str_append(Str* s, char const* text, size_t length) {
+
+    Str_reserve(s, length);
+
+    memcpy(s->buffer + s->length, text, length);
+    s->length += length;
+    s->buffer[s->length] = '\0';
+}
+
+void Str_puts(Str* s, char const* nulterm) {
+    Str_append(s, nulterm, strlen(nulterm));
+}
+
+void Str_printf(Str* s, char const* format, ...) {
+
+    va_list args;
+
+    /* try to fit it in the space already available */
+    va_start(args, format);
+    int length = vsnprintf(s->buffer + s->length, s->capacity - s->length, format, args);
+    va_end(args);
+
+    if (length < 0) return;
+
+    if (s->length + length + 1 > s->capacity) {
+        Str_reserve(s, length);
+
+        va_start(args, format);
+        vsnprintf(s->buffer + s->length, s->capacity - s->length, format, args);
+        va_end(args);
+    }
+
+    s->length += length;
+}
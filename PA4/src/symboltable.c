@@ -3,10 +3,11 @@
 #include <stdbool.h>
 
 #include "../include/symboltable.h"
+#include "../include/memory.h"
 
 bool SymbolTable_enter_scope(SymbolTable* table) {
 
-	Scope* s = malloc(sizeof (Scope));
+	Scope* s = Memory_alloc(MemoryTag_IDTABLE, sizeof (Scope));
 	if (!s) goto fail_1;
 
 	s->symbols = IDTable_new(0);
@@ -21,14 +22,14 @@ bool SymbolTable_enter_scope(SymbolTable* table) {
 	return true;
 
 fail_2:
-	free(s);
+	Memory_free(s);
 fail_1:
 	return false;
 }
 
 SymbolTable* SymbolTable_new(void) {
 
-	SymbolTable* table = malloc(sizeof (SymbolTable));
+	SymbolTable* table = Memory_alloc(MemoryTag_IDTABLE, sizeof (SymbolTable));
 	if (!table) goto fail_1;
 
 	table->depth = -1;
@@ -65,7 +66,7 @@ SymbolTable* SymbolTable_new(void) {
 fail_3:
 	SymbolTable_exit_scope(table);
 fail_2:
-	free(table);
+	Memory_free(table);
 fail_1:
 	return NULL;
 }
@@ -76,7 +77,7 @@ void SymbolTable_exit_scope(SymbolTable* table) {
 	table->here  = there->parent;
 
 	IDTable_free(there->symbols);
-	free(there);
+	Memory_free(there);
 };
 
 Semantic SymbolTable_lookup(SymbolTable* table, char const* string, Type** out_type, int* out_offset) {
@@ -159,5 +160,5 @@ void SymbolTable_free(SymbolTable* table) {
 		SymbolTable_exit_scope(table);
 	}
 
-	free(table);
+	Memory_free(table);
 };
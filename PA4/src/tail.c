@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/memory.h"
+#include "../include/tail.h"
+
+static Instr make(Op op, int dst) {
+	return (Instr) { op, dst, Operand_NONE, Operand_NONE, 0, NULL, -1, NULL, 0, { NULL, NULL } };
+}
+
+/* the call a block ends by returning the result of, directly or through a block doing nothing else, or NULL */
+static Instr* tail(Block* block) {
+
+	if (block->count < 2) return NULL;
+
+	Instr* call = &block->code[block->count - 2];
+	Instr* last = &block->code[block->count - 1];
+
+	if (call->op != Op_CALL) return NULL;
+
+	if (last->op == Op_JUMP) {
+
+		Block* target = last->targets[0];
+
+		if (target->count != 1) return NULL;
+		last = &target->code[0];
+	}
+
+	if (last->op != Op_RETURN) return NULL;
+
+	/* falling off the end returns whatever the call left in $a0 */
+	if (last->a.kind == OperandKind_NONE) return call;
+
+	return call->dst >= 0 && last->a.kind == OperandKind_VREG && last->a.value == call->dst ? call : NULL;
+}
+
+static bool recursive(Procedure const* function, Instr const* call) {
+	return strcmp(call->symbol, function->name) == 0;
+}
+
+/* whether an argument may be the address of an array in the frame */
+static bool framed(Procedure const* function, Operand argument) {
+
+	if (argument.kind != OperandKind_VREG) return false;
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block const* block = function->blocks[i];
+
+		for (size_t j = 0; j < block->count; ++j) {
+			Instr const* instr = &block->code[j];
+			if (instr->dst == argument.value && instr->op == Op_ADDR && instr->slot >= 0) return true;
+		}
+	}
+
+	return false;
+}
+
+/* a recursive call handing on an array of its own needs that array to outlive the jump back */
+static bool loops_back(Procedure const* function, Instr const* call) {
+
+	if (!recursive(function, call)) return false;
+
+	for (int i = 0; i < call->nargs; ++i) {
+		if (framed(function, call->args[i])) return false;
+	}
+
+	return true;
+}
+
+static bool leaves(Procedure const* function, Instr const* call) {
+	return !recursive(function, call) && call->nargs <= function->nparams && call->nargs <= TAIL_ARGUMENTS
+		&& function->nslots == 0;
+}
+
+/* moves everything but the parameters out of the entry into a block of its own right after it, NULL when out of memory */
+static Block* split(Procedure* function) {
+
+	Block* body = Procedure_block(function);
+	if (!body) return NULL;
+
+	Block* entry = function->blocks[0];
+
+	memmove(&function->blocks[2], &function->blocks[1], (function->nblocks - 2) * sizeof (Block*));
+	function->blocks[1] = body;
+
+	body->code     = entry->code;
+	body->count    = entry->count;
+	body->capacity = entry->capacity;
+	body->depth    = entry->depth;
+
+	entry->code     = NULL;
+	entry->count    = 0;
+	entry->capacity = 0;
+
+	size_t nparams = 0;
+
+	while (nparams < body->count && body->code[nparams].op == Op_PARAM) {
+		if (!Block_append(function, entry, &body->code[nparams++])) return NULL;
+	}
+
+	memmove(body->code, body->code + nparams, (body->count - nparams) * sizeof (Instr));
+	body->count -= nparams;
+
+	Instr jump = make(Op_JUMP, -1);
+	jump.targets[0] = body;
+
+	return Block_append(function, entry, &jump) ? body : NULL;
+}
+
+/*
+ * The parameters are written in order, so an argument reading one written
+ * before its own turn is copied aside first.
+ */
+static bool jump_back(Procedure* function, Block* block, Block* body, Instr call) {
+
+	Block* entry = function->blocks[0];
+	int*   param = Memory_alloc(MemoryTag_IR, (call.nargs ? call.nargs : 1) * sizeof (int));
+	bool   ok    = false;
+
+	if (!param) goto done;
+
+	for (size_t j = 0; j < entry->count; ++j) {
+		if (entry->code[j].op == Op_PARAM && entry->code[j].imm < call.nargs) param[entry->code[j].imm] = entry->code[j].dst;
+	}
+
+	for (int i = 0; i < call.nargs; ++i) {
+
+		Operand argument = call.args[i];
+		bool    aside    = false;
+
+		for (int p = 0; p < i; ++p) {
+
+			bool written = call.args[p].kind != OperandKind_VREG || call.args[p].value != param[p];
+
+			if (written && argument.kind == OperandKind_VREG && argument.value == param[p]) aside = true;
+		}
+
+		if (!aside) continue;
+
+		Instr copy = make(Op_COPY, Procedure_vreg(function, NULL));
+		copy.a = argument;
+
+		if (copy.dst < 0 || !Block_append(function, block, &copy)) goto done;
+		call.args[i] = Operand_vreg(copy.dst);
+	}
+
+	for (int i = 0; i < call.nargs; ++i) {
+
+		if (call.args[i].kind == OperandKind_VREG && call.args[i].value == param[i]) continue;
+
+		Instr copy = make(Op_COPY, param[i]);
+		copy.a = call.args[i];
+
+		if (!Block_append(function, block, &copy)) goto done;
+	}
+
+	Instr jump = make(Op_JUMP, -1);
+	jump.targets[0] = body;
+
+	ok = Block_append(function, block, &jump) != NULL;
+
+done:
+	Memory_free(param);
+	Memory_free(call.args);
+
+	return ok;
+}
+
+static bool run_tail(Procedure* function, Analyses* analyses, PassContext* context, bool* changed) {
+
+	Block* body = NULL;
+
+	for (size_t i = 0; i < function->nblocks && !body; ++i) {
+
+		Instr* call = tail(function->blocks[i]);
+
+		if (call && loops_back(function, call)) {
+			body = split(function);
+			if (!body) return false;
+		}
+	}
+
+	for (size_t i = 0; i < function->nblocks; ++i) {
+
+		Block* block = function->blocks[i];
+		Instr* call  = tail(block);
+
+		if (!call) continue;
+
+		if (body && loops_back(function, call)) {
+
+			Instr taken = *call;
+
+			block->count -= 2;
+			if (!jump_back(function, block, body, taken)) return false;
+
+		} else if (leaves(function, call)) {
+
+			call->op  = Op_TAILCALL;
+			call->dst = -1;
+			--block->count;
+
+		} else {
+			continue;
+		}
+
+		*changed = true;
+	}
+
+	return !*changed || Procedure_edges(function);
+}
+
+/* a jump back to the start makes a loop of the function */
+Pass const Pass_TAIL = {
+	.name        = "tail",
+	.invalidates = ANALYSES_CFG,
+	.lowered     = run_tail,
+};
@@ -0,0 +1,50 @@
+#include <time.h>
+
+#include "../include/trace.h"
+
+double Trace_wall(void) {
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+double Trace_cpu(void) {
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static Trace* current = NULL;
+
+void Trace_open(Trace* trace, FILE* file) {
+	trace->file   = file;
+	trace->origin = Trace_wall();
+	trace->events = 0;
+	fputs("{\"traceEvents\":[\n", file);
+}
+
+void Trace_close(Trace* trace) {
+	fputs("\n]}\n", trace->file);
+	if (current == trace) current = NULL;
+}
+
+void Trace_use(Trace* trace) {
+	current = trace;
+}
+
+/* names are identifiers and phase names, neither needs escaping */
+static void event(char const* category, char const* name, char phase) {
+
+	if (!current) return;
+
+	fprintf(current->file,
+		"%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1}",
+		current->events++ ? ",\n" : "", name, category, phase,
+		(Trace_wall() - current->origin) * 1e6);
+}
+
+void Trace_begin(char const* category, char const* name) {
+	event(category, name, 'B');
+}
+
+void Trace_end(char const* category, char const* name) {
+	event(category, name, 'E');
+}
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 
 #include "../include/type.h"
+#include "../include/memory.h"
 
 PrimativeType PrimativeType_of(ASType astype) {
 	switch (astype) {
@@ -19,7 +20,7 @@ PrimativeType PrimativeType_of(ASType astype) {
 
 Type* Type_new(DefinitionType definition, PrimativeType type) {
 
-	Type* t = malloc(sizeof (Type));
+	Type* t = Memory_alloc(MemoryTag_TYPE, sizeof (Type));
 	if (!t) return NULL;
 
 	t->definition = definition;
@@ -46,7 +47,7 @@ Type* Type_takes(Type* base, PrimativeType type) {
 	if (base->definition != DefinitionType_FUNCTION)
 		goto fail;
 
-	Parameter* p = malloc(sizeof (Parameter));
+	Parameter* p = Memory_alloc(MemoryTag_TYPE, sizeof (Parameter));
 	if (!p) goto fail;
 
 	p->type = type;
@@ -132,7 +133,7 @@ void Type_free(Type* type) {
 			while (p) {
 				n = p->next;
 				
-				free(p);
+				Memory_free(p);
 
 				p = n;
 			}
@@ -140,7 +141,7 @@ void Type_free(Type* type) {
 		/* fallthrough */
 
 		case DefinitionType_VARIABLE:
-			free(type);
+			Memory_free(type);
 			break;	
 	}
 }
@@ -0,0 +1,582 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <threads.h>
+
+#include "../include/cminus.h"
+#include "../include/trace.h"
+
+/* build with: gcc -std=c11 -pthread -o cminus_test test/cminus_test.c libcminus.a */
+
+/* each test starts from a CMinus of its own, so nothing one of them sets carries over to the next */
+
+static size_t allocations;
+
+static void* counting_allocate(void* state, size_t size) {
+	++allocations;
+	return malloc(size);
+}
+
+static void* counting_reallocate(void* state, void* block, size_t size) {
+	++allocations;
+	return realloc(block, size);
+}
+
+static void counting_release(void* state, void* block) {
+	free(block);
+}
+
+static Allocator const counting = {
+	NULL, counting_allocate, counting_reallocate, counting_release
+};
+
+/* gathers what the pipeline hands out into one buffer */
+static void append_sink(void* state, char const* text, size_t length) {
+	char* buffer = state;
+	strncat(buffer, text, length);
+}
+
+static void discard_sink(void* state, char const* text, size_t length) {
+}
+
+/* what the pass manager kept for the pass called name */
+static PassStats const* pass_stats(PassManager const* passes, char const* name) {
+
+	for (size_t i = 0; i < passes->npasses; ++i) {
+		if (strcmp(passes->stats[i].name, name) == 0) return &passes->stats[i];
+	}
+
+	return NULL;
+}
+
+static CMinus* fresh(int level, Target target) {
+
+	CMinus* cminus = CMinus_new(NULL);
+	assert(cminus);
+
+	CMinus_optimize(cminus, level);
+	CMinus_target(cminus, target);
+
+	return cminus;
+}
+
+/* the output of a compile that has to succeed, valid until the next compile on cminus */
+static char const* compile(CMinus* cminus, char const* source) {
+
+	Compilation result;
+
+	assert(CMinus_compile(cminus, source, strlen(source), &result));
+	assert(result.ndiagnostics == 0);
+
+	return result.output;
+}
+
+/* whether both are in output, first ahead of second */
+static bool ahead(char const* output, char const* first, char const* second) {
+
+	char const* x = strstr(output, first);
+	char const* y = strstr(output, second);
+
+	return x && y && x < y;
+}
+
+/* how often text occurs in output */
+static size_t occurrences(char const* output, char const* text) {
+
+	size_t count = 0;
+
+	for (char const* at = strstr(output, text); at; at = strstr(at + 1, text)) ++count;
+
+	return count;
+}
+
+static char const PROGRAM[] =
+	"int x[10];\n"
+	"int gcd(int u, int v) {\n"
+	"  if (v == 0) return u; else return gcd(v, u - u / v * v);\n"
+	"}\n"
+	"void main(void) {\n"
+	"  x[0] = gcd(input(), input());\n"
+	"  output(x[0]);\n"
+	"}\n";
+
+/* PROGRAM compiled whole at -O0, which every other way of compiling it has to agree with */
+static char* batch(void) {
+
+	CMinus* cminus = fresh(0, Target_MIPS);
+	char*   copy   = strdup(compile(cminus, PROGRAM));
+
+	assert(copy);
+	CMinus_free(cminus);
+
+	return copy;
+}
+
+static void test_compile(void) {
+
+	/* before anything has been allocated, and off again once everything is freed */
+	MemoryStats memory[MemoryTag_COUNT] = { { 0 } };
+	Memory_track(memory);
+
+	CMinus* cminus = CMinus_new(&counting);
+	assert(cminus);
+
+	Compilation first, second;
+	Timings     timings = { 0 };
+
+	CMinus_profile(cminus, &timings);
+	assert(CMinus_compile(cminus, PROGRAM, strlen(PROGRAM), &first));
+	assert(first.ndiagnostics == 0);
+	assert(strstr(first.output, "_f_gcd:"));
+
+	/* each function's IR is charged to its tag and freed once the function is emitted, the time spent is kept per phase */
+	assert(memory[MemoryTag_IR].allocations > 0 && memory[MemoryTag_IR].peak > 0 && memory[MemoryTag_IR].live == 0);
+	assert(timings.phases[Phase_CODEGEN].wall > 0);
+	CMinus_profile(cminus, NULL);
+
+	/* arguments are stored into words the caller's frame set aside, $fp is worked out again instead of saved */
+	assert(strstr(first.output, ", 8($sp)\n  jal _f_gcd\n  addiu $fp, $sp, ") && !strstr(first.output, "sw $fp"));
+
+	/* keep a copy, the output only lives until the next compile */
+	char* saved = malloc(first.length + 1);
+	assert(saved);
+	memcpy(saved, first.output, first.length + 1);
+
+	/* a repeated compile is served from the arena the first one grew */
+	size_t before = allocations;
+
+	assert(CMinus_compile(cminus, PROGRAM, strlen(PROGRAM), &second));
+	assert(allocations == before);
+	assert(second.length == first.length && memcmp(saved, second.output, second.length) == 0);
+
+	CMinus_free(cminus);
+	free(saved);
+	Memory_track(NULL);
+}
+
+static void test_trace(void) {
+
+	FILE* file = tmpfile();
+	assert(file);
+
+	Trace trace;
+	Trace_open(&trace, file);
+	Trace_use(&trace);
+
+	CMinus* cminus = fresh(1, Target_MIPS);
+	compile(cminus, PROGRAM);
+	CMinus_free(cminus);
+
+	Trace_close(&trace);
+
+	long  length = ftell(file);
+	char* json   = calloc(length + 1, 1);
+	assert(json && length > 0);
+
+	rewind(file);
+	assert(fread(json, 1, length, file) == (size_t) length);
+	fclose(file);
+
+	/* each function is a span of its own in semantics and codegen, inside the span of its phase */
+	assert(strstr(json, "{\"name\":\"gcd\",\"cat\":\"semantics\",\"ph\":\"B\""));
+	assert(strstr(json, "{\"name\":\"main\",\"cat\":\"semantics\",\"ph\":\"E\""));
+	assert(ahead(json, "{\"name\":\"codegen\",\"cat\":\"phase\",\"ph\":\"B\"", "{\"name\":\"gcd\",\"cat\":\"codegen\",\"ph\":\"B\""));
+	assert(ahead(json, "{\"name\":\"main\",\"cat\":\"codegen\",\"ph\":\"E\"", "{\"name\":\"codegen\",\"cat\":\"phase\",\"ph\":\"E\""));
+	assert(occurrences(json, "\"cat\":\"pass\"") > 0);
+
+	/* every span that opens closes, and the events make one well formed object */
+	assert(occurrences(json, "\"ph\":\"B\"") == occurrences(json, "\"ph\":\"E\""));
+	assert(occurrences(json, "{") == occurrences(json, "}") && occurrences(json, "[") == 1 && occurrences(json, "]") == 1);
+	assert(strncmp(json, "{\"traceEvents\":[\n", 17) == 0 && strcmp(json + length - 4, "\n]}\n") == 0);
+
+	free(json);
+}
+
+static void test_diagnostics(void) {
+
+	CMinus*     cminus = fresh(0, Target_MIPS);
+	Compilation result;
+
+	/* diagnostics come back structured */
+	char const bad_token[] = "void main(void) {\n  int x;\n  x = 1 ! 2;\n}\n";
+	assert(!CMinus_compile(cminus, bad_token, strlen(bad_token), &result));
+	assert(result.ndiagnostics == 1);
+	assert(result.diagnostics[0].phase == Phase_LEXER && result.diagnostics[0].lineno == 3);
+
+	char const bad_syntax[] = "void main(void) {\n  output(;\n}\n";
+	assert(!CMinus_compile(cminus, bad_syntax, strlen(bad_syntax), &result));
+	assert(result.diagnostics[0].phase == Phase_PARSER && result.diagnostics[0].lineno == 2);
+
+	char const bad_semantics[] = "void main(void) { y = 1; }";
+	assert(!CMinus_compile(cminus, bad_semantics, strlen(bad_semantics), &result));
+	assert(result.diagnostics[0].phase == Phase_SEMANTICS);
+
+	CMinus_free(cminus);
+}
+
+static void test_ir(void) {
+
+	CMinus* cminus = fresh(0, Target_IR);
+
+	/* the same program lowered to IR instead */
+	char const* output = compile(cminus, PROGRAM);
+	assert(strstr(output, "global x 40"));
+	assert(strstr(output, "function gcd(2)"));
+	assert(strstr(output, "call gcd("));
+	assert(!strstr(output, "_f_gcd:"));
+
+	/* the side needing more registers is lowered first, the single load on the left after the subtraction on the right */
+	char const deeper[] = "int a[4]; void main(void) { output(a[1] * (a[2] - a[3])); }";
+	assert(ahead(compile(cminus, deeper), "load [a + 8]", "load [a + 4]"));
+
+	/* -O1 folds literals the way the generated code would have computed them */
+	char const literals[] = "void main(void) { output((4 * 8) - 2); output(7 / (0 - 2)); output(1 / 0); }";
+	CMinus_optimize(cminus, 1);
+	output = compile(cminus, literals);
+	assert(strstr(output, "call output(30)") && strstr(output, "call output(-3)"));
+	assert(strstr(output, "div 1, 0"));
+
+	CMinus_free(cminus);
+}
+
+static void test_loops(void) {
+
+	CMinus* cminus = fresh(1, Target_IR);
+
+	/* the loop is rotated to branch back from its bottom, the bound is loaded once before it */
+	char const  loop[] = "int n; void main(void) { int i; i = 0; while (i < n) i = i + 1; output(i); }";
+	char const* body   = strstr(compile(cminus, loop), "b2: ; preds b1 b2");
+	assert(body && !strstr(body, "load") && strstr(body, "branch lt"));
+
+	/* -O1 leaves the element address to be shifted and added each time round */
+	char const indexed[] = "int x[10]; void main(void) { int i; i = 0; while (i < 10) { x[i] = i; i = i + 1; } }";
+	body = strstr(compile(cminus, indexed), "b2: ; preds b1 b2");
+	assert(body && strstr(body, "sll"));
+	assert(pass_stats(CMinus_passes(cminus), "hoist") && !pass_stats(CMinus_passes(cminus), "induction"));
+
+	/* -O2 steps it along with the counter, finding the loops once for hoist and induction both */
+	CMinus_optimize(cminus, 2);
+	body = strstr(compile(cminus, indexed), "b2: ; preds b1 b2");
+	assert(body && !strstr(body, "sll") && strstr(body, "addu") && strstr(body, ", 4\n"));
+	assert(CMinus_passes(cminus)->lowered.computed[Analysis_LOOPS] == 1);
+	assert(pass_stats(CMinus_passes(cminus), "induction")->changed == 1);
+
+	/* a sum reads i only to find a[i], so the test compares the pointer with the end of a and i no longer counts */
+	char const  walked[] = "int a[10]; void main(void) { int i; int s; i = 0; s = 0; while (i < 10) { s = s + a[i]; i = i + 1; } output(s); }";
+	char const* output   = compile(cminus, walked);
+	body = strstr(output, "b2: ; preds b1 b2");
+	assert(body && strstr(output, "= addr [a + 40]\n") && !strstr(body, "v0.i = add") && !strstr(body, "branch lt v0.i"));
+
+	CMinus_free(cminus);
+}
+
+static void test_calls(void) {
+
+	CMinus* cminus = fresh(2, Target_IR);
+
+	/* gcd calls itself last, which becomes a jump back to its start, main may then inline the loop */
+	char const* output    = compile(cminus, PROGRAM);
+	char const* recursive = strstr(output, "function gcd(2)");
+	char const* caller    = strstr(output, "function main(0)");
+	assert(recursive && caller && (!strstr(recursive, "call gcd(") || strstr(recursive, "call gcd(") > caller));
+
+	/* constant factors need no mult and divisors no div, only the high word of a multiply */
+	char const constants[] = "void main(void) { int x; x = input(); output(x * 10); output(x / 8); output(x / (0 - 7)); }";
+	CMinus_target(cminus, Target_MIPS);
+	output = compile(cminus, constants);
+	assert(!strstr(output, "mflo") && !strstr(output, "div") && strstr(output, "mfhi"));
+
+	/* min costs less than a call to it, so it takes the call's place and says so */
+	char const small[] = "int min(int a, int b) { if (a < b) return a; return b; } void main(void) { output(min(input(), 5)); }";
+	output = compile(cminus, small);
+	assert(strstr(output, "# inlined min, call 2 of main") && !strstr(output, "jal _f_min"));
+
+	/* output and input are made as syscalls in place, so neither is written out of line */
+	assert(!strstr(output, "_f_output") && !strstr(output, "_f_input"));
+
+	/* min takes its arguments in registers, returns in $v0 and calls nothing, so it has no frame to build */
+	assert(strstr(output, "_f_min:\n_f_min_0:\n  move $t0, $a0\n") && strstr(output, "move $v0, $t1\n_f_min_exit:\n  jr $ra\n"));
+
+	/* output and input are still made in place when a function ends by calling them, where any other callee would be jumped to */
+	char const ending[] = "int a[10]; void f(int i, int j) { output(a[i] + a[j]); } int g(void) { return input(); } void main(void) { f(1, 2); output(g()); }";
+	output = compile(cminus, ending);
+	assert(!strstr(output, "_f_output") && !strstr(output, "_f_input"));
+
+	/* stack calls hold whichever order they and the level are set in, and clearing them brings the registers back */
+	CMinus_stack_calls(cminus, true);
+	CMinus_optimize(cminus, 1);
+	assert(strstr(compile(cminus, small), "_f_min_0:\n  lw $t0, 4($fp)\n"));
+	CMinus_stack_calls(cminus, false);
+	output = compile(cminus, small);
+	assert(strstr(output, "_f_min:\n_f_min_0:\n  move $t0, $a0\n"));
+
+	/* inlining is left to -O2, so at -O1 main still calls min */
+	assert(strstr(output, "jal _f_min") && !strstr(output, "# inlined"));
+
+	CMinus_free(cminus);
+}
+
+static void test_registers(void) {
+
+	CMinus* cminus = fresh(1, Target_MIPS);
+
+	/* n lives across the call, so f keeps it in $s0 and saves and restores that around its body */
+	char const  summed[] = "int f(int n) { if (n < 1) return 0; return n + f(n - 1); } void main(void) { output(f(input())); }";
+	char const* output   = compile(cminus, summed);
+	assert(strstr(output, "sw $s0, -4($fp)") && strstr(output, "lw $s0, -4($fp)"));
+
+	/* the test of n branches on the comparison itself, with no register set to hold its outcome */
+	assert(strstr(output, "bge $s0, 1, _f_f_") && !strstr(output, "slt"));
+
+	/* the arrays of the two arms are never in use together, so they share their words */
+	char const arms[] = "void main(void) { if (input()) { int a[10]; a[0] = 1; output(a[0]); } else { int b[10]; b[0] = 2; output(b[0]); } }";
+	assert(strstr(compile(cminus, arms), "# frame of main: 44 bytes, 84 with no slots shared"));
+
+	/* the small globals go in the small data in declaration order and the loop reaches them from $gp, cold is too big for it */
+	char const globals[] = "int cold[100]; int warm[2]; int hot; void main(void) { int i; i = 0; while (i < 10) { hot = hot + i; i = i + 1; } cold[0] = hot; warm[1] = hot; output(cold[0]); }";
+	output = compile(cminus, globals);
+	assert(strstr(output, "-32760($gp)") && strstr(output, ".data 0x10000000\n_v_warm: .space 8\n_v_hot: .space 4\n") && strstr(output, "_v_cold: .space 400\n"));
+
+	CMinus_free(cminus);
+}
+
+static void test_passes(void) {
+
+	CMinus* cminus = fresh(1, Target_MIPS);
+
+	/* fold goes over both functions of a program and reports a change for the one with a sum of literals */
+	char const literal[] = "int f(int n) { return n; } void main(void) { output(f(3 + 4)); }";
+	compile(cminus, literal);
+
+	PassStats const* fold = pass_stats(CMinus_passes(cminus), "fold");
+	assert(fold && fold->runs == 2 && fold->changed == 1);
+
+	/* show moves its argument out of $a0 only to move it straight back for output, which the peephole pass drops */
+	char const echo[] = "void show(int a) { output(a); output(a); } void main(void) { show(input()); show(3); }";
+	compile(cminus, echo);
+	assert(CMinus_peephole(cminus)[Rule_MOVE_BACK] > 0);
+
+	/* i and j are each shifted once, a[j] is still loaded again as the store to a[i] may have changed it */
+	char const repeated[] = "int a[10]; int f(int i, int j) { a[i] = a[i] + a[j]; return a[j]; } void main(void) { output(f(input(), input())); }";
+	assert(strstr(compile(cminus, repeated), "# eliminated 2 redundant expressions in f\n"));
+
+	/* x is still 3 each time round the loop, so the test of it goes and output(9) with it */
+	char const  decided[] = "void main(void) { int x; x = 3; while (input()) { if (x < 5) output(7); else output(9); x = x + 0; } }";
+	char const* output    = compile(cminus, decided);
+	assert(strstr(output, "li $a0, 7") && !strstr(output, "li $a0, 9") && !strstr(output, "bge"));
+
+	CMinus_free(cminus);
+}
+
+static void test_buffered(void) {
+
+	CMinus*    cminus  = fresh(1, Target_MIPS);
+	char const small[] = "int min(int a, int b) { if (a < b) return a; return b; } void main(void) { output(min(input(), 5)); }";
+
+	/* buffered, output goes back to being a call and the buffer is flushed on the way out */
+	CMinus_buffer_output(cminus, true);
+	char const* output = compile(cminus, small);
+	assert(strstr(output, "jal _f_output") && strstr(output, "jal _f_main\n  jal _rt_flush\n"));
+	CMinus_buffer_output(cminus, false);
+
+	/* buffered input reads stdin in bulk with the read syscall */
+	CMinus_buffer_input(cminus, true);
+	output = compile(cminus, small);
+	assert(strstr(output, "jal _f_input") && strstr(output, "li $v0, 14\n"));
+
+	CMinus_free(cminus);
+}
+
+static void test_stream(void) {
+
+	char*       saved    = batch();
+	char*       streamed = calloc(strlen(saved) + 1, 1);
+	CMinus*     cminus   = fresh(0, Target_MIPS);
+	Source      input    = Source_buffer(PROGRAM, strlen(PROGRAM));
+	Compilation result;
+
+	assert(streamed);
+
+	/* compiling one declaration at a time on the calling thread gives what the batch compile does */
+	assert(CMinus_stream(cminus, &input, append_sink, streamed, &result));
+	assert(strcmp(streamed, saved) == 0);
+
+	/* a declaration before an error has already gone to the sink when the error is reported */
+	char const late[] = "int y;\nvoid main(void) {\n  output(;\n}\n";
+
+	streamed[0] = '\0';
+	input       = Source_buffer(late, strlen(late));
+	assert(!CMinus_stream(cminus, &input, append_sink, streamed, &result));
+	assert(result.ndiagnostics == 1 && result.diagnostics[0].phase == Phase_PARSER && result.diagnostics[0].lineno == 3);
+	assert(strstr(streamed, "_v_y: .space 4\n"));
+
+	CMinus_free(cminus);
+	free(streamed);
+	free(saved);
+}
+
+static void test_inliner_budget(void) {
+
+	MemoryStats memory[MemoryTag_COUNT] = { { 0 } };
+	Memory_track(memory);
+
+	CMinus*     cminus = fresh(2, Target_MIPS);
+	char*       calls  = malloc(64 * 4096);
+	size_t      peaks[2];
+	Compilation result;
+
+	assert(calls);
+
+	/* streamed at -O2, the inliner keeps only the most recent small functions, so four times the program peaks at about the same IR */
+	for (int n = 0; n < 2; ++n) {
+
+		size_t length = 0;
+
+		for (int i = 0; i < 1000 << (2 * n); ++i) {
+			length += sprintf(calls + length, "int f%d(int a) { return a + %d; }\n", i, i);
+		}
+
+		length += sprintf(calls + length, "void main(void) { output(f0(1) + f%d(2)); }\n", (1000 << (2 * n)) - 1);
+
+		Source source = Source_buffer(calls, length);
+		memory[MemoryTag_IR].peak = 0;
+		assert(CMinus_stream(cminus, &source, discard_sink, NULL, &result));
+		peaks[n] = memory[MemoryTag_IR].peak;
+	}
+
+	assert(peaks[1] < peaks[0] * 3 / 2 && memory[MemoryTag_IR].live == 0);
+
+	CMinus_free(cminus);
+	free(calls);
+	Memory_track(NULL);
+}
+
+/* the pipeline's stages allocate on one thread and free on another, so these run with tracking off */
+static void test_pipeline(void) {
+
+	char*         saved  = batch();
+	char*         piped  = calloc(strlen(saved) + 1, 1);
+	CMinus*       cminus = fresh(0, Target_MIPS);
+	Source        input  = Source_buffer(PROGRAM, strlen(PROGRAM));
+	Compilation   result;
+	PipelineStats stats;
+
+	assert(piped);
+
+	/* the threaded pipeline agrees with the batch compile, on the thread-safe default allocator */
+	assert(CMinus_pipeline(cminus, &input, append_sink, piped, &result, &stats));
+	assert(strcmp(piped, saved) == 0);
+	assert(stats.stages[Phase_PARSER].items == 3 && stats.stages[Phase_CODEGEN].items == 3);
+
+	char const bad_syntax[] = "void main(void) {\n  output(;\n}\n";
+	input = Source_buffer(bad_syntax, strlen(bad_syntax));
+	assert(!CMinus_pipeline(cminus, &input, discard_sink, NULL, &result, NULL));
+	assert(result.diagnostics[0].phase == Phase_PARSER && result.diagnostics[0].lineno == 2);
+
+	/* an undeclared name early on stops the lexer partway through far more input than the rings hold, and every stage still ends */
+	size_t length = 0;
+	char*  many   = malloc(64 * 4096);
+	assert(many);
+
+	for (int i = 0; i < 4000; ++i) {
+		length += sprintf(many + length, "int f%d(int a) { return a + %d; }\n", i, i);
+		if (i == 100) length += sprintf(many + length, "void h(void) { z = 1; }\n");
+	}
+
+	input = Source_buffer(many, length);
+	assert(!CMinus_pipeline(cminus, &input, discard_sink, NULL, &result, NULL));
+	assert(result.diagnostics[0].phase == Phase_SEMANTICS);
+
+	free(many);
+	CMinus_free(cminus);
+
+	/* any other allocator is called by one stage at a time, so the counting one needs no lock of its own */
+	CMinus* counted = CMinus_new(&counting);
+	size_t  before  = allocations;
+	assert(counted);
+
+	piped[0] = '\0';
+	input    = Source_buffer(PROGRAM, strlen(PROGRAM));
+	assert(CMinus_pipeline(counted, &input, append_sink, piped, &result, NULL));
+	assert(strcmp(piped, saved) == 0 && allocations > before);
+
+	CMinus_free(counted);
+	free(piped);
+	free(saved);
+}
+
+/* one of several compiles running at once, each on its own CMinus with its own settings */
+typedef struct Worker {
+	int         level;
+	bool        buffered;
+	char const* source;
+	char*       expected;
+	bool        ok;
+} Worker;
+
+static int compile_repeatedly(void* arg) {
+
+	Worker*     w      = arg;
+	CMinus*     cminus = CMinus_new(NULL);
+	Compilation result;
+
+	w->ok = cminus != NULL;
+	if (!w->ok) return 0;
+
+	CMinus_optimize(cminus, w->level);
+	CMinus_buffer_output(cminus, w->buffered);
+
+	for (int i = 0; i < 200 && w->ok; ++i) {
+		w->ok = CMinus_compile(cminus, w->source, strlen(w->source), &result) && strcmp(result.output, w->expected) == 0;
+	}
+
+	CMinus_free(cminus);
+	return 0;
+}
+
+static void test_threads(void) {
+
+	/* two instances compiling on two threads at once, at different levels with different builtins, each get what they would alone */
+	char const busy[]     = "int hot; int cold[100]; void main(void) { int i; i = 0; while (i < 10) { hot = hot + i; i = i + 1; } cold[0] = hot; output(cold[0]); output(input()); }";
+	Worker     workers[2] = { { 2, true, busy, NULL, false }, { 0, false, PROGRAM, NULL, false } };
+	thrd_t     threads[2];
+
+	for (int i = 0; i < 2; ++i) {
+
+		CMinus* cminus = fresh(workers[i].level, Target_MIPS);
+
+		CMinus_buffer_output(cminus, workers[i].buffered);
+		workers[i].expected = strdup(compile(cminus, workers[i].source));
+		assert(workers[i].expected);
+
+		CMinus_free(cminus);
+	}
+
+	for (int i = 0; i < 2; ++i) assert(thrd_create(&threads[i], compile_repeatedly, &workers[i]) == thrd_success);
+
+	for (int i = 0; i < 2; ++i) {
+		thrd_join(threads[i], NULL);
+		assert(workers[i].ok);
+		free(workers[i].expected);
+	}
+}
+
+int main(void) {
+
+	test_compile();
+	test_trace();
+	test_diagnostics();
+	test_ir();
+	test_loops();
+	test_calls();
+	test_registers();
+	test_passes();
+	test_buffered();
+	test_stream();
+	test_inliner_budget();
+	test_pipeline();
+	test_threads();
+
+	puts("ok");
+}
@@ -1,6 +1,7 @@
 
 #include <stdio.h>
 
+#include "../src/memory.c"
 #include "../src/type.c"
 
 int main(int argc, char** argv) {
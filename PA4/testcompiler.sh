@@ -6,15 +6,20 @@ codout="$(mktemp)"
 # names of test scripts stripped of extentions
 tests="$(find ./correct_cod/* | sed -E 's/\.in|\.stdout|\.stdin//g' | sort -u)"
 
+# each program is run once per way of compiling it, "" being the plain -O0 compile
+configs=("" "-O1" "-O2" "--stream" "--pipeline")
+
+for flags in "${configs[@]}"; do
 for test in $tests; do
 
 	# dump asm to temporary file
-	./compiler "$test.in" "$codout"
+	./compiler $flags "$test.in" "$codout"
+	status="$?"
 
-	if   [ "$?" = 2 ]; then
-		echo "SEGV $test" 1>&2
-	elif [ "$?" = 3 ]; then
-		echo "SEME $test" 1>&2
+	if   [ "$status" = 2 ]; then
+		echo "SEGV $test $flags" 1>&2
+	elif [ "$status" = 3 ]; then
+		echo "SEME $test $flags" 1>&2
 	else
 
 		# load expected output
@@ -28,9 +33,10 @@ for test in $tests; do
 				# echo "PASS $test"
 				true
 			else
-				echo "FAIL $test" 1>&2
+				echo "FAIL $test $flags" 1>&2
 		fi
 	fi
 done
+done
 
 rm "$codout"
\ No newline at end of file